@@ -26,6 +26,8 @@ uniform sampler2D specular_texture;
 uniform sampler2D normal_map;
 uniform sampler2D emissive_texture;
 uniform sampler2D shadow_map;
+uniform sampler2D fog_of_war;
+uniform bool fog_of_war_on;
 
 
 uniform sampler2D unique_splatmaps[2];
@@ -48,7 +50,6 @@ layout(std140) uniform ProfileSettings {
 
 const bool NORMAL_DEBUG = false;
 const bool SPLAT_DEBUG = false;
-const bool FOG_OF_WAR_ON = false;
 
 // Range: 0 to 4
 // 0 is sharp
@@ -245,14 +246,9 @@ void main() {
         visibility = 1.0;
     }
 
-    if (FOG_OF_WAR_ON){
-        // Fade off at 20
-        if (fog_dist > 20.0){
-            float old_visibility = visibility;
-            visibility = 1 / pow((fog_dist - 20), 1);
-            visibility = min(old_visibility, visibility);
-            visibility = max(0.2, visibility);
-        }
+    if (fog_of_war_on){
+        // Seen now is lit, seen before is dim, never seen is darker still
+        visibility *= max(texture(fog_of_war, Splatcoord).r, 0.15);
     }
 
     vec4 texel;
@@ -0,0 +1,196 @@
+#include "collision_avoidance.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+const float CollisionAvoidance::EPSILON = 0.00001f;
+
+CollisionAvoidance::Line CollisionAvoidance::avoid(glm::vec2 relative_position, glm::vec2 relative_velocity, glm::vec2 velocity, float combined_radius, float time_horizon, float responsibility){
+    Line line;
+    glm::vec2 change;
+
+    float distance_squared = glm::dot(relative_position, relative_position);
+    float combined_radius_squared = combined_radius * combined_radius;
+
+    if (distance_squared > combined_radius_squared){
+        // Not touching yet. The velocities that touch within the horizon are
+        // a cone cut off by a circle, find the nearest point on its edge.
+        glm::vec2 w = relative_velocity - relative_position / time_horizon;
+        float w_length_squared = glm::dot(w, w);
+        float along = glm::dot(w, relative_position);
+
+        if (along < 0.0f && along * along > combined_radius_squared * w_length_squared){
+            // Nearest the cut-off circle
+            float w_length = std::sqrt(w_length_squared);
+            glm::vec2 unit_w = w / w_length;
+
+            line.direction = glm::vec2(unit_w.y, -unit_w.x);
+            change = (combined_radius / time_horizon - w_length) * unit_w;
+        } else {
+            // Nearest one of the cone's sides
+            float leg = std::sqrt(distance_squared - combined_radius_squared);
+
+            if (cross(relative_position, w) > 0.0f){
+                line.direction = glm::vec2(relative_position.x * leg - relative_position.y * combined_radius,
+                                           relative_position.x * combined_radius + relative_position.y * leg) / distance_squared;
+            } else {
+                line.direction = -glm::vec2(relative_position.x * leg + relative_position.y * combined_radius,
+                                            -relative_position.x * combined_radius + relative_position.y * leg) / distance_squared;
+            }
+
+            change = glm::dot(relative_velocity, line.direction) * line.direction - relative_velocity;
+        }
+    } else {
+        // Already overlapping, get apart within the next step
+        glm::vec2 w = relative_velocity - relative_position;
+        float w_length = std::sqrt(glm::dot(w, w));
+
+        if (w_length < EPSILON){
+            w = -relative_position;
+            w_length = std::sqrt(glm::dot(w, w));
+        }
+
+        glm::vec2 unit_w = w / w_length;
+
+        line.direction = glm::vec2(unit_w.y, -unit_w.x);
+        change = (combined_radius - w_length) * unit_w;
+    }
+
+    line.point = velocity + responsibility * change;
+    return line;
+}
+
+glm::vec2 CollisionAvoidance::findVelocity(const vector<Line>& lines, int hard_lines, float max_speed, glm::vec2 preferred){
+    glm::vec2 result;
+
+    int failed_line = solve(lines, max_speed, preferred, false, result);
+    if (failed_line < lines.size()){
+        solveLeastViolating(lines, hard_lines, failed_line, max_speed, result);
+    }
+
+    return result;
+}
+
+bool CollisionAvoidance::solveOnLine(const vector<Line>& lines, int line, float max_speed, glm::vec2 preferred, bool along_direction, glm::vec2& result){
+    const Line& current = lines[line];
+
+    // Where the line crosses the speed circle
+    float along = glm::dot(current.point, current.direction);
+    float discriminant = along * along + max_speed * max_speed - glm::dot(current.point, current.point);
+
+    if (discriminant < 0.0f){
+        return false;
+    }
+
+    float root = std::sqrt(discriminant);
+    float t_left = -along - root;
+    float t_right = -along + root;
+
+    // Cut the segment down by every line before this one
+    for (int i = 0; i < line; ++i){
+        float denominator = cross(current.direction, lines[i].direction);
+        float numerator = cross(lines[i].direction, current.point - lines[i].point);
+
+        if (std::fabs(denominator) <= EPSILON){
+            // Parallel, either all of this line is allowed or none of it
+            if (numerator < 0.0f){
+                return false;
+            }
+            continue;
+        }
+
+        float t = numerator / denominator;
+        if (denominator >= 0.0f){
+            t_right = std::min(t_right, t);
+        } else {
+            t_left = std::max(t_left, t);
+        }
+
+        if (t_left > t_right){
+            return false;
+        }
+    }
+
+    if (along_direction){
+        // As far as the segment goes in the preferred direction
+        if (glm::dot(preferred, current.direction) > 0.0f){
+            result = current.point + t_right * current.direction;
+        } else {
+            result = current.point + t_left * current.direction;
+        }
+    } else {
+        // The closest point of the segment
+        float t = glm::dot(current.direction, preferred - current.point);
+        t = std::max(t_left, std::min(t, t_right));
+        result = current.point + t * current.direction;
+    }
+
+    return true;
+}
+
+int CollisionAvoidance::solve(const vector<Line>& lines, float max_speed, glm::vec2 preferred, bool along_direction, glm::vec2& result){
+    if (along_direction){
+        // preferred is a unit direction here
+        result = preferred * max_speed;
+    } else if (glm::dot(preferred, preferred) > max_speed * max_speed){
+        result = preferred * (max_speed / std::sqrt(glm::dot(preferred, preferred)));
+    } else {
+        result = preferred;
+    }
+
+    // Incremental 2d linear program. The answer only moves when a line rules
+    // it out, and then the new one is on that line.
+    for (int i = 0; i < lines.size(); ++i){
+        if (cross(lines[i].direction, lines[i].point - result) > 0.0f){
+            glm::vec2 previous_result = result;
+
+            if (!solveOnLine(lines, i, max_speed, preferred, along_direction, result)){
+                result = previous_result;
+                return i;
+            }
+        }
+    }
+
+    return lines.size();
+}
+
+void CollisionAvoidance::solveLeastViolating(const vector<Line>& lines, int hard_lines, int failed_line, float max_speed, glm::vec2& result){
+    // Too crowded for any velocity to keep clear of everyone. Find the one
+    // that breaks the soft lines by the least, with the hard ones kept.
+    float distance = 0.0f;
+    vector<Line> projected_lines;
+
+    for (int i = failed_line; i < lines.size(); ++i){
+        if (cross(lines[i].direction, lines[i].point - result) <= distance){
+            continue;
+        }
+
+        projected_lines.assign(lines.begin(), lines.begin() + hard_lines);
+
+        for (int j = hard_lines; j < i; ++j){
+            Line line;
+            float determinant = cross(lines[i].direction, lines[j].direction);
+
+            if (std::fabs(determinant) <= EPSILON){
+                if (glm::dot(lines[i].direction, lines[j].direction) > 0.0f){
+                    // Same direction, adds nothing
+                    continue;
+                }
+                line.point = 0.5f * (lines[i].point + lines[j].point);
+            } else {
+                line.point = lines[i].point + (cross(lines[j].direction, lines[i].point - lines[j].point) / determinant) * lines[i].direction;
+            }
+
+            line.direction = glm::normalize(lines[j].direction - lines[i].direction);
+            projected_lines.push_back(line);
+        }
+
+        glm::vec2 previous_result = result;
+        if (solve(projected_lines, max_speed, glm::vec2(-lines[i].direction.y, lines[i].direction.x), true, result) < projected_lines.size()){
+            // Only rounding can get here, keep what we had
+            result = previous_result;
+        }
+
+        distance = cross(lines[i].direction, lines[i].point - result);
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef CollisionAvoidance_h
+#define CollisionAvoidance_h
+
+#include "includes/glm.hpp"
+
+#include <vector>
+
+using namespace std;
+
+// Optimal reciprocal collision avoidance (ORCA), after van den Berg et al.
+// Every unit or obstacle nearby rules out the half of the velocity plane
+// that would bring us into it within a time horizon. The velocity we use is
+// the one closest to the one we wanted that's in every remaining half.
+//
+// Between two units each one only takes half of the turn away, trusting the
+// other to take the rest, so neither has to know what the other decided.
+// Obstacles don't move, so against them we take all of it.
+//
+// Everything is in the x-z plane, velocities in distance per simulation
+// step and times in steps.
+class CollisionAvoidance {
+public:
+    // The allowed velocities are those on the left of the line, looking
+    // along direction
+    struct Line {
+        glm::vec2 point;
+        glm::vec2 direction;
+    };
+
+    // The half-plane for something at relative_position (from us) that we
+    // close in on at relative_velocity. responsibility is our share of the
+    // turn, a half against a unit and all of it against an obstacle.
+    static Line avoid(glm::vec2 relative_position, glm::vec2 relative_velocity, glm::vec2 velocity, float combined_radius, float time_horizon, float responsibility);
+
+    // The velocity no faster than max_speed closest to preferred that is on
+    // the allowed side of every line. The first hard_lines lines are kept
+    // whatever happens; when no velocity meets them all, the rest are given
+    // up as little as possible.
+    static glm::vec2 findVelocity(const vector<Line>& lines, int hard_lines, float max_speed, glm::vec2 preferred);
+
+private:
+    static bool solveOnLine(const vector<Line>& lines, int line, float max_speed, glm::vec2 preferred, bool along_direction, glm::vec2& result);
+    static int solve(const vector<Line>& lines, float max_speed, glm::vec2 preferred, bool along_direction, glm::vec2& result);
+    static void solveLeastViolating(const vector<Line>& lines, int hard_lines, int failed_line, float max_speed, glm::vec2& result);
+
+    static float cross(glm::vec2 a, glm::vec2 b) {return a.x * b.y - a.y * b.x;}
+
+    static const float EPSILON;
+};
+
+#endif
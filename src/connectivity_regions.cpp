@@ -0,0 +1,181 @@
+#include "connectivity_regions.hpp"
+
+#include "pathing_grid.hpp"
+
+const int ConnectivityRegions::NO_REGION;
+const int ConnectivityRegions::SECTOR_SIZE;
+const int ConnectivityRegions::MAX_SECTOR_REGIONS;
+
+// Same neighbourhood as PathFinder, which lets diagonal steps squeeze past
+// corners, so regions are 8-connected
+static const int NEIGHBOR_X[8] = { 1, 1, 1, 0, 0, -1, -1, -1 };
+static const int NEIGHBOR_Z[8] = { -1, 0, 1, -1, 1, -1, 0, 1 };
+
+ConnectivityRegions::ConnectivityRegions() : has_dirty_sectors(false), width(0), depth(0), sectors_x(0), sectors_z(0), clearance(0) {
+
+}
+
+ConnectivityRegions::ConnectivityRegions(int width, int depth, int clearance) : width(width), depth(depth), clearance(clearance) {
+    sectors_x = (width + SECTOR_SIZE - 1) / SECTOR_SIZE;
+    sectors_z = (depth + SECTOR_SIZE - 1) / SECTOR_SIZE;
+
+    cell_region.assign(width * depth, NO_REGION);
+    parent.assign(sectors_x * sectors_z * MAX_SECTOR_REGIONS, 0);
+
+    sector_dirty.assign(sectors_x * sectors_z, true);
+    has_dirty_sectors = true;
+}
+
+int ConnectivityRegions::getRegion(PathingGrid& ground, int index_x, int index_z){
+    if (index_x < 0 || index_z < 0 || index_x >= width || index_z >= depth){
+        return NO_REGION;
+    }
+
+    if (has_dirty_sectors){
+        rebuild(ground);
+    }
+
+    int label = cell_region[index_x + index_z * width];
+    if (label == NO_REGION){
+        return NO_REGION;
+    }
+
+    return findRoot(label);
+}
+
+void ConnectivityRegions::markDirty(int min_x, int min_z, int max_x, int max_z){
+    // A sector's labels depend only on its own cells, the border join is
+    // redone anyway
+    int min_sector_x = std::max(min_x / SECTOR_SIZE, 0);
+    int min_sector_z = std::max(min_z / SECTOR_SIZE, 0);
+    int max_sector_x = std::min(max_x / SECTOR_SIZE, sectors_x - 1);
+    int max_sector_z = std::min(max_z / SECTOR_SIZE, sectors_z - 1);
+
+    for (int sector_z = min_sector_z; sector_z <= max_sector_z; ++sector_z){
+        for (int sector_x = min_sector_x; sector_x <= max_sector_x; ++sector_x){
+            sector_dirty[sector_x + sector_z * sectors_x] = true;
+            has_dirty_sectors = true;
+        }
+    }
+}
+
+void ConnectivityRegions::rebuild(PathingGrid& ground){
+    for (int sector = 0; sector < sector_dirty.size(); ++sector){
+        if (sector_dirty[sector]){
+            labelSector(ground, sector);
+            sector_dirty[sector] = false;
+        }
+    }
+
+    joinSectors();
+    has_dirty_sectors = false;
+}
+
+void ConnectivityRegions::labelSector(PathingGrid& ground, int sector){
+    int min_x = (sector % sectors_x) * SECTOR_SIZE;
+    int min_z = (sector / sectors_x) * SECTOR_SIZE;
+    int max_x = std::min(min_x + SECTOR_SIZE, width) - 1;
+    int max_z = std::min(min_z + SECTOR_SIZE, depth) - 1;
+
+    int start_x = ground.getStartX();
+    int start_z = ground.getStartZ();
+
+    for (int z = min_z; z <= max_z; ++z){
+        for (int x = min_x; x <= max_x; ++x){
+            cell_region[x + z * width] = NO_REGION;
+        }
+    }
+
+    int next_label = sector * MAX_SECTOR_REGIONS;
+
+    for (int z = min_z; z <= max_z; ++z){
+        for (int x = min_x; x <= max_x; ++x){
+            if (cell_region[x + z * width] != NO_REGION || !ground.canPath(x + start_x, z + start_z, clearance)){
+                continue;
+            }
+
+            // Flood the patch without leaving the sector
+            int label = next_label++;
+            cell_region[x + z * width] = label;
+            open_cells.push_back(x + z * width);
+
+            while (!open_cells.empty()){
+                int current = open_cells.back();
+                open_cells.pop_back();
+
+                for (int i = 0; i < 8; ++i){
+                    int n_x = (current % width) + NEIGHBOR_X[i];
+                    int n_z = (current / width) + NEIGHBOR_Z[i];
+
+                    if (n_x < min_x || n_z < min_z || n_x > max_x || n_z > max_z){
+                        continue;
+                    }
+
+                    int n = n_x + n_z * width;
+                    if (cell_region[n] == NO_REGION && ground.canPath(n_x + start_x, n_z + start_z, clearance)){
+                        cell_region[n] = label;
+                        open_cells.push_back(n);
+                    }
+                }
+            }
+        }
+    }
+}
+
+void ConnectivityRegions::joinSectors(){
+    for (int i = 0; i < parent.size(); ++i){
+        parent[i] = i;
+    }
+
+    // Across every vertical sector border, including its diagonal steps
+    for (int x = SECTOR_SIZE - 1; x + 1 < width; x += SECTOR_SIZE){
+        for (int z = 0; z < depth; ++z){
+            int label = cell_region[x + z * width];
+            if (label == NO_REGION){
+                continue;
+            }
+
+            for (int n_z = std::max(z - 1, 0); n_z <= std::min(z + 1, depth - 1); ++n_z){
+                int other = cell_region[(x + 1) + n_z * width];
+                if (other != NO_REGION){
+                    join(label, other);
+                }
+            }
+        }
+    }
+
+    // And every horizontal one
+    for (int z = SECTOR_SIZE - 1; z + 1 < depth; z += SECTOR_SIZE){
+        for (int x = 0; x < width; ++x){
+            int label = cell_region[x + z * width];
+            if (label == NO_REGION){
+                continue;
+            }
+
+            for (int n_x = std::max(x - 1, 0); n_x <= std::min(x + 1, width - 1); ++n_x){
+                int other = cell_region[n_x + (z + 1) * width];
+                if (other != NO_REGION){
+                    join(label, other);
+                }
+            }
+        }
+    }
+}
+
+int ConnectivityRegions::findRoot(int label){
+    // Path halving keeps later lookups close to O(1)
+    while (parent[label] != label){
+        parent[label] = parent[parent[label]];
+        label = parent[label];
+    }
+    return label;
+}
+
+void ConnectivityRegions::join(int label_a, int label_b){
+    int root_a = findRoot(label_a);
+    int root_b = findRoot(label_b);
+
+    if (root_a != root_b){
+        parent[std::max(root_a, root_b)] = std::min(root_a, root_b);
+    }
+}
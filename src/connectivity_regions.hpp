@@ -0,0 +1,62 @@
+#ifndef ConnectivityRegions_h
+#define ConnectivityRegions_h
+
+#include <vector>
+
+using namespace std;
+
+class PathingGrid;
+
+// Connected components of a pathing grid for one clearance class. Two cells
+// with the same region can reach each other, so a search towards a cell in
+// another region is known to fail before it starts.
+//
+// The grid is cut into SECTOR_SIZE squares that are labelled on their own,
+// and the sector labels are then joined across the sector borders. An edit
+// only relabels the sectors under it, the join over the borders is cheap.
+class ConnectivityRegions {
+public:
+    ConnectivityRegions();
+    ConnectivityRegions(int width, int depth, int clearance);
+
+    // Region of a cell, in grid indices, or NO_REGION if units of this
+    // clearance can't stand there
+    int getRegion(PathingGrid& ground, int index_x, int index_z);
+
+    // Sectors under the area (grid indices) get relabelled on the next lookup
+    void markDirty(int min_x, int min_z, int max_x, int max_z);
+
+    static const int NO_REGION = -1;
+    static const int SECTOR_SIZE = 16;
+
+    // The most separate 8-connected patches a sector can hold
+    static const int MAX_SECTOR_REGIONS = (SECTOR_SIZE / 2) * (SECTOR_SIZE / 2);
+
+private:
+    void rebuild(PathingGrid& ground);
+    void labelSector(PathingGrid& ground, int sector);
+    void joinSectors();
+
+    int findRoot(int label);
+    void join(int label_a, int label_b);
+
+    // Per cell, sector * MAX_SECTOR_REGIONS + the patch inside the sector
+    vector<int> cell_region;
+
+    // Union-find over the sector labels
+    vector<int> parent;
+
+    vector<bool> sector_dirty;
+    bool has_dirty_sectors;
+
+    // Reused between sector floods
+    vector<int> open_cells;
+
+    int width;
+    int depth;
+    int sectors_x;
+    int sectors_z;
+    int clearance;
+};
+
+#endif
@@ -131,6 +131,16 @@ void DebugConsole::parseInput(){
                 // level->getTerrain()->setPaintLayer(layer_num);
             } catch (std::invalid_argument e){
 
+            }
+        } else if (tokens[1] == "speed" && tokens.size() > 2){
+            // Fast forward (or slow down) the simulation, drawing stays at
+            // the same rate
+            try {
+                float speed = std::stof(tokens[2]);
+                GameClock::getInstance()->setSimulationSpeed(speed);
+                Debug::info("Simulation speed: %.2f\n", GameClock::getInstance()->getSimulationSpeed());
+            } catch (std::invalid_argument e){
+
             }
         }
     } else if (tokens[0] == "swap"){
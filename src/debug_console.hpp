@@ -7,6 +7,7 @@
 #include "core_ui/ui_window.hpp"
 #include "debug.hpp"
 #include "input_handler.hpp"
+#include "game_clock.hpp"
 
 class DebugConsole : public UIWindow {
 public:
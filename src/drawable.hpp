@@ -14,7 +14,7 @@
 
 class Drawable {
 public:
-    Drawable () {;}
+    Drawable () : mesh(0), shader(0) {;}
     Drawable(Mesh&, Shader& shader);
     Drawable(Mesh&, Shader& shader, glm::vec3, GLfloat);
     virtual Drawable* clone() = 0;
@@ -0,0 +1,207 @@
+#include "flow_field.hpp"
+
+const float FlowField::UNREACHABLE = 1e30f;
+const unsigned char FlowField::NO_DIRECTION;
+
+// Same neighbourhood and step costs as PathFinder. Diagonal steps squeeze
+// past corners there and in ConnectivityRegions, so they do here too, or
+// a group would stop where one unit's path goes through.
+static const int NEIGHBOR_X[8] = { 1, 1, 1, 0, 0, -1, -1, -1 };
+static const int NEIGHBOR_Z[8] = { -1, 0, 1, -1, 1, -1, 0, 1 };
+static const float NEIGHBOR_COST[8] = { 1.4f, 1.0f, 1.4f, 1.0f, 1.0f, 1.4f, 1.0f, 1.4f };
+
+FlowField::FlowField(PathingGrid& ground, float goal_x, float goal_z, int clearance) : clearance(clearance) {
+    width = ground.getWidth();
+    depth = ground.getDepth();
+    start_x = ground.getStartX();
+    start_z = ground.getStartZ();
+
+    this->goal_x = int(goal_x);
+    this->goal_z = int(goal_z);
+    clampGoal(ground, this->goal_x, this->goal_z);
+
+    integrate(ground);
+    computeDirections(ground);
+}
+
+void FlowField::clampGoal(PathingGrid& ground, int& goal_x, int& goal_z){
+    goal_x = std::max(ground.getStartX(), std::min(goal_x, ground.getStartX() + ground.getWidth() - 1));
+    goal_z = std::max(ground.getStartZ(), std::min(goal_z, ground.getStartZ() + ground.getDepth() - 1));
+}
+
+bool FlowField::getDirection(float x, float z, glm::vec3& direction){
+    int index = getIndex(x, z);
+    if (index < 0 || this->direction[index] == NO_DIRECTION){
+        return false;
+    }
+
+    int i = this->direction[index];
+    direction = glm::normalize(glm::vec3(NEIGHBOR_X[i], 0.0f, NEIGHBOR_Z[i]));
+    return true;
+}
+
+float FlowField::getCost(float x, float z){
+    int index = getIndex(x, z);
+    if (index < 0){
+        return UNREACHABLE;
+    }
+    return integration[index];
+}
+
+int FlowField::getIndex(float x, float z){
+    int index_x = int(x) - start_x;
+    int index_z = int(z) - start_z;
+
+    if (index_x < 0 || index_z < 0 || index_x >= width || index_z >= depth){
+        return -1;
+    }
+    return index_x + index_z * width;
+}
+
+void FlowField::integrate(PathingGrid& ground){
+    // Dijkstra outwards from the goal over every cell a unit of this size can
+    // stand on. The goal itself is seeded even when blocked, so units still
+    // gather as close to it as they can.
+    integration.assign(width * depth, UNREACHABLE);
+
+    IndexedHeap frontier(width * depth);
+
+    int goal = (goal_x - start_x) + (goal_z - start_z) * width;
+    integration[goal] = 0.0f;
+    frontier.push(goal, 0.0f);
+
+    while (!frontier.empty()){
+        float cost = frontier.topKey();
+        int current = frontier.pop();
+        int x = current % width;
+        int z = current / width;
+
+        for (int i = 0; i < 8; ++i){
+            int n_x = x + NEIGHBOR_X[i];
+            int n_z = z + NEIGHBOR_Z[i];
+
+            if (!ground.canPath(n_x + start_x, n_z + start_z, clearance)){
+                continue;
+            }
+
+            int n = n_x + n_z * width;
+            float n_cost = cost + NEIGHBOR_COST[i];
+
+            if (n_cost < integration[n]){
+                bool queued = integration[n] < UNREACHABLE;
+                integration[n] = n_cost;
+
+                if (queued && frontier.contains(n)){
+                    frontier.decreaseKey(n, n_cost);
+                } else if (!queued){
+                    frontier.push(n, n_cost);
+                }
+            }
+        }
+    }
+}
+
+void FlowField::computeDirections(PathingGrid& ground){
+    // Each cell points at its cheapest neighbour
+    direction.assign(width * depth, NO_DIRECTION);
+
+    for (int z = 0; z < depth; ++z){
+        for (int x = 0; x < width; ++x){
+            int current = x + z * width;
+            float best = integration[current];
+
+            if (best >= UNREACHABLE){
+                continue;
+            }
+
+            for (int i = 0; i < 8; ++i){
+                int n_x = x + NEIGHBOR_X[i];
+                int n_z = z + NEIGHBOR_Z[i];
+
+                if (n_x < 0 || n_z < 0 || n_x >= width || n_z >= depth){
+                    continue;
+                }
+
+                float n_cost = integration[n_x + n_z * width];
+                if (n_cost < best){
+                    best = n_cost;
+                    direction[current] = i;
+                }
+            }
+        }
+    }
+}
+
+void FlowField::saveState(Snapshot& snapshot){
+    snapshot.write(width);
+    snapshot.write(depth);
+    snapshot.write(start_x);
+    snapshot.write(start_z);
+    snapshot.write(goal_x);
+    snapshot.write(goal_z);
+    snapshot.write(clearance);
+    snapshot.writeVector(integration);
+    snapshot.writeVector(direction);
+}
+
+shared_ptr<FlowField> FlowField::loadState(Snapshot& snapshot, PathingGrid& ground){
+    shared_ptr<FlowField> field(new FlowField());
+
+    snapshot.read(field->width);
+    snapshot.read(field->depth);
+    snapshot.read(field->start_x);
+    snapshot.read(field->start_z);
+    snapshot.read(field->goal_x);
+    snapshot.read(field->goal_z);
+    snapshot.read(field->clearance);
+    snapshot.readVector(field->integration);
+    snapshot.readVector(field->direction);
+
+    size_t cell_count = size_t(field->width) * field->depth;
+
+    if (!snapshot.isGood() || field->width != ground.getWidth() || field->depth != ground.getDepth() ||
+        field->start_x != ground.getStartX() || field->start_z != ground.getStartZ() ||
+        field->integration.size() != cell_count || field->direction.size() != cell_count){
+        return shared_ptr<FlowField>();
+    }
+
+    return field;
+}
+
+FlowFieldCache::FlowFieldCache(PathingGrid& ground) : ground(&ground) {
+    PathingGrid::Change_Callback_Type callback = std::bind(&FlowFieldCache::invalidate, this,
+        std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4);
+    change_callback_id = ground.addChangeCallback(callback);
+}
+
+FlowFieldCache::~FlowFieldCache(){
+    ground->removeChangeCallback(change_callback_id);
+}
+
+shared_ptr<FlowField> FlowFieldCache::find(int goal_x, int goal_z, int clearance){
+    FlowField::clampGoal(*ground, goal_x, goal_z);
+
+    // Forget the fields nobody is following any more
+    for (auto it = fields.begin(); it != fields.end();){
+        if (it->second.expired()){
+            it = fields.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    auto it = fields.find(std::make_tuple(goal_x, goal_z, clearance));
+    if (it == fields.end()){
+        return shared_ptr<FlowField>();
+    }
+    return it->second.lock();
+}
+
+void FlowFieldCache::insert(shared_ptr<FlowField> field){
+    fields[std::make_tuple(field->getGoalX(), field->getGoalZ(), field->getClearance())] = field;
+}
+
+void FlowFieldCache::invalidate(int min_x, int min_z, int max_x, int max_z){
+    // A single blocked cell can change distances anywhere on the map
+    fields.clear();
+}
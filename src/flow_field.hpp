@@ -0,0 +1,91 @@
+#ifndef FlowField_h
+#define FlowField_h
+
+#include "includes/glm.hpp"
+
+#include <vector>
+#include <map>
+#include <memory>
+#include <tuple>
+
+#include "pathing_grid.hpp"
+#include "indexed_heap.hpp"
+#include "snapshot.hpp"
+
+using namespace std;
+
+// Every cell's walking distance to one goal (the integration field), and
+// which neighbour to step to from there (the direction field). Built once
+// per order, then any number of units can follow it by sampling the cell
+// they stand on, instead of each carrying its own path.
+class FlowField {
+public:
+    FlowField(PathingGrid& ground, float goal_x, float goal_z, int clearance);
+
+    // Unit vector towards the goal from the cell under (x, z). False when
+    // there is nowhere to go from there: off the field, unreachable, or
+    // already on the goal cell.
+    bool getDirection(float x, float z, glm::vec3& direction);
+    float getCost(float x, float z);
+
+    // Orders off the edge of the map lead to the nearest cell on it. Fields
+    // are kept under the goal this gives.
+    static void clampGoal(PathingGrid& ground, int& goal_x, int& goal_z);
+
+    int getGoalX() {return goal_x;}
+    int getGoalZ() {return goal_z;}
+    int getClearance() {return clearance;}
+
+    // Both fields as they are, so a snapshot doesn't have to build them
+    // again. Load gives nothing back if the field doesn't fit this ground.
+    void saveState(Snapshot& snapshot);
+    static shared_ptr<FlowField> loadState(Snapshot& snapshot, PathingGrid& ground);
+
+    static const float UNREACHABLE;
+
+private:
+    FlowField() {}
+
+    int getIndex(float x, float z);
+
+    void integrate(PathingGrid& ground);
+    void computeDirections(PathingGrid& ground);
+
+    vector<float> integration;
+    vector<unsigned char> direction;
+
+    int width;
+    int depth;
+    int start_x;
+    int start_z;
+
+    int goal_x;
+    int goal_z;
+    int clearance;
+
+    static const unsigned char NO_DIRECTION = 8;
+};
+
+// Fields still being followed, so orders to the same spot share one. Units
+// hold the shared_ptr while they follow a field; once the last one lets go
+// the field is freed and its entry here expires. Any edit to the grid drops
+// every entry. Units already underway keep the field they have until
+// UnitManager hands them a new one.
+class FlowFieldCache {
+public:
+    FlowFieldCache(PathingGrid& ground);
+    ~FlowFieldCache();
+
+    shared_ptr<FlowField> find(int goal_x, int goal_z, int clearance);
+    void insert(shared_ptr<FlowField> field);
+
+private:
+    void invalidate(int min_x, int min_z, int max_x, int max_z);
+
+    map<tuple<int, int, int>, weak_ptr<FlowField>> fields;
+
+    PathingGrid* ground;
+    int change_callback_id;
+};
+
+#endif
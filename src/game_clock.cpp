@@ -1,12 +1,25 @@
 #include "game_clock.hpp"
 
+#include <cmath>
+#include <algorithm>
+
 GameClock* GameClock::instance;
 
+// 60 Hz, the rate unit speeds were tuned at
+const float GameClock::SIMULATION_STEP = 1.0f / 60.0f;
+const int GameClock::MAX_CATCH_UP_STEPS;
+
 GameClock::GameClock(){
-    current_time = last_time = getCurrentTime();
+    started = false;
+    current_time = last_time = 0.0f;
+    delta_time = 0.0f;
     tick_count = 0;
     average_delta_time = 0.0f;
 
+    unsimulated_time = 0.0f;
+    simulation_speed = 1.0f;
+    simulation_steps = 0;
+
 }
 
 GameClock* GameClock::getInstance(){
@@ -21,6 +34,12 @@ GameClock* GameClock::getInstance(){
 void GameClock::tick(){
     ++tick_count;
 
+    // The first frame starts the clock, nothing has passed before it
+    if(!started){
+        current_time = getCurrentTime();
+        started = true;
+    }
+
     last_time = current_time;
     current_time = getCurrentTime();
     delta_time = current_time - last_time;
@@ -29,6 +48,8 @@ void GameClock::tick(){
     average_delta_time = (average_delta_time *
         (float)(tick_count-1)/(float)tick_count)
         + (delta_time / (float)tick_count);
+
+    unsimulated_time += delta_time * simulation_speed;
 }
 
 void GameClock::resetAverage(){
@@ -51,3 +72,48 @@ float GameClock::getDeltaTime(){
 float GameClock::getAverageDeltaTime(){
     return average_delta_time;
 }
+
+int GameClock::takeSimulationSteps(){
+    int steps = int(unsimulated_time / SIMULATION_STEP);
+
+    // Fast forwarding is meant to take more steps a frame, so the cap
+    // grows with the speed
+    int max_steps = MAX_CATCH_UP_STEPS * std::max(1, int(std::ceil(simulation_speed)));
+
+    if(steps > max_steps){
+        steps = max_steps;
+        unsimulated_time = std::fmod(unsimulated_time, SIMULATION_STEP);
+    } else {
+        unsimulated_time -= steps * SIMULATION_STEP;
+    }
+
+    return steps;
+}
+
+void GameClock::advanceSimulationStep(){
+    ++simulation_steps;
+}
+
+float GameClock::getInterpolation(){
+    return std::min(unsimulated_time / SIMULATION_STEP, 1.0f);
+}
+
+float GameClock::getSimulationTime(){
+    return double(simulation_steps) * SIMULATION_STEP;
+}
+
+long GameClock::getSimulationSteps(){
+    return simulation_steps;
+}
+
+void GameClock::setSimulationSteps(long steps){
+    simulation_steps = steps;
+}
+
+void GameClock::setSimulationSpeed(float speed){
+    simulation_speed = std::max(speed, 0.0f);
+}
+
+float GameClock::getSimulationSpeed(){
+    return simulation_speed;
+}
@@ -9,6 +9,8 @@ class GameClock {
 public:
     static GameClock* getInstance();
 
+    // The real time is first read on the first tick, so a game run with
+    // no window, which never ticks, never needs SDL
     void tick();
     void resetAverage();
 
@@ -16,12 +18,42 @@ public:
     float getDeltaTime();
     float getAverageDeltaTime();
 
+    // The simulation runs in fixed steps of SIMULATION_STEP seconds, however
+    // fast frames are drawn. tick() banks the time that passed (scaled by
+    // the simulation speed) and takeSimulationSteps() hands out the whole
+    // steps that are due, at most MAX_CATCH_UP_STEPS per frame at normal
+    // speed. Time past the cap is dropped, so the game slows down rather
+    // than spiralling when steps take longer than frames.
+    int takeSimulationSteps();
+
+    // Counts a step as it is taken. Simulation time only moves on with the
+    // steps that really happened, so it's the same wherever they run, even
+    // when one waits on the network or runs flat out with nothing drawn.
+    void advanceSimulationStep();
+
+    // How far the frame is between the last two steps, from 0 to 1
+    float getInterpolation();
+
+    // Seconds of simulated time, which is what game logic should time with
+    float getSimulationTime();
+
+    // Steps taken so far, put back when a saved game is loaded
+    long getSimulationSteps();
+    void setSimulationSteps(long steps);
+
+    // 2 runs the simulation twice as fast, 0 pauses it
+    void setSimulationSpeed(float speed);
+    float getSimulationSpeed();
+
+    static const float SIMULATION_STEP;
+    static const int MAX_CATCH_UP_STEPS = 5;
 
 private:
     GameClock();
 
     static GameClock* instance;
 
+    bool started;
     float current_time;
     float last_time;
     float delta_time;
@@ -29,6 +61,10 @@ private:
     int tick_count;
     float average_delta_time;
 
+    float unsimulated_time;
+    float simulation_speed;
+    long simulation_steps;
+
 };
 
 #endif
@@ -1,10 +1,11 @@
 #include "game_map.hpp"
 
-GameMap::GameMap(string map_filename, UnitHolder& units, RenderDeque& render_stack, ResourceLoader& resource_loader) : camera(), ground(), unit_holder(&units), render_stack(&render_stack),  resource_loader(&resource_loader),has_temp_drawable(false),  shadowbuffer(1.0), depthbuffer(1.0), shadow_shader("shaders/shadow.vs", "shaders/shadow.fs"), depth_shader("shaders/depth.vs", "shaders/depth.fs") {
+GameMap::GameMap(string map_filename, UnitHolder& units, RenderDeque& render_stack, ResourceLoader& resource_loader) : camera(), ground(), unit_holder(&units), render_stack(&render_stack),  resource_loader(&resource_loader),has_temp_drawable(false),  shadowbuffer(1.0), depthbuffer(1.0), shadow_shader("shaders/shadow.vs", "shaders/shadow.fs"), depth_shader("shaders/depth.vs", "shaders/depth.fs"), viewing_team(1), fog_of_war(0) {
 
     ifstream map_input(map_filename);
     if (map_input) {
         load(map_input);
+        ground.getPathingGrid().loadNavigationMeshes(getNavigationMeshFilename(map_filename));
     } else {
         loadBlankGameMap();
     }
@@ -17,6 +18,8 @@ GameMap::GameMap(string map_filename, UnitHolder& units, RenderDeque& render_sta
 }
 
 void GameMap::render(){
+    updateFogOfWar();
+
     // Render the shadow map into the shadow buffer
     if (Profile::getInstance()->isShadowsOn()){
         renderToShadowMap();
@@ -65,8 +68,11 @@ void GameMap::renderAllNoShader() {
     }
 
     // Draw all the units
-    for (Playable& unit : unit_holder->getUnits()){
-        unit.draw();
+    for (int id = 0; id < unit_holder->getUnitCount(); ++id){
+        Playable& unit = unit_holder->getUnit(id);
+        if (!isHidden(unit)){
+            unit_holder->getModel(id).draw(unit);
+        }
     }
 
     // Draw the ground
@@ -120,16 +126,23 @@ void GameMap::renderAllWithShader(Shader& shader, Framebuffer& buf) {
         doodad.setShader(current_shader);
     }
 
-    // Draw all the units
-    for (Playable& unit : unit_holder->getUnits()){
+    // Draw all the units, hidden ones don't cast shadows either
+    for (int id = 0; id < unit_holder->getUnitCount(); ++id){
+        Playable& unit = unit_holder->getUnit(id);
+        if (isHidden(unit)){
+            continue;
+        }
+
+        UnitModel& model = unit_holder->getModel(id);
+
         // Save the shader this drawable is currently using
-        Shader& current_shader = unit.getShader();
+        Shader& current_shader = model.getShader();
         // Set the drawable to render with the shadow shader
-        unit.setShader(shader);
+        model.setShader(shader);
         // Draw the drawable from the light's perspective
-        unit.draw();
+        model.draw(unit);
         // Reset the drawable's shader to what it was before
-        unit.setShader(current_shader);
+        model.setShader(current_shader);
     }
 
 
@@ -160,6 +173,13 @@ void GameMap::setTempDrawable(Drawable& drawable) {
 void GameMap::placeTempDrawable() {
     Drawable* new_drawable = temp_drawable->clone();
     addDrawable(*new_drawable);
+
+    // Units can't walk through what was just placed. Anything built on the
+    // pathing grid (cached paths, path graphs) hears about it from there.
+    glm::vec3 position = new_drawable->getPosition();
+    int footprint = int(ceil(new_drawable->getScale()));
+    ground.getPathingGrid().setAreaPathable(int(position.x) - footprint, int(position.z) - footprint,
+                                            int(position.x) + footprint, int(position.z) + footprint, false);
 }
 
 void GameMap::removeTempDrawable() {
@@ -217,6 +237,68 @@ string GameMap::asJsonString() {
     return json_string;
 }
 
+void GameMap::updateFogOfWar(){
+    VisibilityGrid& visibility = unit_holder->getVisibility();
+    const vector<unsigned char>& image = visibility.getImage(viewing_team);
+
+    // Nothing to show until the team has units
+    if (image.empty()){
+        return;
+    }
+
+    int width = visibility.getWidth();
+    int depth = visibility.getDepth();
+
+    glActiveTexture(GL_TEXTURE0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    if (!fog_of_war){
+        glGenTextures(1, &fog_of_war);
+        glBindTexture(GL_TEXTURE_2D, fog_of_war);
+
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, width, depth, 0, GL_RED, GL_UNSIGNED_BYTE, image.data());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        // All of it just went up
+        int min_x, min_z, max_x, max_z;
+        visibility.takeChangedArea(viewing_team, min_x, min_z, max_x, max_z);
+
+        ground.setFogOfWar(fog_of_war);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        return;
+    }
+
+    // Only the rectangle that changed goes up, read out of the whole image
+    int min_x, min_z, max_x, max_z;
+    if (visibility.takeChangedArea(viewing_team, min_x, min_z, max_x, max_z)){
+        glBindTexture(GL_TEXTURE_2D, fog_of_war);
+
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, width);
+        glPixelStorei(GL_UNPACK_SKIP_PIXELS, min_x);
+        glPixelStorei(GL_UNPACK_SKIP_ROWS, min_z);
+
+        glTexSubImage2D(GL_TEXTURE_2D, 0, min_x, min_z, max_x - min_x + 1, max_z - min_z + 1, GL_RED, GL_UNSIGNED_BYTE, image.data());
+
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+        glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+bool GameMap::isHidden(Playable& unit){
+    if (unit.getTeam() == viewing_team){
+        return false;
+    }
+
+    glm::vec3 position = unit.getPosition();
+    return !unit_holder->getVisibility().isVisible(viewing_team, position.x, position.z);
+}
+
 Shadowbuffer& GameMap::getShadowbuffer() {
     return shadowbuffer;
 }
@@ -281,6 +363,21 @@ void GameMap::load(ifstream& map_input){
 
 }
 
+void GameMap::saveNavigationMeshes(string map_filename){
+    PathingGrid& pathing_grid = ground.getPathingGrid();
+
+    // Every size of unit on the map, so none of them build one on load
+    for (Playable& unit : unit_holder->getUnits()){
+        pathing_grid.getNavigationMesh(PathingGrid::getClearanceClass(unit.getRadius()));
+    }
+
+    pathing_grid.saveNavigationMeshes(getNavigationMeshFilename(map_filename));
+}
+
+string GameMap::getNavigationMeshFilename(string map_filename){
+    return map_filename + ".navmesh";
+}
+
 void GameMap::loadBlankGameMap() {
     // WOAH this is hardcode
 
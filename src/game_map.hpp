@@ -43,6 +43,15 @@ public:
     Camera& getCamera();
     Terrain& getGround();
 
+    // Whose fog of war is drawn. Other teams' units it can't see aren't.
+    void setViewingTeam(int team) {viewing_team = team;}
+
+    // The ground's navigation meshes live next to the map file, so loading
+    // the map doesn't have to build them again
+    void saveNavigationMeshes(string map_filename);
+
+    static string getNavigationMeshFilename(string map_filename);
+
 
 private:
 
@@ -56,6 +65,10 @@ private:
 
     void loadBlankGameMap();
 
+    // Uploads the parts of the viewing team's visibility that changed
+    void updateFogOfWar();
+    bool isHidden(Playable& unit);
+
     glm::vec3 getIntersection(glm::vec3 line, float plane_height);
     glm::vec3 calculateRay(glm::vec2 screen_point);
     std::tuple<float, float, glm::vec3> findMapPoint(glm::vec3 ray, int steps, float bottom, float top);
@@ -86,6 +99,9 @@ private:
     GLuint camera_ubo;
     GLuint shadow_ubo;
 
+    int viewing_team;
+    GLuint fog_of_war;
+
 };
 
 #endif
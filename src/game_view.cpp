@@ -1,5 +1,7 @@
 #include "game_view.hpp"
 
+#define QUICK_SAVE_FILENAME "quicksave.snapshot"
+
 GameView::GameView(Level& level, RenderDeque& render_stack) : level(&level), gamebuffer(), ui_buffer(), render_stack(&render_stack), healthbar(Texture("res/textures/healthbar_test.png", GL_NEAREST, false), UIDrawable::Center) {
 
     // // Gaussian Blur shaders
@@ -42,6 +44,9 @@ GameView::GameView(Level& level, RenderDeque& render_stack) : level(&level), gam
 
     menu_key_state = false;
 
+    quick_save_key_state = false;
+    quick_load_key_state = false;
+
     mouse_count = 0;
     left_mouse_button_unclick = false;
 
@@ -67,8 +72,18 @@ void GameView::update(){
     // Swap display/rendering buffers
     Window::getInstance()->display();
 
-    // Update the units
-    level->getUnitManager().updateUnits();
+    // The searches get one frame's budget, however many steps are due
+    level->getUnitManager().updatePaths();
+
+    // Step the units at the fixed simulation rate, as many times as are due
+    // since the last frame. Drawing blends between the last two steps.
+    int steps = GameClock::getInstance()->takeSimulationSteps();
+    for (int i = 0; i < steps; ++i){
+        // Waiting on the other player, the rest of the steps are dropped
+        if (!level->getUnitManager().updateUnits()){
+            break;
+        }
+    }
 
     // Render things
     drawCore();
@@ -99,12 +114,15 @@ void GameView::drawCore(){
     // Push the ui framebuffer to the rendering stack
     render_stack->enqueueFramebuffer(ui_buffer);
 
-    glm::vec3 unit_pos = level->getUnitHolder().getUnits()[0].getPosition();
-    Camera& camera = level->getGameMap().getCamera();
-    glm::vec2 healthbar_pos = GLMHelpers::calculateScreenPosition(camera.getProjectionMatrix(), camera.getViewMatrix(), (unit_pos + glm::vec3(0, 3, 0)));
-    healthbar_pos += glm::vec2(0, 0.01);
-    healthbar.setGLPosition(healthbar_pos);
-    healthbar.draw();
+    // Dead units are removed, there may be nobody left to follow
+    if (level->getUnitHolder().getUnitCount() > 0){
+        glm::vec3 unit_pos = level->getUnitHolder().getUnits()[0].getRenderPosition();
+        Camera& camera = level->getGameMap().getCamera();
+        glm::vec2 healthbar_pos = GLMHelpers::calculateScreenPosition(camera.getProjectionMatrix(), camera.getViewMatrix(), (unit_pos + glm::vec3(0, 3, 0)));
+        healthbar_pos += glm::vec2(0, 0.01);
+        healthbar.setGLPosition(healthbar_pos);
+        healthbar.draw();
+    }
 
     // Draw all of the ui elements on top of the level
     for(int i = 0; i < ui_drawables.size(); ++i){
@@ -260,6 +278,12 @@ void GameView::handleInput(SDL_Event event){
             } else if ((key_scancode == SDL_SCANCODE_P) && (!printscreen_key_state)){
                 printscreen_key_state = true;
                 Window::getInstance()->takeScreenshot();
+            } else if ((key_scancode == SDL_SCANCODE_F5) && (!quick_save_key_state)){
+                quick_save_key_state = true;
+                level->getUnitManager().saveSnapshot(QUICK_SAVE_FILENAME);
+            } else if ((key_scancode == SDL_SCANCODE_F9) && (!quick_load_key_state)){
+                quick_load_key_state = true;
+                level->getUnitManager().loadSnapshot(QUICK_SAVE_FILENAME);
             }
         break;
 
@@ -274,6 +298,10 @@ void GameView::handleInput(SDL_Event event){
                 menu_key_state = false;
             } else if (key_scancode == SDL_SCANCODE_P){
                 printscreen_key_state = false;
+            } else if (key_scancode == SDL_SCANCODE_F5){
+                quick_save_key_state = false;
+            } else if (key_scancode == SDL_SCANCODE_F9){
+                quick_load_key_state = false;
             }
         break;
 
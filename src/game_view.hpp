@@ -72,6 +72,9 @@ protected:
 
     bool printscreen_key_state;
 
+    bool quick_save_key_state;
+    bool quick_load_key_state;
+
     UIWindow* menu;
     bool menu_key_state;
 
@@ -0,0 +1,185 @@
+#include "headless_simulation.hpp"
+
+#include <cstdio>
+#include <cinttypes>
+#include <chrono>
+#include <random>
+#include <fstream>
+#include <algorithm>
+
+#include "includes/json.hpp"
+#include "terrain_pathing.hpp"
+#include "game_map.hpp"
+#include "debug.hpp"
+
+// The unit UnitHolder::populate makes for the game
+#define UNIT_FILENAME "res/units/airship.xml"
+
+#define SPAWN_ATTEMPTS 100
+
+HeadlessSimulation::HeadlessSimulation(string map_filename, int unit_count, unsigned int seed) : map_filename(map_filename), unit_manager(0) {
+    if (!loadGround(map_filename)){
+        return;
+    }
+
+    unit_manager = new UnitManager(ground, unit_holder);
+
+    if (unit_count > 0){
+        spawnUnits(unit_count, seed);
+    } else {
+        unit_holder.populate(seed);
+    }
+}
+
+void HeadlessSimulation::startBattle(){
+    if (!unit_manager){
+        return;
+    }
+
+    // Each army goes for the middle of the other one's side
+    PathingGrid& grid = ground.getPathingGrid();
+    float min_x = grid.getStartX();
+    float max_x = grid.getStartX() + grid.getWidth();
+
+    orderAttack(min_x, 0.0f, max_x / 2.0f);
+    orderAttack(0.0f, max_x, min_x / 2.0f);
+}
+
+HeadlessSimulation::~HeadlessSimulation(){
+    delete unit_manager;
+}
+
+bool HeadlessSimulation::loadGround(string map_filename){
+    ifstream map_input(map_filename);
+    if (!map_input){
+        Debug::error("Could not open map %s.\n", map_filename.c_str());
+        return false;
+    }
+
+    string map_contents((istreambuf_iterator<char>(map_input)), istreambuf_iterator<char>());
+
+    Json::Value root;
+    Json::Reader reader;
+    if (!reader.parse(map_contents, root)){
+        Debug::error("Failed to parse map\n%s", reader.getFormattedErrorMessages().c_str());
+        return false;
+    }
+
+    // Only the heights, the same way GameMap's Terrain reads them
+    const Json::Value& terrain_json = root["terrain"];
+    string heightmap_filename = root["texture_path"].asString() + terrain_json["heightmap"].asString();
+    float amplification = terrain_json["amplification"].asFloat();
+
+    vector<float> heights;
+    int width;
+    int depth;
+    if (!TerrainPathing::loadHeights(heightmap_filename, amplification, heights, width, depth)){
+        return false;
+    }
+
+    ground = Terrain(heights, width, depth, amplification);
+    ground.getPathingGrid().loadNavigationMeshes(GameMap::getNavigationMeshFilename(map_filename));
+
+    return true;
+}
+
+void HeadlessSimulation::spawnUnits(int unit_count, unsigned int seed){
+    PathingGrid& grid = ground.getPathingGrid();
+
+    std::mt19937 random(seed);
+
+    // Team 1 on the left half of the map and team 2 on the right
+    for (int i = 0; i < unit_count; ++i){
+        int team = 1 + (i % 2);
+
+        Playable unit(glm::vec3(0.0f));
+        unit.loadFromXML(UNIT_FILENAME);
+        unit.setFlying(true);
+        unit.setTeam(team);
+
+        int clearance = PathingGrid::getClearanceClass(unit.getRadius());
+        int half_width = grid.getWidth() / 2;
+
+        std::uniform_int_distribution<int> place_x(team == 1 ? grid.getStartX() : grid.getStartX() + half_width,
+                                                   team == 1 ? grid.getStartX() + half_width - 1 : grid.getStartX() + grid.getWidth() - 1);
+        std::uniform_int_distribution<int> place_z(grid.getStartZ(), grid.getStartZ() + grid.getDepth() - 1);
+
+        // Somewhere it fits, or it's left out
+        for (int attempt = 0; attempt < SPAWN_ATTEMPTS; ++attempt){
+            int x = place_x(random);
+            int z = place_z(random);
+
+            if (grid.canPath(x, z, clearance)){
+                unit.setPosition(glm::vec3(x, ground.getHeightInterpolated(x, z), z));
+                unit_holder.addUnit(unit);
+                break;
+            }
+        }
+    }
+}
+
+void HeadlessSimulation::orderAttack(float from_min_x, float from_max_x, float target_x){
+    // Dragging a box over the army, like the player would
+    PathingGrid& grid = ground.getPathingGrid();
+    glm::vec3 corner_a = glm::vec3(from_min_x, 0.0f, grid.getStartZ());
+    glm::vec3 corner_b = glm::vec3(from_max_x, 0.0f, grid.getStartZ() + grid.getDepth());
+
+    unit_manager->tempSelectUnits(corner_a, corner_b);
+    unit_manager->selectUnits(corner_a, corner_b);
+    unit_manager->issueOrder(Playable::Order::ATTACK, glm::vec3(target_x, 0.0f, 0.0f), false);
+}
+
+void HeadlessSimulation::run(int steps){
+    if (!unit_manager){
+        return;
+    }
+
+    vector<double> step_times;
+    step_times.reserve(steps);
+
+    // The dead are removed as they fall
+    int starting_units = unit_holder.getUnitCount();
+
+    std::chrono::steady_clock::time_point run_start = std::chrono::steady_clock::now();
+
+    long first_step = unit_manager->getStepCount();
+
+    while (unit_manager->getStepCount() - first_step < steps){
+        std::chrono::steady_clock::time_point step_start = std::chrono::steady_clock::now();
+
+        // No frames without a window, each step gets the searches' budget
+        unit_manager->updatePaths();
+
+        if (!unit_manager->updateUnits()){
+            // Waiting on a lockstep peer isn't a step, so it isn't timed as
+            // one
+            if (unit_manager->isPlaybackFinished()){
+                break;
+            }
+            continue;
+        }
+
+        std::chrono::duration<double, std::milli> step_time = std::chrono::steady_clock::now() - step_start;
+        step_times.push_back(step_time.count());
+    }
+
+    std::chrono::duration<double> run_time = std::chrono::steady_clock::now() - run_start;
+    double seconds = run_time.count();
+
+    double mean = 0.0;
+    for (double step_time : step_times){
+        mean += step_time;
+    }
+    int steps_taken = step_times.size();
+    mean /= std::max(steps_taken, 1);
+
+    std::sort(step_times.begin(), step_times.end());
+    double worst = step_times.empty() ? 0.0 : step_times.back();
+    double p99 = step_times.empty() ? 0.0 : step_times[std::min(int(steps_taken * 0.99), steps_taken - 1)];
+
+    printf("{\"map\": \"%s\", \"units\": %d, \"alive\": %d, \"steps\": %d, \"seconds\": %.3f, "
+           "\"steps_per_second\": %.1f, \"mean_step_ms\": %.3f, \"p99_step_ms\": %.3f, \"max_step_ms\": %.3f, "
+           "\"checksum\": \"%016" PRIx64 "\"}\n",
+           map_filename.c_str(), starting_units, unit_holder.getUnitCount(), steps_taken, seconds,
+           seconds > 0.0 ? steps_taken / seconds : 0.0, mean, p99, worst, unit_holder.getChecksum());
+}
@@ -0,0 +1,59 @@
+#ifndef HeadlessSimulation_h
+#define HeadlessSimulation_h
+
+#include <string>
+#include <vector>
+
+#include "terrain.hpp"
+#include "unit_holder.hpp"
+#include "unit_manager.hpp"
+
+using namespace std;
+
+// The game's simulation with nothing drawn. The map's terrain and pathing are
+// built from its heightmap on the CPU and the units are made without meshes
+// or textures, so none of it needs a window or a GL context. Steps run back
+// to back instead of waiting for the clock.
+//
+// Two armies start on opposite sides of the map and attack-move across it,
+// so a run covers pathing, avoidance and fighting. Placement comes from the
+// seed, so runs with the same seed can be compared. With no unit count the
+// game's own starting units are made instead, and nobody is ordered
+// anywhere.
+class HeadlessSimulation {
+public:
+    HeadlessSimulation(string map_filename, int unit_count, unsigned int seed = DEFAULT_SEED);
+    ~HeadlessSimulation();
+
+    // False if the map couldn't be loaded, and there's nothing to run
+    bool isLoaded() {return unit_manager != 0;}
+
+    // Sends each army at the other one's side of the map. Left out when a
+    // replay is giving the orders instead.
+    void startBattle();
+
+    UnitManager& getUnitManager() {return *unit_manager;}
+    UnitHolder& getUnitHolder() {return unit_holder;}
+
+    // Runs the steps as fast as they'll go, then prints one JSON line with
+    // how long they took
+    void run(int steps);
+
+    static const int DEFAULT_UNIT_COUNT = 500;
+    static const unsigned int DEFAULT_SEED = 1;
+
+private:
+    bool loadGround(string map_filename);
+    void spawnUnits(int unit_count, unsigned int seed);
+    void orderAttack(float from_min_x, float from_max_x, float target_x);
+
+    string map_filename;
+
+    Terrain ground;
+    UnitHolder unit_holder;
+
+    // Made once the ground is loaded, it keeps a pointer to the grid
+    UnitManager* unit_manager;
+};
+
+#endif
@@ -0,0 +1,534 @@
+#include "hierarchical_pathfinder.hpp"
+
+const int HierarchicalPathFinder::CLUSTER_SIZE;
+const int HierarchicalPathFinder::WIDE_ENTRANCE;
+const int HierarchicalPathFinder::MAX_ENTRANCES;
+const int HierarchicalPathFinder::REFINED_SEGMENTS;
+
+static const float UNREACHABLE = 1e30f;
+
+// Same neighbourhood and step costs as PathFinder
+static const int NEIGHBOR_X[8] = { 1, 1, 1, 0, 0, -1, -1, -1 };
+static const int NEIGHBOR_Z[8] = { -1, 0, 1, -1, 1, -1, 0, 1 };
+static const float NEIGHBOR_COST[8] = { 1.4f, 1.0f, 1.4f, 1.0f, 1.0f, 1.4f, 1.0f, 1.4f };
+
+HierarchicalPathFinder::HierarchicalPathFinder(PathingGrid& ground, PathFinder& local_pathfinder) : ground(&ground), local_pathfinder(&local_pathfinder) {
+    width = ground.getWidth();
+    depth = ground.getDepth();
+    clusters_x = (width + CLUSTER_SIZE - 1) / CLUSTER_SIZE;
+    clusters_z = (depth + CLUSTER_SIZE - 1) / CLUSTER_SIZE;
+    nodes_expanded = 0;
+    refined_count = 0;
+
+    cluster_distance.assign(CLUSTER_SIZE * CLUSTER_SIZE, UNREACHABLE);
+    cluster_stamp.assign(CLUSTER_SIZE * CLUSTER_SIZE, 0);
+    cluster_generation = 0;
+    cluster_frontier.resize(CLUSTER_SIZE * CLUSTER_SIZE);
+
+    int abstract_nodes = clusters_x * clusters_z * MAX_ENTRANCES + 2;
+    abstract_g.assign(abstract_nodes, UNREACHABLE);
+    abstract_parent.assign(abstract_nodes, -1);
+    abstract_cell.assign(abstract_nodes, -1);
+    abstract_stamp.assign(abstract_nodes, 0);
+    abstract_generation = 0;
+    abstract_frontier.resize(abstract_nodes);
+
+    start_costs.assign(MAX_ENTRANCES, UNREACHABLE);
+    goal_costs.assign(MAX_ENTRANCES, UNREACHABLE);
+
+    // Only the clusters under an edit get rebuilt
+    PathingGrid::Change_Callback_Type callback = std::bind(&HierarchicalPathFinder::markDirty, this,
+        std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4);
+    change_callback_id = ground.addChangeCallback(callback);
+}
+
+HierarchicalPathFinder::~HierarchicalPathFinder(){
+    ground->removeChangeCallback(change_callback_id);
+}
+
+vector<glm::vec3> HierarchicalPathFinder::find_path(float start_x, float start_z, float target_x, float target_z, float radius){
+    int clearance = PathingGrid::getClearanceClass(radius);
+    nodes_expanded = 0;
+    refined_count = 0;
+
+    int start_index_x = int(start_x) - ground->getStartX();
+    int start_index_z = int(start_z) - ground->getStartZ();
+    int target_index_x = int(target_x) - ground->getStartX();
+    int target_index_z = int(target_z) - ground->getStartZ();
+
+    // Short hops and anything the abstract graph can't answer (a blocked
+    // start or target, or one in another region) go straight to the grid
+    // search, which knows where to go instead.
+    bool is_short = abs(start_index_x / CLUSTER_SIZE - target_index_x / CLUSTER_SIZE) <= 1 &&
+        abs(start_index_z / CLUSTER_SIZE - target_index_z / CLUSTER_SIZE) <= 1;
+
+    if (is_short || !isWalkable(start_index_x, start_index_z, clearance) || !isWalkable(target_index_x, target_index_z, clearance) ||
+        ground->getRegion(int(start_x), int(start_z), clearance) != ground->getRegion(int(target_x), int(target_z), clearance) ||
+        ground->canPathOnLine(start_x, start_z, target_x, target_z, clearance)){
+        vector<glm::vec3> path = local_pathfinder->find_path(start_x, start_z, target_x, target_z, radius);
+        nodes_expanded = local_pathfinder->getNodesExpanded();
+        refined_count = path.size();
+        return path;
+    }
+
+    AbstractGraph& graph = getGraph(clearance);
+
+    int start_cell = start_index_x + start_index_z * width;
+    int goal_cell = target_index_x + target_index_z * width;
+
+    vector<int> abstract_path;
+    if (!searchAbstract(graph, start_cell, goal_cell, clearance, abstract_path)){
+        // Not connected, the grid search knows how to get close instead
+        vector<glm::vec3> path = local_pathfinder->find_path(start_x, start_z, target_x, target_z, radius);
+        nodes_expanded += local_pathfinder->getNodesExpanded();
+        refined_count = path.size();
+        return path;
+    }
+
+    // The abstract path in world coordinates, ending at the real target
+    vector<glm::vec3> points;
+    for (int i = 1; i < abstract_path.size() - 1; ++i){
+        int cell = abstract_path[i];
+        points.push_back(glm::vec3((cell % width) + ground->getStartX(), 0.0f, (cell / width) + ground->getStartZ()));
+    }
+    points.push_back(glm::vec3(target_x, 0.0f, target_z));
+
+    // Refine the first few segments. Consecutive entrances are always
+    // connected inside a cluster, so a segment with a clear straight line
+    // costs one line check, and only segments that bend around something
+    // need a (cluster sized) grid search.
+    int segments = std::min(int(points.size()), REFINED_SEGMENTS);
+
+    vector<glm::vec3> waypoints;
+    glm::vec3 from(start_x, 0.0f, start_z);
+    for (int i = 0; i < segments; ++i){
+        refineSegment(from, points[i], clearance, radius, waypoints);
+        from = points[i];
+    }
+
+    // Pull the string across the cluster borders so units don't zig-zag
+    // through every entrance.
+    vector<glm::vec3> final;
+    glm::vec3 anchor(start_x, 0.0f, start_z);
+    for (int i = 0; i < waypoints.size() - 1; ++i){
+        if (!ground->canPathOnLine(anchor.x, anchor.z, waypoints[i + 1].x, waypoints[i + 1].z, clearance)){
+            final.push_back(waypoints[i]);
+            anchor = waypoints[i];
+        }
+    }
+    final.push_back(waypoints.back());
+    refined_count = final.size();
+
+    // The rest waits for refineNext
+    final.insert(final.end(), points.begin() + segments, points.end());
+
+    return final;
+}
+
+bool HierarchicalPathFinder::refineNext(vector<glm::vec3>& path, int& refined, float radius){
+    if (refined <= 0 || refined >= path.size()){
+        return false;
+    }
+
+    int clearance = PathingGrid::getClearanceClass(radius);
+
+    // Everything up to the segment's end point goes in front of it
+    vector<glm::vec3> waypoints;
+    refineSegment(path[refined - 1], path[refined], clearance, radius, waypoints);
+    path.insert(path.begin() + refined, waypoints.begin(), waypoints.end() - 1);
+
+    refined += waypoints.size();
+    return true;
+}
+
+void HierarchicalPathFinder::refineSegment(glm::vec3 from, glm::vec3 to, int clearance, float radius, vector<glm::vec3>& waypoints){
+    if (!ground->canPathOnLine(from.x, from.z, to.x, to.z, clearance)){
+        vector<glm::vec3> segment = local_pathfinder->find_path(from.x, from.z, to.x, to.z, radius);
+        nodes_expanded += local_pathfinder->getNodesExpanded();
+        waypoints.insert(waypoints.end(), segment.begin(), segment.end());
+    }
+
+    if (waypoints.empty() || waypoints.back() != to){
+        waypoints.push_back(to);
+    }
+}
+
+HierarchicalPathFinder::AbstractGraph& HierarchicalPathFinder::getGraph(int clearance){
+    map<int, AbstractGraph>::iterator it = graphs.find(clearance);
+
+    if (it == graphs.end()){
+        AbstractGraph graph;
+        graph.clusters.resize(clusters_x * clusters_z);
+        for (Cluster& cluster : graph.clusters){
+            cluster.dirty = true;
+        }
+        graph.has_dirty_clusters = true;
+        it = graphs.insert(std::make_pair(clearance, graph)).first;
+    }
+
+    if (it->second.has_dirty_clusters){
+        rebuildDirtyClusters(it->second, clearance);
+    }
+
+    return it->second;
+}
+
+void HierarchicalPathFinder::rebuildDirtyClusters(AbstractGraph& graph, int clearance){
+    // A dirty cluster's borders may have changed, and those borders are
+    // shared with its four neighbours, so they need new entrances too.
+    // Clusters further out keep theirs: they link to entrances by cell, not
+    // by position in a neighbour's list.
+    int cluster_count = clusters_x * clusters_z;
+    vector<bool> rebuild(cluster_count, false);
+
+    for (int k = 0; k < cluster_count; ++k){
+        if (!graph.clusters[k].dirty){
+            continue;
+        }
+
+        int cx = k % clusters_x;
+        int cz = k / clusters_x;
+
+        rebuild[k] = true;
+        if (cx > 0) rebuild[k - 1] = true;
+        if (cx < clusters_x - 1) rebuild[k + 1] = true;
+        if (cz > 0) rebuild[k - clusters_x] = true;
+        if (cz < clusters_z - 1) rebuild[k + clusters_x] = true;
+    }
+
+    for (int k = 0; k < cluster_count; ++k){
+        if (rebuild[k]){
+            buildCluster(graph, k, clearance);
+        }
+    }
+
+    graph.has_dirty_clusters = false;
+}
+
+void HierarchicalPathFinder::buildCluster(AbstractGraph& graph, int k, int clearance){
+    Cluster& cluster = graph.clusters[k];
+    cluster.cells.clear();
+    cluster.links.clear();
+    cluster.dirty = false;
+
+    int cx = k % clusters_x;
+    int cz = k / clusters_x;
+
+    if (cx > 0) addBorderEntrances(k, k - 1, true, clearance, cluster);
+    if (cx < clusters_x - 1) addBorderEntrances(k, k + 1, true, clearance, cluster);
+    if (cz > 0) addBorderEntrances(k, k - clusters_x, false, clearance, cluster);
+    if (cz < clusters_z - 1) addBorderEntrances(k, k + clusters_x, false, clearance, cluster);
+
+    // Walking distance between every pair of entrances
+    int count = cluster.cells.size();
+    cluster.distances.assign(count * count, UNREACHABLE);
+
+    for (int i = 0; i < count; ++i){
+        searchCluster(k, cluster.cells[i], clearance);
+        for (int j = 0; j < count; ++j){
+            cluster.distances[i * count + j] = getClusterDistance(cluster.cells[j]);
+        }
+    }
+}
+
+void HierarchicalPathFinder::addBorderEntrances(int k, int neighbor, bool horizontal, int clearance, Cluster& result){
+    // Horizontal neighbours share a column of cells on each side, vertical
+    // neighbours a row. Find the runs where both sides are walkable.
+    int cx = k % clusters_x;
+    int cz = k / clusters_x;
+    int nx = neighbor % clusters_x;
+    int nz = neighbor / clusters_x;
+
+    int line_self, line_other, span_start, span_end;
+    if (horizontal){
+        line_self = (nx > cx) ? (cx + 1) * CLUSTER_SIZE - 1 : cx * CLUSTER_SIZE;
+        line_other = line_self + ((nx > cx) ? 1 : -1);
+        span_start = cz * CLUSTER_SIZE;
+        span_end = std::min(span_start + CLUSTER_SIZE, depth) - 1;
+    } else {
+        line_self = (nz > cz) ? (cz + 1) * CLUSTER_SIZE - 1 : cz * CLUSTER_SIZE;
+        line_other = line_self + ((nz > cz) ? 1 : -1);
+        span_start = cx * CLUSTER_SIZE;
+        span_end = std::min(span_start + CLUSTER_SIZE, width) - 1;
+    }
+
+    int run_start = -1;
+    for (int t = span_start; t <= span_end + 1; ++t){
+        bool open = false;
+        if (t <= span_end){
+            if (horizontal){
+                open = isWalkable(line_self, t, clearance) && isWalkable(line_other, t, clearance);
+            } else {
+                open = isWalkable(t, line_self, clearance) && isWalkable(t, line_other, clearance);
+            }
+        }
+
+        if (open && run_start < 0){
+            run_start = t;
+        } else if (!open && run_start >= 0){
+            int run_end = t - 1;
+
+            int positions[2];
+            int position_count = 0;
+            if (run_end - run_start + 1 >= WIDE_ENTRANCE){
+                positions[position_count++] = run_start;
+                positions[position_count++] = run_end;
+            } else {
+                positions[position_count++] = (run_start + run_end) / 2;
+            }
+
+            for (int i = 0; i < position_count; ++i){
+                int self_cell, other_cell;
+                if (horizontal){
+                    self_cell = line_self + positions[i] * width;
+                    other_cell = line_other + positions[i] * width;
+                } else {
+                    self_cell = positions[i] + line_self * width;
+                    other_cell = positions[i] + line_other * width;
+                }
+
+                int entrance = addEntrance(result, self_cell);
+                if (entrance >= 0){
+                    result.links[entrance].push_back(other_cell);
+                }
+            }
+
+            run_start = -1;
+        }
+    }
+}
+
+int HierarchicalPathFinder::addEntrance(Cluster& cluster, int cell){
+    // Corner cells can be an entrance on two borders
+    int existing = findEntrance(cluster, cell);
+    if (existing >= 0){
+        return existing;
+    }
+
+    if (cluster.cells.size() >= MAX_ENTRANCES){
+        return -1;
+    }
+
+    cluster.cells.push_back(cell);
+    cluster.links.push_back(vector<int>());
+    return cluster.cells.size() - 1;
+}
+
+int HierarchicalPathFinder::findEntrance(Cluster& cluster, int cell){
+    for (int i = 0; i < cluster.cells.size(); ++i){
+        if (cluster.cells[i] == cell){
+            return i;
+        }
+    }
+    return -1;
+}
+
+void HierarchicalPathFinder::searchCluster(int k, int start_cell, int clearance){
+    // Dijkstra that never leaves cluster k. Results are read back with
+    // getClusterDistance until the next call.
+    cluster_min_x = (k % clusters_x) * CLUSTER_SIZE;
+    cluster_min_z = (k / clusters_x) * CLUSTER_SIZE;
+    int cluster_max_x = std::min(cluster_min_x + CLUSTER_SIZE, width) - 1;
+    int cluster_max_z = std::min(cluster_min_z + CLUSTER_SIZE, depth) - 1;
+
+    ++cluster_generation;
+    if (cluster_generation == 0){
+        std::fill(cluster_stamp.begin(), cluster_stamp.end(), 0);
+        cluster_generation = 1;
+    }
+    cluster_frontier.clear();
+
+    int start_local = (start_cell % width - cluster_min_x) + (start_cell / width - cluster_min_z) * CLUSTER_SIZE;
+    cluster_stamp[start_local] = cluster_generation;
+    cluster_distance[start_local] = 0.0f;
+    cluster_frontier.push(start_local, 0.0f);
+
+    while (!cluster_frontier.empty()){
+        float current_distance = cluster_frontier.topKey();
+        int current = cluster_frontier.pop();
+        int x = cluster_min_x + current % CLUSTER_SIZE;
+        int z = cluster_min_z + current / CLUSTER_SIZE;
+
+        for (int i = 0; i < 8; ++i){
+            int n_x = x + NEIGHBOR_X[i];
+            int n_z = z + NEIGHBOR_Z[i];
+
+            if (n_x < cluster_min_x || n_x > cluster_max_x || n_z < cluster_min_z || n_z > cluster_max_z){
+                continue;
+            }
+
+            int n = (n_x - cluster_min_x) + (n_z - cluster_min_z) * CLUSTER_SIZE;
+            float distance = current_distance + NEIGHBOR_COST[i];
+
+            if (cluster_stamp[n] != cluster_generation){
+                if (!isWalkable(n_x, n_z, clearance)){
+                    continue;
+                }
+                cluster_stamp[n] = cluster_generation;
+                cluster_distance[n] = distance;
+                cluster_frontier.push(n, distance);
+            } else if (cluster_frontier.contains(n) && distance < cluster_distance[n]){
+                cluster_distance[n] = distance;
+                cluster_frontier.decreaseKey(n, distance);
+            }
+        }
+    }
+}
+
+float HierarchicalPathFinder::getClusterDistance(int cell){
+    int x = cell % width - cluster_min_x;
+    int z = cell / width - cluster_min_z;
+
+    if (x < 0 || x >= CLUSTER_SIZE || z < 0 || z >= CLUSTER_SIZE){
+        return UNREACHABLE;
+    }
+
+    int local = x + z * CLUSTER_SIZE;
+    if (cluster_stamp[local] != cluster_generation){
+        return UNREACHABLE;
+    }
+    return cluster_distance[local];
+}
+
+bool HierarchicalPathFinder::searchAbstract(AbstractGraph& graph, int start_cell, int goal_cell, int clearance, vector<int>& abstract_path){
+    int start_node = clusters_x * clusters_z * MAX_ENTRANCES;
+    int goal_node = start_node + 1;
+
+    int start_cluster = getClusterOf(start_cell);
+    int goal_cluster = getClusterOf(goal_cell);
+
+    // Connect the goal to the entrances of its cluster, then the start. The
+    // second search is left in the scratch space, which lets us read off the
+    // direct distance when both are in the same cluster.
+    Cluster& goal_entrances = graph.clusters[goal_cluster];
+    searchCluster(goal_cluster, goal_cell, clearance);
+    for (int j = 0; j < goal_entrances.cells.size(); ++j){
+        goal_costs[j] = getClusterDistance(goal_entrances.cells[j]);
+    }
+
+    Cluster& start_entrances = graph.clusters[start_cluster];
+    searchCluster(start_cluster, start_cell, clearance);
+    for (int j = 0; j < start_entrances.cells.size(); ++j){
+        start_costs[j] = getClusterDistance(start_entrances.cells[j]);
+    }
+    float direct_cost = getClusterDistance(goal_cell);
+
+    ++abstract_generation;
+    if (abstract_generation == 0){
+        std::fill(abstract_stamp.begin(), abstract_stamp.end(), 0);
+        abstract_generation = 1;
+    }
+    abstract_frontier.clear();
+
+    abstract_stamp[start_node] = abstract_generation;
+    abstract_g[start_node] = 0.0f;
+    abstract_parent[start_node] = -1;
+    abstract_cell[start_node] = start_cell;
+    abstract_frontier.push(start_node, octileDistance(start_cell, goal_cell));
+
+    // Relaxing an edge into node v of the abstract graph
+    auto relax = [&](int from, int v, int cell, float cost){
+        float g = abstract_g[from] + cost;
+        if (abstract_stamp[v] != abstract_generation){
+            abstract_stamp[v] = abstract_generation;
+            abstract_g[v] = g;
+            abstract_parent[v] = from;
+            abstract_cell[v] = cell;
+            abstract_frontier.push(v, g + octileDistance(cell, goal_cell));
+        } else if (abstract_frontier.contains(v) && g < abstract_g[v]){
+            abstract_g[v] = g;
+            abstract_parent[v] = from;
+            abstract_frontier.decreaseKey(v, g + octileDistance(cell, goal_cell));
+        }
+    };
+
+    while (!abstract_frontier.empty()){
+        int current = abstract_frontier.pop();
+        nodes_expanded++;
+
+        if (current == goal_node){
+            abstract_path.clear();
+            for (int node = goal_node; node >= 0; node = abstract_parent[node]){
+                abstract_path.push_back(abstract_cell[node]);
+            }
+            std::reverse(abstract_path.begin(), abstract_path.end());
+            return true;
+        }
+
+        if (current == start_node){
+            for (int j = 0; j < start_entrances.cells.size(); ++j){
+                if (start_costs[j] < UNREACHABLE){
+                    relax(current, start_cluster * MAX_ENTRANCES + j, start_entrances.cells[j], start_costs[j]);
+                }
+            }
+            if (direct_cost < UNREACHABLE){
+                relax(current, goal_node, goal_cell, direct_cost);
+            }
+            continue;
+        }
+
+        int k = current / MAX_ENTRANCES;
+        int i = current % MAX_ENTRANCES;
+        Cluster& cluster = graph.clusters[k];
+        int count = cluster.cells.size();
+
+        for (int j = 0; j < count; ++j){
+            float distance = cluster.distances[i * count + j];
+            if (j != i && distance < UNREACHABLE){
+                relax(current, k * MAX_ENTRANCES + j, cluster.cells[j], distance);
+            }
+        }
+
+        for (int link : cluster.links[i]){
+            int neighbor = getClusterOf(link);
+            int j = findEntrance(graph.clusters[neighbor], link);
+            if (j >= 0){
+                relax(current, neighbor * MAX_ENTRANCES + j, link, 1.0f);
+            }
+        }
+
+        if (k == goal_cluster && goal_costs[i] < UNREACHABLE){
+            relax(current, goal_node, goal_cell, goal_costs[i]);
+        }
+    }
+
+    return false;
+}
+
+void HierarchicalPathFinder::markDirty(int min_x, int min_z, int max_x, int max_z){
+    min_x = std::max(min_x - ground->getStartX(), 0) / CLUSTER_SIZE;
+    min_z = std::max(min_z - ground->getStartZ(), 0) / CLUSTER_SIZE;
+    max_x = std::min(max_x - ground->getStartX(), width - 1) / CLUSTER_SIZE;
+    max_z = std::min(max_z - ground->getStartZ(), depth - 1) / CLUSTER_SIZE;
+
+    for (auto& entry : graphs){
+        AbstractGraph& graph = entry.second;
+        for (int cz = min_z; cz <= max_z; ++cz){
+            for (int cx = min_x; cx <= max_x; ++cx){
+                graph.clusters[cx + cz * clusters_x].dirty = true;
+                graph.has_dirty_clusters = true;
+            }
+        }
+    }
+}
+
+int HierarchicalPathFinder::getClusterOf(int cell){
+    return (cell % width) / CLUSTER_SIZE + ((cell / width) / CLUSTER_SIZE) * clusters_x;
+}
+
+bool HierarchicalPathFinder::isWalkable(int index_x, int index_z, int clearance){
+    if (index_x < 0 || index_x >= width || index_z < 0 || index_z >= depth){
+        return false;
+    }
+    return ground->canPath(index_x + ground->getStartX(), index_z + ground->getStartZ(), clearance);
+}
+
+float HierarchicalPathFinder::octileDistance(int cell_a, int cell_b){
+    int x_delta = abs(cell_a % width - cell_b % width);
+    int z_delta = abs(cell_a / width - cell_b / width);
+
+    int straight = std::max(x_delta, z_delta);
+    int diagonal = std::min(x_delta, z_delta);
+
+    return float(straight) + (NEIGHBOR_COST[0] - 1.0f) * float(diagonal);
+}
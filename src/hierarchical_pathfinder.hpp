@@ -0,0 +1,129 @@
+#ifndef HierarchicalPathFinder_h
+#define HierarchicalPathFinder_h
+
+#include "includes/glm.hpp"
+
+#include <vector>
+#include <map>
+
+#include "pathing_grid.hpp"
+#include "pathfinder.hpp"
+#include "indexed_heap.hpp"
+
+using namespace std;
+
+// HPA* (Botea, Mueller & Schaeffer) on top of PathFinder. The pathing grid is
+// cut into CLUSTER_SIZE square clusters. Where two clusters share a walkable
+// stretch of border we place entrance nodes, and inside every cluster we
+// store the walking distance between each pair of its entrances. A long query
+// is then a search over that small abstract graph, and the grid is only
+// searched again to refine the abstract segments into waypoints.
+//
+// Only the first REFINED_SEGMENTS segments are refined straight away. The
+// rest of the path is the entrances the abstract search went through, which
+// are connected but may bend around something, and refineNext refines them
+// one at a time as the unit gets to them.
+//
+// The game's path workers search the navigation mesh instead, which answers
+// the same queries faster. tools/path_benchmark.cpp times the two against
+// each other, refining this one's paths all the way.
+class HierarchicalPathFinder {
+public:
+    HierarchicalPathFinder(PathingGrid& ground, PathFinder& local_pathfinder);
+    ~HierarchicalPathFinder();
+
+    vector<glm::vec3> find_path(float start_x, float start_z, float target_x, float target_z, float radius);
+
+    // Since the last find_path, with any refineNext after it
+    int getNodesExpanded() {return nodes_expanded;}
+
+    // How many waypoints at the front of the last path found are refined
+    int getRefinedCount() {return refined_count;}
+
+    // Refines the segment ending at path[refined], putting any waypoints
+    // it needs in front of it, and moves refined past them. False once the
+    // whole path is refined.
+    bool refineNext(vector<glm::vec3>& path, int& refined, float radius);
+
+    static const int CLUSTER_SIZE = 16;
+    static const int REFINED_SEGMENTS = 2;
+
+private:
+    struct Cluster {
+        // Entrance cells on the cluster's borders, as grid indices
+        vector<int> cells;
+        // distances[i * cells.size() + j], walking inside the cluster only
+        vector<float> distances;
+        // For each entrance, the cells across the border it leads to
+        vector<vector<int>> links;
+        bool dirty;
+    };
+
+    // One abstract graph per clearance class, built the first time a unit
+    // of that size asks for a path.
+    struct AbstractGraph {
+        vector<Cluster> clusters;
+        bool has_dirty_clusters;
+    };
+
+    AbstractGraph& getGraph(int clearance);
+    void buildCluster(AbstractGraph& graph, int cluster, int clearance);
+    void rebuildDirtyClusters(AbstractGraph& graph, int clearance);
+    void markDirty(int min_x, int min_z, int max_x, int max_z);
+
+    void addBorderEntrances(int cluster, int neighbor, bool horizontal, int clearance, Cluster& result);
+    int addEntrance(Cluster& cluster, int cell);
+    int findEntrance(Cluster& cluster, int cell);
+
+    void searchCluster(int cluster, int start_cell, int clearance);
+    float getClusterDistance(int cell);
+
+    bool searchAbstract(AbstractGraph& graph, int start_cell, int goal_cell, int clearance, vector<int>& abstract_path);
+
+    int getClusterOf(int cell);
+    bool isWalkable(int index_x, int index_z, int clearance);
+    float octileDistance(int cell_a, int cell_b);
+
+    // Grid waypoints from one point to another, not counting the first. Just
+    // the end point if the straight line is clear.
+    void refineSegment(glm::vec3 from, glm::vec3 to, int clearance, float radius, vector<glm::vec3>& waypoints);
+
+    PathingGrid* ground;
+    PathFinder* local_pathfinder;
+    int change_callback_id;
+
+    map<int, AbstractGraph> graphs;
+
+    int width;
+    int depth;
+    int clusters_x;
+    int clusters_z;
+    int nodes_expanded;
+    int refined_count;
+
+    // Scratch space for the searches inside one cluster
+    vector<float> cluster_distance;
+    vector<unsigned int> cluster_stamp;
+    unsigned int cluster_generation;
+    int cluster_min_x;
+    int cluster_min_z;
+    IndexedHeap cluster_frontier;
+
+    // Scratch space for the abstract search. Entrance j of cluster k is node
+    // k * MAX_ENTRANCES + j, the start and goal come after all of those.
+    vector<float> abstract_g;
+    vector<int> abstract_parent;
+    vector<int> abstract_cell;
+    vector<unsigned int> abstract_stamp;
+    unsigned int abstract_generation;
+    IndexedHeap abstract_frontier;
+    vector<float> start_costs;
+    vector<float> goal_costs;
+
+    // A border run this long gets an entrance at each end instead of one in
+    // the middle, so units don't all funnel through the centre of wide gaps.
+    static const int WIDE_ENTRANCE = 6;
+    static const int MAX_ENTRANCES = 4 * CLUSTER_SIZE;
+};
+
+#endif
@@ -0,0 +1,336 @@
+#include "incremental_pathfinder.hpp"
+
+static const float UNREACHABLE = 1e30f;
+
+// Same neighbourhood as PathFinder, with its 1.0 / 1.4 step costs scaled
+// to whole numbers. Keys are compared for ties, and float rounding in
+// g + h + key_modifier would otherwise break them the wrong way and leave
+// cells on the route unexpanded.
+static const int NEIGHBOR_X[8] = { 1, 1, 1, 0, 0, -1, -1, -1 };
+static const int NEIGHBOR_Z[8] = { -1, 0, 1, -1, 1, -1, 0, 1 };
+static const float NEIGHBOR_COST[8] = { 14.0f, 10.0f, 14.0f, 10.0f, 10.0f, 14.0f, 10.0f, 14.0f };
+
+IncrementalPathFinder::IncrementalPathFinder(PathingGrid& ground) : ground(&ground), has_plan(false), nodes_expanded(0) {
+    width = ground.getWidth();
+    depth = ground.getDepth();
+
+    PathingGrid::Change_Callback_Type callback = std::bind(&IncrementalPathFinder::onGridChanged, this,
+        std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4);
+    change_callback_id = ground.addChangeCallback(callback);
+}
+
+IncrementalPathFinder::~IncrementalPathFinder(){
+    ground->removeChangeCallback(change_callback_id);
+}
+
+vector<glm::vec3> IncrementalPathFinder::find_path(float start_x, float start_z, float target_x, float target_z, float radius){
+    startPath(start_x, start_z, target_x, target_z, radius);
+    continuePath(0);
+    return getPath();
+}
+
+vector<glm::vec3> IncrementalPathFinder::replan(float start_x, float start_z){
+    moveStart(start_x, start_z);
+    continuePath(0);
+    return getPath();
+}
+
+void IncrementalPathFinder::startPath(float start_x, float start_z, float target_x, float target_z, float radius){
+    states.clear();
+    frontier = priority_queue<QueueEntry, vector<QueueEntry>, greater<QueueEntry>>();
+    changed_areas.clear();
+    nodes_expanded = 0;
+    has_plan = false;
+
+    clearance = PathingGrid::getClearanceClass(radius);
+    target = glm::vec3(target_x, 0.0f, target_z);
+
+    start_cell = toCell(start_x, start_z);
+    goal_cell = toCell(target_x, target_z);
+    last_start_cell = start_cell;
+    key_modifier = 0.0f;
+
+    if (start_cell < 0 || goal_cell < 0){
+        return;
+    }
+
+    getState(goal_cell).rhs = 0.0f;
+    frontier.push(QueueEntry(calculateKey(goal_cell), goal_cell));
+    has_plan = true;
+}
+
+void IncrementalPathFinder::moveStart(float start_x, float start_z){
+    if (!has_plan){
+        return;
+    }
+
+    int new_start = toCell(start_x, start_z);
+    if (new_start < 0){
+        has_plan = false;
+        return;
+    }
+
+    // Moving the start shrinks every heuristic in the queue by at most this
+    // much. Adding it to new keys instead of re-keying the queue keeps the
+    // old entries in order.
+    start_cell = new_start;
+    key_modifier += heuristic(last_start_cell, start_cell);
+    last_start_cell = start_cell;
+
+    applyChanges();
+}
+
+bool IncrementalPathFinder::continuePath(int max_nodes){
+    nodes_expanded = 0;
+
+    if (!has_plan){
+        return true;
+    }
+    return computeShortestPath(max_nodes);
+}
+
+vector<glm::vec3> IncrementalPathFinder::getPath(){
+    if (!has_plan){
+        return vector<glm::vec3>();
+    }
+    return extractPath();
+}
+
+bool IncrementalPathFinder::computeShortestPath(int max_nodes){
+    while (!frontier.empty()){
+        Key start_key = calculateKey(start_cell);
+        CellState& start = getState(start_cell);
+
+        if (!(frontier.top().first < start_key) && start.rhs == start.g){
+            return true;
+        }
+
+        if (max_nodes > 0 && nodes_expanded >= max_nodes){
+            return false;
+        }
+
+        Key old_key = frontier.top().first;
+        int current = frontier.top().second;
+        frontier.pop();
+
+        CellState& state = getState(current);
+        if (state.g == state.rhs){
+            // Stale entry, this cell was settled since it was pushed
+            continue;
+        }
+
+        Key new_key = calculateKey(current);
+        if (old_key < new_key){
+            frontier.push(QueueEntry(new_key, current));
+            continue;
+        }
+
+        nodes_expanded++;
+
+        int x = current % width;
+        int z = current / width;
+
+        if (state.g > state.rhs){
+            state.g = state.rhs;
+        } else {
+            state.g = UNREACHABLE;
+            updateVertex(current);
+        }
+
+        for (int i = 0; i < 8; ++i){
+            int n_x = x + NEIGHBOR_X[i];
+            int n_z = z + NEIGHBOR_Z[i];
+
+            if (n_x < 0 || n_z < 0 || n_x >= width || n_z >= depth){
+                continue;
+            }
+
+            updateVertex(n_x + n_z * width);
+        }
+    }
+
+    return true;
+}
+
+void IncrementalPathFinder::updateVertex(int cell){
+    if (cell != goal_cell){
+        int x = cell % width;
+        int z = cell / width;
+        float rhs = UNREACHABLE;
+
+        // Moving between two cells costs the usual step as long as both can
+        // be stood on
+        if (isWalkable(x, z)){
+            for (int i = 0; i < 8; ++i){
+                int n_x = x + NEIGHBOR_X[i];
+                int n_z = z + NEIGHBOR_Z[i];
+
+                if (isWalkable(n_x, n_z)){
+                    rhs = std::min(rhs, NEIGHBOR_COST[i] + getG(n_x + n_z * width));
+                }
+            }
+        }
+
+        // Cells the search never reached don't need an entry just to say so
+        if (rhs >= UNREACHABLE && states.find(cell) == states.end()){
+            return;
+        }
+
+        getState(cell).rhs = rhs;
+    }
+
+    CellState& state = getState(cell);
+    if (state.g != state.rhs){
+        frontier.push(QueueEntry(calculateKey(cell), cell));
+    }
+}
+
+IncrementalPathFinder::Key IncrementalPathFinder::calculateKey(int cell){
+    float best = std::min(getG(cell), getRhs(cell));
+    if (best >= UNREACHABLE){
+        return Key(UNREACHABLE, UNREACHABLE);
+    }
+    return Key(best + heuristic(start_cell, cell) + key_modifier, best);
+}
+
+float IncrementalPathFinder::getG(int cell){
+    unordered_map<int, CellState>::iterator it = states.find(cell);
+    return it == states.end() ? UNREACHABLE : it->second.g;
+}
+
+float IncrementalPathFinder::getRhs(int cell){
+    unordered_map<int, CellState>::iterator it = states.find(cell);
+    return it == states.end() ? UNREACHABLE : it->second.rhs;
+}
+
+IncrementalPathFinder::CellState& IncrementalPathFinder::getState(int cell){
+    unordered_map<int, CellState>::iterator it = states.find(cell);
+    if (it == states.end()){
+        CellState state;
+        state.g = UNREACHABLE;
+        state.rhs = UNREACHABLE;
+        it = states.insert(std::make_pair(cell, state)).first;
+    }
+    return it->second;
+}
+
+bool IncrementalPathFinder::isWalkable(int index_x, int index_z){
+    // Off the grid is never walkable, canPath checks that
+    return ground->canPath(index_x + ground->getStartX(), index_z + ground->getStartZ(), clearance);
+}
+
+float IncrementalPathFinder::heuristic(int cell_a, int cell_b){
+    int x_delta = abs(cell_a % width - cell_b % width);
+    int z_delta = abs(cell_a / width - cell_b / width);
+
+    int straight = std::max(x_delta, z_delta);
+    int diagonal = std::min(x_delta, z_delta);
+
+    return (NEIGHBOR_COST[1] * float(straight)) + (NEIGHBOR_COST[0] - NEIGHBOR_COST[1]) * float(diagonal);
+}
+
+void IncrementalPathFinder::applyChanges(){
+    // Every edge into or out of a changed cell may have changed cost, which
+    // touches the cells one step outside the area too.
+    for (ChangedArea& area : changed_areas){
+        int min_x = std::max(area.min_x - 1, 0);
+        int min_z = std::max(area.min_z - 1, 0);
+        int max_x = std::min(area.max_x + 1, width - 1);
+        int max_z = std::min(area.max_z + 1, depth - 1);
+
+        for (int z = min_z; z <= max_z; ++z){
+            for (int x = min_x; x <= max_x; ++x){
+                updateVertex(x + z * width);
+            }
+        }
+    }
+
+    changed_areas.clear();
+}
+
+void IncrementalPathFinder::onGridChanged(int min_x, int min_z, int max_x, int max_z){
+    if (!has_plan){
+        return;
+    }
+
+    ChangedArea area;
+    area.min_x = min_x - ground->getStartX();
+    area.min_z = min_z - ground->getStartZ();
+    area.max_x = max_x - ground->getStartX();
+    area.max_z = max_z - ground->getStartZ();
+    changed_areas.push_back(area);
+}
+
+vector<glm::vec3> IncrementalPathFinder::extractPath(){
+    vector<glm::vec3> final;
+
+    if (getG(start_cell) >= UNREACHABLE){
+        return final;
+    }
+
+    // Walk downhill on g from the start to the goal
+    vector<int> cells;
+    cells.push_back(start_cell);
+
+    int current = start_cell;
+    while (current != goal_cell && cells.size() <= width * depth){
+        int x = current % width;
+        int z = current / width;
+
+        int best = -1;
+        float best_cost = UNREACHABLE;
+
+        for (int i = 0; i < 8; ++i){
+            int n_x = x + NEIGHBOR_X[i];
+            int n_z = z + NEIGHBOR_Z[i];
+
+            if (!isWalkable(n_x, n_z)){
+                continue;
+            }
+
+            int n = n_x + n_z * width;
+            if (NEIGHBOR_COST[i] + getG(n) < best_cost){
+                best_cost = NEIGHBOR_COST[i] + getG(n);
+                best = n;
+            }
+        }
+
+        if (best < 0){
+            return final;
+        }
+
+        current = best;
+        cells.push_back(current);
+    }
+
+    // Keep only the corners a straight line can't cut, like PathFinder
+    int start_x = ground->getStartX();
+    int start_z = ground->getStartZ();
+    int anchor = cells[0];
+
+    for (int i = 1; i < cells.size(); ++i){
+        int current_cell = cells[i];
+
+        bool line_between = ground->canPathOnLine((anchor % width) + start_x, (anchor / width) + start_z,
+                                                  (current_cell % width) + start_x, (current_cell / width) + start_z, clearance);
+
+        if (!line_between){
+            int previous = cells[i - 1];
+            final.push_back(glm::vec3((previous % width) + start_x, 0.0f, (previous / width) + start_z));
+            anchor = previous;
+        }
+    }
+
+    final.push_back(target);
+    return final;
+}
+
+int IncrementalPathFinder::toCell(float x, float z){
+    int index_x = int(x) - ground->getStartX();
+    int index_z = int(z) - ground->getStartZ();
+
+    if (index_x < 0 || index_z < 0 || index_x >= width || index_z >= depth){
+        return -1;
+    }
+    return index_x + index_z * width;
+}
@@ -0,0 +1,105 @@
+#ifndef IncrementalPathFinder_h
+#define IncrementalPathFinder_h
+
+#include "includes/glm.hpp"
+
+#include <vector>
+#include <queue>
+#include <unordered_map>
+#include <utility>
+
+#include "pathing_grid.hpp"
+
+using namespace std;
+
+// D* Lite (Koenig & Likhachev). Searches backwards from the goal and keeps
+// its search state between calls, so when cells of the pathing grid change
+// under a route, replan() only repairs the part of the search those cells
+// affected instead of starting over. One instance per route being followed.
+//
+// State is kept sparsely, only for the cells the search has touched, so an
+// instance costs memory in proportion to the search, not to the map.
+class IncrementalPathFinder {
+public:
+    IncrementalPathFinder(PathingGrid& ground);
+    ~IncrementalPathFinder();
+
+    // Plans from scratch. Returns waypoints ending at the target, or nothing
+    // if the target can't be reached.
+    vector<glm::vec3> find_path(float start_x, float start_z, float target_x, float target_z, float radius);
+
+    // Plans again from a new start (where the units are now) towards the same
+    // target, taking in any grid changes since the last call.
+    vector<glm::vec3> replan(float start_x, float start_z);
+
+    // The same two, spread over as many calls as it takes. startPath and
+    // moveStart only set the search up, continuePath expands at most
+    // max_nodes cells (0 for no limit) and returns true once getPath has
+    // the answer.
+    void startPath(float start_x, float start_z, float target_x, float target_z, float radius);
+    void moveStart(float start_x, float start_z);
+    bool continuePath(int max_nodes);
+    vector<glm::vec3> getPath();
+
+    glm::vec3 getTarget() {return target;}
+
+    bool hasPendingChanges() {return !changed_areas.empty();}
+    int getNodesExpanded() {return nodes_expanded;}
+
+private:
+    struct CellState {
+        float g;
+        float rhs;
+    };
+
+    typedef pair<float, float> Key;
+    typedef pair<Key, int> QueueEntry;
+
+    bool computeShortestPath(int max_nodes);
+    void updateVertex(int cell);
+    Key calculateKey(int cell);
+
+    float getG(int cell);
+    float getRhs(int cell);
+    CellState& getState(int cell);
+
+    bool isWalkable(int index_x, int index_z);
+    float heuristic(int cell_a, int cell_b);
+
+    void applyChanges();
+    void onGridChanged(int min_x, int min_z, int max_x, int max_z);
+
+    vector<glm::vec3> extractPath();
+    int toCell(float x, float z);
+
+    PathingGrid* ground;
+    int change_callback_id;
+
+    unordered_map<int, CellState> states;
+
+    // Stale entries are left in the queue and skipped when popped
+    priority_queue<QueueEntry, vector<QueueEntry>, greater<QueueEntry>> frontier;
+
+    int width;
+    int depth;
+    int start_cell;
+    int last_start_cell;
+    int goal_cell;
+    float key_modifier;
+    int clearance;
+    bool has_plan;
+    int nodes_expanded;
+
+    glm::vec3 target;
+
+    // Grid areas changed since the last plan, in grid indices
+    struct ChangedArea {
+        int min_x;
+        int min_z;
+        int max_x;
+        int max_z;
+    };
+    vector<ChangedArea> changed_areas;
+};
+
+#endif
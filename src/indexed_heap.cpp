@@ -0,0 +1,100 @@
+#include "indexed_heap.hpp"
+
+const int IndexedHeap::NOT_IN_HEAP;
+
+IndexedHeap::IndexedHeap(){
+
+}
+
+IndexedHeap::IndexedHeap(int capacity){
+    resize(capacity);
+}
+
+void IndexedHeap::resize(int capacity){
+    items.clear();
+    keys.clear();
+    items.reserve(capacity);
+    keys.reserve(capacity);
+    position.assign(capacity, NOT_IN_HEAP);
+}
+
+void IndexedHeap::clear(){
+    // Only the items still in the heap have a position to forget, so this
+    // is proportional to the heap size and not to the capacity.
+    for (int item : items){
+        position[item] = NOT_IN_HEAP;
+    }
+    items.clear();
+    keys.clear();
+}
+
+void IndexedHeap::push(int item, float key){
+    items.push_back(item);
+    keys.push_back(key);
+    position[item] = items.size() - 1;
+    siftUp(items.size() - 1);
+}
+
+void IndexedHeap::decreaseKey(int item, float key){
+    int slot = position[item];
+    if (key < keys[slot]){
+        keys[slot] = key;
+        siftUp(slot);
+    }
+}
+
+int IndexedHeap::pop(){
+    int item = items[0];
+    int last = items.size() - 1;
+
+    swapSlots(0, last);
+    items.pop_back();
+    keys.pop_back();
+    position[item] = NOT_IN_HEAP;
+
+    if (!items.empty()){
+        siftDown(0);
+    }
+
+    return item;
+}
+
+void IndexedHeap::siftUp(int slot){
+    while (slot > 0){
+        int parent = (slot - 1) / 2;
+        if (keys[parent] <= keys[slot]){
+            break;
+        }
+        swapSlots(parent, slot);
+        slot = parent;
+    }
+}
+
+void IndexedHeap::siftDown(int slot){
+    int count = items.size();
+    while (true){
+        int left = 2 * slot + 1;
+        int right = left + 1;
+        int smallest = slot;
+
+        if (left < count && keys[left] < keys[smallest]){
+            smallest = left;
+        }
+        if (right < count && keys[right] < keys[smallest]){
+            smallest = right;
+        }
+        if (smallest == slot){
+            break;
+        }
+
+        swapSlots(slot, smallest);
+        slot = smallest;
+    }
+}
+
+void IndexedHeap::swapSlots(int a, int b){
+    std::swap(items[a], items[b]);
+    std::swap(keys[a], keys[b]);
+    position[items[a]] = a;
+    position[items[b]] = b;
+}
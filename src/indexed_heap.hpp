@@ -0,0 +1,41 @@
+#ifndef IndexedHeap_h
+#define IndexedHeap_h
+
+#include <vector>
+#include <utility>
+
+// Binary min-heap over integer items in [0, capacity) that remembers where
+// each item sits, so keys can be lowered in place (decrease-key) instead of
+// pushing duplicates. All storage is sized up front by resize().
+class IndexedHeap {
+public:
+    IndexedHeap();
+    IndexedHeap(int capacity);
+
+    void resize(int capacity);
+    void clear();
+
+    bool empty() {return items.empty();}
+    int size() {return items.size();}
+    bool contains(int item) {return position[item] != NOT_IN_HEAP;}
+
+    void push(int item, float key);
+    void decreaseKey(int item, float key);
+
+    int top() {return items[0];}
+    float topKey() {return keys[0];}
+    int pop();
+
+private:
+    void siftUp(int slot);
+    void siftDown(int slot);
+    void swapSlots(int a, int b);
+
+    std::vector<int> items;
+    std::vector<float> keys;
+    std::vector<int> position;
+
+    static const int NOT_IN_HEAP = -1;
+};
+
+#endif
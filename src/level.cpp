@@ -1,9 +1,9 @@
 #include "level.hpp"
 
-Level::Level(string filename, RenderDeque& render_stack) : File(filename), unit_holder(), resource_loader(), game_map(filename, unit_holder, render_stack, resource_loader), unit_manager(game_map, unit_holder) {
+Level::Level(string filename, RenderDeque& render_stack, unsigned int seed) : File(filename), unit_holder(), resource_loader(), game_map(filename, unit_holder, render_stack, resource_loader), unit_manager(game_map.getGround(), unit_holder) {
 
     // Temporary stuff
-    unit_holder.populate(resource_loader);
+    unit_holder.populate(resource_loader, seed);
 
 }
 
@@ -42,4 +42,6 @@ void Level::saveAs(string filepath) {
     myfile.open(filepath);
     myfile << asJsonString();
     myfile.close();
+
+    game_map.saveNavigationMeshes(filepath);
 }
@@ -12,7 +12,8 @@ using namespace std;
 
 class Level : public File {
 public:
-    Level(string filename, RenderDeque& render_stack);
+    // The seed decides the starting units, see UnitHolder::populate
+    Level(string filename, RenderDeque& render_stack, unsigned int seed);
 
     GameMap& getGameMap();
     UnitManager& getUnitManager();
@@ -0,0 +1,471 @@
+#include "lockstep_session.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <cinttypes>
+#include <algorithm>
+
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include "game_clock.hpp"
+#include "debug.hpp"
+
+// "LKS2", to ignore anything else that turns up on the port
+#define PACKET_MAGIC 0x32534B4C
+#define MAX_PACKET_SIZE 65507
+#define MAX_TURNS_PER_PACKET 255
+#define MAX_COMMANDS_PER_TURN 255
+
+// Magic, team, acknowledged turn, first turn and turn count
+#define PACKET_HEADER_BYTES 14
+
+// Checksum flag, checksum and command count
+#define TURN_HEADER_BYTES 10
+
+// Type and id count, then 4 bytes an id
+#define SELECT_BYTES 3
+
+// Type, order, enqueue flag and target
+#define ORDER_BYTES 15
+
+// So any one turn always fits in a packet on its own
+#define MAX_TURN_BYTES (MAX_PACKET_SIZE - PACKET_HEADER_BYTES - TURN_HEADER_BYTES)
+
+const int LockstepSession::TURN_STEPS;
+const int LockstepSession::DELAY_TURNS;
+const int LockstepSession::CHECKSUM_STEPS;
+const int LockstepSession::STALL_WAIT_MS;
+const int LockstepSession::RESEND_MS;
+const int LockstepSession::PACKET_BUDGET;
+
+// Packets are little endian whatever the machine is
+static void writeValue(vector<unsigned char>& packet, uint64_t value, int bytes){
+    for (int i = 0; i < bytes; ++i){
+        packet.push_back((value >> (8 * i)) & 0xFF);
+    }
+}
+
+static void writeFloat(vector<unsigned char>& packet, float value){
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    writeValue(packet, bits, 4);
+}
+
+static bool readValue(const unsigned char* data, int size, int& offset, int bytes, uint64_t& value){
+    if (offset + bytes > size){
+        return false;
+    }
+
+    value = 0;
+    for (int i = 0; i < bytes; ++i){
+        value |= uint64_t(data[offset + i]) << (8 * i);
+    }
+
+    offset += bytes;
+    return true;
+}
+
+static bool readFloat(const unsigned char* data, int size, int& offset, float& value){
+    uint64_t bits;
+    if (!readValue(data, size, offset, 4, bits)){
+        return false;
+    }
+
+    uint32_t float_bits = bits;
+    memcpy(&value, &float_bits, sizeof(value));
+    return true;
+}
+
+LockstepSession::LockstepSession(int team, int local_port, string peer_host, int peer_port) : socket_id(-1), team(team), peer_team(0), checksums_compared(0), desyncs(0), bytes_sent(0), bytes_received(0), packets_sent(0), packets_received(0) {
+    // The first turns have no orders on either side, there was nobody to
+    // give them
+    last_sealed_turn = DELAY_TURNS - 1;
+    last_taken_turn = -1;
+    current_turn = 0;
+    peer_received_turn = DELAY_TURNS - 1;
+    peer_acknowledged_turn = DELAY_TURNS - 1;
+
+    last_send = std::chrono::steady_clock::now();
+
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+
+    addrinfo* found = 0;
+    if (getaddrinfo(peer_host.c_str(), 0, &hints, &found) != 0 || !found){
+        Debug::error("Could not find lockstep peer %s.\n", peer_host.c_str());
+        return;
+    }
+
+    peer_address = *reinterpret_cast<sockaddr_in*>(found->ai_addr);
+    peer_address.sin_port = htons(peer_port);
+    freeaddrinfo(found);
+
+    int opened = socket(AF_INET, SOCK_DGRAM, 0);
+    if (opened < 0){
+        Debug::error("Could not open a UDP socket for lockstep.\n");
+        return;
+    }
+
+    sockaddr_in local_address;
+    memset(&local_address, 0, sizeof(local_address));
+    local_address.sin_family = AF_INET;
+    local_address.sin_addr.s_addr = htonl(INADDR_ANY);
+    local_address.sin_port = htons(local_port);
+
+    if (bind(opened, reinterpret_cast<sockaddr*>(&local_address), sizeof(local_address)) < 0){
+        Debug::error("Could not listen for lockstep on port %d.\n", local_port);
+        close(opened);
+        return;
+    }
+
+    // Reads never block, waiting is done with poll
+    fcntl(opened, F_SETFL, fcntl(opened, F_GETFL, 0) | O_NONBLOCK);
+
+    socket_id = opened;
+}
+
+LockstepSession::~LockstepSession(){
+    if (socket_id >= 0){
+        close(socket_id);
+    }
+}
+
+bool LockstepSession::queueCommand(Command& command){
+    Turn& turn = local_turns[current_turn + DELAY_TURNS];
+    int bytes = getCommandBytes(command);
+
+    // Held down keys give an order every frame, a turn only has room for so
+    // many
+    if (turn.commands.size() >= MAX_COMMANDS_PER_TURN || turn.command_bytes + bytes > MAX_TURN_BYTES){
+        return false;
+    }
+
+    command.team = team;
+    turn.commands.push_back(command);
+    turn.command_bytes += bytes;
+    return true;
+}
+
+int LockstepSession::getCommandBytes(Command& command){
+    if (command.type == Command::Type::SELECT){
+        return SELECT_BYTES + 4 * command.unit_ids.size();
+    }
+    return ORDER_BYTES;
+}
+
+int LockstepSession::getTurnBytes(Turn& turn){
+    return TURN_HEADER_BYTES - (turn.has_checksum ? 0 : 8) + turn.command_bytes;
+}
+
+bool LockstepSession::waitForTurn(int turn){
+    receive(0);
+    if (turn <= peer_received_turn){
+        return true;
+    }
+
+    // The peer may be stuck too, waiting on a packet of ours that was lost
+    if (std::chrono::steady_clock::now() - last_send >= std::chrono::milliseconds(RESEND_MS)){
+        send();
+    }
+
+    receive(STALL_WAIT_MS);
+    return turn <= peer_received_turn;
+}
+
+vector<LockstepSession::Command> LockstepSession::takeTurn(int turn){
+    vector<Command> commands;
+
+    vector<Command>& local = local_turns[turn].commands;
+    vector<Command>& remote = peer_turns[turn].commands;
+
+    // Both sides have to carry them out in the same order
+    if (team < peer_team){
+        commands.insert(commands.end(), local.begin(), local.end());
+        commands.insert(commands.end(), remote.begin(), remote.end());
+    } else {
+        commands.insert(commands.end(), remote.begin(), remote.end());
+        commands.insert(commands.end(), local.begin(), local.end());
+    }
+
+    last_taken_turn = turn;
+    peer_turns.erase(peer_turns.begin(), peer_turns.upper_bound(turn));
+    local_turns.erase(local_turns.begin(), local_turns.upper_bound(std::min(turn, peer_acknowledged_turn)));
+
+    return commands;
+}
+
+void LockstepSession::endTurn(int turn, UnitHolder& units){
+    int sealed_turn = turn + DELAY_TURNS;
+    Turn& sealed = local_turns[sealed_turn];
+    sealed.has_checksum = false;
+
+    long step = long(turn + 1) * TURN_STEPS;
+    if (step % CHECKSUM_STEPS == 0){
+        sealed.has_checksum = true;
+        sealed.checksum = units.getChecksum();
+
+        local_checksums[step] = sealed.checksum;
+        compareChecksums();
+    }
+
+    last_sealed_turn = sealed_turn;
+    current_turn = turn + 1;
+
+    send();
+}
+
+void LockstepSession::send(){
+    if (socket_id < 0){
+        return;
+    }
+
+    vector<unsigned char> packet;
+    writeValue(packet, PACKET_MAGIC, 4);
+    writeValue(packet, team, 1);
+    writeValue(packet, peer_received_turn, 4);
+
+    // The oldest turns the peer is missing, as many as fit in the budget.
+    // The rest go in the packets after this one is acknowledged.
+    int first_turn = peer_acknowledged_turn + 1;
+    int turn_count = 0;
+    int packet_bytes = PACKET_HEADER_BYTES;
+
+    while (first_turn + turn_count <= last_sealed_turn && turn_count < MAX_TURNS_PER_PACKET){
+        int turn_bytes = getTurnBytes(local_turns[first_turn + turn_count]);
+        if (turn_count > 0 && packet_bytes + turn_bytes > PACKET_BUDGET){
+            break;
+        }
+
+        packet_bytes += turn_bytes;
+        turn_count++;
+    }
+
+    writeValue(packet, first_turn, 4);
+    writeValue(packet, turn_count, 1);
+
+    for (int t = first_turn; t < first_turn + turn_count; ++t){
+        Turn& turn = local_turns[t];
+
+        writeValue(packet, turn.has_checksum, 1);
+        if (turn.has_checksum){
+            writeValue(packet, turn.checksum, 8);
+        }
+
+        writeValue(packet, turn.commands.size(), 1);
+        for (Command& command : turn.commands){
+            writeValue(packet, int(command.type), 1);
+
+            if (command.type == Command::Type::SELECT){
+                writeValue(packet, command.unit_ids.size(), 2);
+                for (int id : command.unit_ids){
+                    writeValue(packet, id, 4);
+                }
+            } else {
+                writeValue(packet, int(command.order), 1);
+                writeValue(packet, command.should_enqueue, 1);
+                writeFloat(packet, command.target.x);
+                writeFloat(packet, command.target.y);
+                writeFloat(packet, command.target.z);
+            }
+        }
+    }
+
+    int sent = sendto(socket_id, packet.data(), packet.size(), 0, reinterpret_cast<sockaddr*>(&peer_address), sizeof(peer_address));
+    if (sent > 0){
+        bytes_sent += sent;
+        packets_sent++;
+    }
+
+    last_send = std::chrono::steady_clock::now();
+}
+
+void LockstepSession::receive(int timeout_ms){
+    if (socket_id < 0){
+        return;
+    }
+
+    pollfd waiting;
+    waiting.fd = socket_id;
+    waiting.events = POLLIN;
+    waiting.revents = 0;
+
+    if (poll(&waiting, 1, timeout_ms) <= 0){
+        return;
+    }
+
+    vector<unsigned char> buffer(MAX_PACKET_SIZE);
+
+    while (true){
+        sockaddr_in from;
+        socklen_t from_size = sizeof(from);
+
+        int size = recvfrom(socket_id, buffer.data(), buffer.size(), 0, reinterpret_cast<sockaddr*>(&from), &from_size);
+        if (size < 0){
+            return;
+        }
+
+        if (from.sin_addr.s_addr != peer_address.sin_addr.s_addr || from.sin_port != peer_address.sin_port){
+            continue;
+        }
+
+        bytes_received += size;
+        packets_received++;
+        readPacket(buffer.data(), size);
+    }
+}
+
+void LockstepSession::readPacket(const unsigned char* data, int size){
+    int offset = 0;
+    uint64_t magic, sender_team, acknowledged, first_turn, turn_count;
+
+    if (!readValue(data, size, offset, 4, magic) || magic != PACKET_MAGIC ||
+        !readValue(data, size, offset, 1, sender_team) || int(sender_team) == team ||
+        !readValue(data, size, offset, 4, acknowledged) ||
+        !readValue(data, size, offset, 4, first_turn) ||
+        !readValue(data, size, offset, 1, turn_count)){
+        return;
+    }
+
+    // Read it all before using any of it, so a cut off packet changes nothing
+    map<int, Turn> turns;
+
+    for (int t = int(first_turn); t < int(first_turn + turn_count); ++t){
+        Turn& turn = turns[t];
+
+        uint64_t has_checksum, command_count;
+        if (!readValue(data, size, offset, 1, has_checksum)){
+            return;
+        }
+
+        turn.has_checksum = has_checksum != 0;
+        if (turn.has_checksum && !readValue(data, size, offset, 8, turn.checksum)){
+            return;
+        }
+
+        if (!readValue(data, size, offset, 1, command_count)){
+            return;
+        }
+
+        for (int c = 0; c < int(command_count); ++c){
+            Command command;
+            uint64_t type;
+
+            if (!readValue(data, size, offset, 1, type)){
+                return;
+            }
+
+            command.team = sender_team;
+
+            if (type == uint64_t(Command::Type::SELECT)){
+                uint64_t id_count;
+                if (!readValue(data, size, offset, 2, id_count)){
+                    return;
+                }
+
+                command.type = Command::Type::SELECT;
+                for (int i = 0; i < int(id_count); ++i){
+                    uint64_t id;
+                    if (!readValue(data, size, offset, 4, id)){
+                        return;
+                    }
+                    command.unit_ids.push_back(id);
+                }
+            } else if (type == uint64_t(Command::Type::ORDER)){
+                uint64_t order, should_enqueue;
+                if (!readValue(data, size, offset, 1, order) ||
+                    !readValue(data, size, offset, 1, should_enqueue) ||
+                    !readFloat(data, size, offset, command.target.x) ||
+                    !readFloat(data, size, offset, command.target.y) ||
+                    !readFloat(data, size, offset, command.target.z)){
+                    return;
+                }
+
+                // Not an order this build knows
+                if (order > uint64_t(Playable::Order::STOP)){
+                    return;
+                }
+
+                command.type = Command::Type::ORDER;
+                command.order = Playable::Order(order);
+                command.should_enqueue = should_enqueue != 0;
+            } else {
+                return;
+            }
+
+            turn.commands.push_back(command);
+        }
+    }
+
+    peer_team = sender_team;
+    peer_acknowledged_turn = std::max(peer_acknowledged_turn, int(acknowledged));
+
+    for (map<int, Turn>::iterator it = turns.begin(); it != turns.end(); ++it){
+        if (it->first <= peer_received_turn || peer_turns.count(it->first)){
+            continue;
+        }
+
+        peer_turns[it->first] = it->second;
+
+        // Sealed at the end of the turn DELAY_TURNS before it
+        if (it->second.has_checksum){
+            long step = long(it->first - DELAY_TURNS + 1) * TURN_STEPS;
+            peer_checksums[step] = it->second.checksum;
+        }
+    }
+
+    while (peer_turns.count(peer_received_turn + 1)){
+        peer_received_turn++;
+    }
+
+    compareChecksums();
+}
+
+void LockstepSession::compareChecksums(){
+    map<long, uint64_t>::iterator local = local_checksums.begin();
+
+    while (local != local_checksums.end()){
+        map<long, uint64_t>::iterator remote = peer_checksums.find(local->first);
+        if (remote == peer_checksums.end()){
+            ++local;
+            continue;
+        }
+
+        checksums_compared++;
+        if (remote->second != local->second){
+            desyncs++;
+            Debug::error("Lockstep desync at step %ld, the games are no longer the same.\n", local->first);
+        }
+
+        peer_checksums.erase(remote);
+        local = local_checksums.erase(local);
+    }
+}
+
+void LockstepSession::flush(int timeout_ms){
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    while (peer_acknowledged_turn < last_sealed_turn &&
+           std::chrono::steady_clock::now() - start < std::chrono::milliseconds(timeout_ms)){
+        send();
+        receive(RESEND_MS);
+    }
+}
+
+void LockstepSession::printStats(UnitHolder& units, long step_count){
+    // Per second of game time, which is what a real match would run at
+    float seconds = step_count * GameClock::SIMULATION_STEP;
+
+    printf("{\"team\": %d, \"steps\": %ld, \"packets_sent\": %d, \"packets_received\": %d, "
+           "\"bytes_sent\": %ld, \"bytes_received\": %ld, \"bytes_sent_per_second\": %.1f, "
+           "\"checksums_compared\": %d, \"desyncs\": %d, \"checksum\": \"%016" PRIx64 "\"}\n",
+           team, step_count, packets_sent, packets_received, bytes_sent, bytes_received,
+           seconds > 0.0f ? bytes_sent / seconds : 0.0f, checksums_compared, desyncs,
+           units.getChecksum());
+}
@@ -0,0 +1,153 @@
+#ifndef LockstepSession_h
+#define LockstepSession_h
+
+#include "includes/glm.hpp"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <cstdint>
+
+#include <netinet/in.h>
+
+#include "playable.hpp"
+#include "unit_holder.hpp"
+
+using namespace std;
+
+// Deterministic lockstep between two players over UDP. Every player runs the
+// whole simulation and only orders go over the wire, so the traffic is the
+// same for ten units or ten thousand.
+//
+// Steps are grouped into turns of TURN_STEPS. An order given during turn t
+// is carried out at the start of turn t + DELAY_TURNS, on both sides. When a
+// turn ends, all of its orders are sealed and sent in one packet, even if
+// there are none, so the peer knows it can go on. A turn can't start until
+// the peer's half of it has arrived, and the simulation waits until it has.
+//
+// A player's selection goes over once, when it changes, and their orders
+// after it are for whoever it holds. An order costs the same however many
+// units it moves.
+//
+// Packets carry the oldest sealed turns the peer hasn't acknowledged yet, as
+// many as fit in PACKET_BUDGET bytes, so a lost one is covered by the next
+// and a backlog goes out over several. Every CHECKSUM_STEPS steps a turn also
+// carries the checksum of the units at the end of the turn it was sealed in.
+// If the peer's checksum for the same step differs, the games have
+// desynced. Both players need the same map, seed and path settings.
+class LockstepSession {
+public:
+    // A new selection, or an order for the player's last one. A player can
+    // only select and order their own team.
+    struct Command {
+        enum class Type{ SELECT, ORDER };
+
+        Type type;
+        int team;
+
+        // Handles of the selected units
+        vector<int> unit_ids;
+
+        Playable::Order order;
+        glm::vec3 target;
+        bool should_enqueue;
+    };
+
+    // Listens on local_port and talks to peer_host:peer_port
+    LockstepSession(int team, int local_port, string peer_host, int peer_port);
+    ~LockstepSession();
+
+    // False if the socket couldn't be opened or the peer wasn't found
+    bool isConnected() {return socket_id >= 0;}
+
+    int getTeam() {return team;}
+
+    // Carried out DELAY_TURNS turns after the one being simulated. False if
+    // the turn has no room left for it, then it's never sent.
+    bool queueCommand(Command& command);
+
+    // Whether both players' commands for the turn are in. Reads whatever
+    // the peer has sent and, if still waiting, resends ours and waits up to
+    // STALL_WAIT_MS for more.
+    bool waitForTurn(int turn);
+
+    // Both players' commands for the turn, lower team first
+    vector<Command> takeTurn(int turn);
+
+    // Seals the turn after this one's delay and sends everything the peer
+    // still needs
+    void endTurn(int turn, UnitHolder& units);
+
+    // Keeps resending until the peer has every sealed turn, so it can finish
+    // after we've stopped, or until the time runs out
+    void flush(int timeout_ms);
+
+    // One JSON line with the traffic and desyncs so far
+    void printStats(UnitHolder& units, long step_count);
+
+    static const int TURN_STEPS = 6;
+    static const int DELAY_TURNS = 2;
+    static const int CHECKSUM_STEPS = 60;
+
+    static const int STALL_WAIT_MS = 1;
+    static const int RESEND_MS = 50;
+
+    // Below a typical MTU, so packets aren't split up on the way. A turn
+    // bigger than this still goes, in a packet of its own.
+    static const int PACKET_BUDGET = 1200;
+
+private:
+    struct Turn {
+        Turn() : has_checksum(false), checksum(0), command_bytes(0) {;}
+
+        vector<Command> commands;
+        bool has_checksum;
+        uint64_t checksum;
+
+        // What the commands take up in a packet
+        int command_bytes;
+    };
+
+    static int getCommandBytes(Command& command);
+    static int getTurnBytes(Turn& turn);
+
+    void send();
+    void receive(int timeout_ms);
+    void readPacket(const unsigned char* data, int size);
+    void compareChecksums();
+
+    int socket_id;
+    sockaddr_in peer_address;
+
+    int team;
+    int peer_team;
+
+    // Our turns by number, kept until they've been carried out and the
+    // peer has them
+    map<int, Turn> local_turns;
+    int last_sealed_turn;
+    int last_taken_turn;
+    int current_turn;
+
+    // The peer's turns. We have all of theirs up to peer_received_turn, and
+    // they have all of ours up to peer_acknowledged_turn.
+    map<int, Turn> peer_turns;
+    int peer_received_turn;
+    int peer_acknowledged_turn;
+
+    // Checksums by step, waiting for the other side's
+    map<long, uint64_t> local_checksums;
+    map<long, uint64_t> peer_checksums;
+    int checksums_compared;
+    int desyncs;
+
+    std::chrono::steady_clock::time_point last_send;
+
+    long bytes_sent;
+    long bytes_received;
+    int packets_sent;
+    int packets_received;
+};
+
+#endif
@@ -36,13 +36,22 @@
 #include "flat_drawable.hpp"
 #include "texture.hpp"
 #include "file.hpp"
+#include "headless_simulation.hpp"
+#include "replay.hpp"
+#include "lockstep_session.hpp"
 
 using namespace std;
 
+// How long to keep resending at the end of a lockstep game, so the other
+// player gets our last turns
+#define LOCKSTEP_FLUSH_MS 2000
+
 int main(int argc, char* argv[]) {
 
-    // Make the randomizer random
-    srand(time(NULL));
+    // Make the randomizer random. The seed also picks the starting units,
+    // so a replay puts it back.
+    unsigned int seed = time(NULL);
+    srand(seed);
 
     // Parse command line arguments
     int fxaa_level = Profile::getInstance()->getFxaaLevel();
@@ -56,11 +65,21 @@ int main(int argc, char* argv[]) {
     bool has_map = false;
     bool vsync   = Profile::getInstance()->getVsync();
     bool edit = false;
+    int headless_steps = 0;
+    int headless_units = HeadlessSimulation::DEFAULT_UNIT_COUNT;
+    bool no_window = false;
+    int team = 1;
+    int local_port = 0;
     char argument;
 
     std::string map_filename;
+    std::string record_filename;
+    std::string playback_filename;
+    std::string peer;
+    std::string save_snapshot_filename;
+    std::string load_snapshot_filename;
 
-    while ((argument = getopt(argc, argv, "wvfidem:x:")) != -1){
+    while ((argument = getopt(argc, argv, "wvfidenm:x:s:u:r:p:t:l:c:k:o:")) != -1){
         // printf("Read command line option:\n");
         // printf("  argument = %c\n", argument);
         // printf("  optopt   = %c\n", optopt);
@@ -84,6 +103,26 @@ int main(int argc, char* argv[]) {
             vsync = true;
         } else if (argument == 'e'){
             edit = true;
+        } else if (argument == 's'){
+            headless_steps = std::stoi(std::string(optarg));
+        } else if (argument == 'u'){
+            headless_units = std::stoi(std::string(optarg));
+        } else if (argument == 'r'){
+            record_filename = std::string(optarg);
+        } else if (argument == 'p'){
+            playback_filename = std::string(optarg);
+        } else if (argument == 'n'){
+            no_window = true;
+        } else if (argument == 't'){
+            team = std::stoi(std::string(optarg));
+        } else if (argument == 'l'){
+            local_port = std::stoi(std::string(optarg));
+        } else if (argument == 'c'){
+            peer = std::string(optarg);
+        } else if (argument == 'k'){
+            save_snapshot_filename = std::string(optarg);
+        } else if (argument == 'o'){
+            load_snapshot_filename = std::string(optarg);
         } else {
             printf("\nCommand line options:\n");
             printf("\t-f\n");
@@ -102,12 +141,137 @@ int main(int argc, char* argv[]) {
             printf("\t\tTurn on Verticl Sync.\n\n");
             printf("\t-e \n");
             printf("\t\tRun in level edit mode.\n\n");
+            printf("\t-s <steps>\n");
+            printf("\t\tRun <steps> simulation steps without a window and report how fast they went.\n\n");
+            printf("\t-u <units>\n");
+            printf("\t\tNumber of units to simulate with -s.\n\n");
+            printf("\t-r <replay_filename>\n");
+            printf("\t\tRecord every order given into <replay_filename>.\n\n");
+            printf("\t-p <replay_filename>\n");
+            printf("\t\tPlay back <replay_filename> and report how long its steps took.\n\n");
+            printf("\t-n \n");
+            printf("\t\tPlay back the replay without a window.\n\n");
+            printf("\t-c <host>:<port>\n");
+            printf("\t\tPlay in lockstep with the game at <host>:<port>.\n\n");
+            printf("\t-l <port>\n");
+            printf("\t\tListen for the other lockstep player on <port>.\n\n");
+            printf("\t-t <team>\n");
+            printf("\t\tPlay as team <team>, seeing only what it sees. Team 1 by default.\n\n");
+            printf("\t-o <snapshot_filename>\n");
+            printf("\t\tStart the -s run from <snapshot_filename> instead of the usual battle.\n\n");
+            printf("\t-k <snapshot_filename>\n");
+            printf("\t\tSave a snapshot to <snapshot_filename> at the end of the -s run.\n\n");
             return 1;
         }
     }
 
     Debug::is_on = debug;
 
+    if (!has_map){
+        map_filename = "res/maps/newformat.map";
+    }
+
+    // A replay starts where its recording did
+    Replay replay;
+    bool playing_back = !playback_filename.empty();
+    bool recording = !record_filename.empty() && !playing_back;
+
+    // Only orders go over the wire, so both players have to start from the
+    // same units
+    LockstepSession* lockstep = 0;
+    if (!peer.empty()){
+        if (playing_back || recording){
+            Debug::error("Replays can't be recorded or played in a lockstep game.\n");
+            return 1;
+        }
+
+        size_t colon = peer.rfind(':');
+        if (colon == std::string::npos){
+            Debug::error("Expected <host>:<port> for the lockstep peer, got %s.\n", peer.c_str());
+            return 1;
+        }
+
+        lockstep = new LockstepSession(team, local_port, peer.substr(0, colon), std::stoi(peer.substr(colon + 1)));
+        if (!lockstep->isConnected()){
+            return 1;
+        }
+
+        seed = 1;
+    }
+
+    if (playing_back){
+        if (!replay.load(playback_filename)){
+            return 1;
+        }
+
+        map_filename = replay.getMapFilename();
+        seed = replay.getSeed();
+        headless_units = replay.getUnitCount();
+
+        if (headless_units > 0 && !no_window){
+            Debug::error("Replay %s was recorded with %d units and no window, play it back with -n.\n", playback_filename.c_str(), headless_units);
+            return 1;
+        }
+    }
+
+    // Headless, no window or GL context is ever made
+    if (headless_steps > 0 || (playing_back && no_window)){
+        HeadlessSimulation simulation(map_filename, headless_units, playing_back ? seed : HeadlessSimulation::DEFAULT_SEED);
+        if (!simulation.isLoaded()){
+            return 1;
+        }
+
+        UnitManager& unit_manager = simulation.getUnitManager();
+
+        if (lockstep){
+            unit_manager.startLockstep(*lockstep);
+
+            // Each side orders both armies, but only its own listens
+            simulation.startBattle();
+            simulation.run(headless_steps);
+
+            lockstep->flush(LOCKSTEP_FLUSH_MS);
+            lockstep->printStats(simulation.getUnitHolder(), unit_manager.getStepCount());
+            delete lockstep;
+            return 0;
+        }
+
+        if (playing_back){
+            unit_manager.startPlayback(replay);
+            simulation.run(replay.getStepCount());
+            unit_manager.printPlaybackReport();
+            return 0;
+        }
+
+        if (recording){
+            replay.setMapFilename(map_filename);
+            replay.setSeed(HeadlessSimulation::DEFAULT_SEED);
+            replay.setUnitCount(headless_units);
+            unit_manager.startRecording(replay);
+        }
+
+        // The snapshot already has everyone's orders
+        if (!load_snapshot_filename.empty()){
+            if (!unit_manager.loadSnapshot(load_snapshot_filename)){
+                return 1;
+            }
+        } else {
+            simulation.startBattle();
+        }
+
+        simulation.run(headless_steps);
+
+        if (recording){
+            replay.setStepCount(unit_manager.getStepCount());
+            replay.save(record_filename);
+        }
+
+        if (!save_snapshot_filename.empty() && !unit_manager.saveSnapshot(save_snapshot_filename)){
+            return 1;
+        }
+        return 0;
+    }
+
     Window* our_window = Window::getInstance();
 
     // Create the window
@@ -127,11 +291,22 @@ int main(int argc, char* argv[]) {
     our_window->display();
 
     // Create the world
-    if (!has_map){
-        map_filename = "res/maps/newformat.map";
-    }
+    World world(map_filename.c_str(), edit, seed);
+
+    // Only what our team can see is drawn
+    world.getLevel().getGameMap().setViewingTeam(team);
 
-    World world(map_filename.c_str(), edit);
+    UnitManager& unit_manager = world.getLevel().getUnitManager();
+    if (lockstep){
+        unit_manager.startLockstep(*lockstep);
+    } else if (playing_back){
+        unit_manager.startPlayback(replay);
+    } else if (recording){
+        replay.setMapFilename(map_filename);
+        replay.setSeed(seed);
+        replay.setUnitCount(0);
+        unit_manager.startRecording(replay);
+    }
 
     float start_time = GameClock::getInstance()->getCurrentTime();
 
@@ -140,7 +315,7 @@ int main(int argc, char* argv[]) {
     InputHandler::getInstance();
 
     // Display loop
-    while(!our_window->shouldClose()) {
+    while(!our_window->shouldClose() && !unit_manager.isPlaybackFinished()) {
         // Just handle inputs in this thread.
         InputHandler::getInstance()->pollInputs();
         world.update();
@@ -153,6 +328,19 @@ int main(int argc, char* argv[]) {
     // Close the window
     our_window->close();
 
+    if (playing_back){
+        unit_manager.printPlaybackReport();
+    } else if (recording){
+        replay.setStepCount(unit_manager.getStepCount());
+        replay.save(record_filename);
+    }
+
+    if (lockstep){
+        lockstep->flush(LOCKSTEP_FLUSH_MS);
+        lockstep->printStats(world.getLevel().getUnitHolder(), unit_manager.getStepCount());
+        delete lockstep;
+    }
+
     // Add a line break before going back to the terminal prompt.
     printf("\n");
 
@@ -0,0 +1,494 @@
+#include "navigation_mesh.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+#include "pathing_grid.hpp"
+
+const int NavigationMesh::NO_POLYGON;
+const int NavigationMesh::MAX_POLYGON_SIZE;
+const int NavigationMesh::BUCKET_SIZE;
+
+NavigationMesh::NavigationMesh() : width(0), depth(0), buckets_x(0), buckets_z(0), search_generation(0) {
+
+}
+
+void NavigationMesh::build(PathingGrid& ground, int clearance){
+    width = ground.getWidth();
+    depth = ground.getDepth();
+    polygons.clear();
+    portals.clear();
+
+    vector<bool> walkable(width * depth);
+    for (int z = 0; z < depth; ++z){
+        for (int x = 0; x < width; ++x){
+            walkable[x + z * width] = ground.canPath(x + ground.getStartX(), z + ground.getStartZ(), clearance);
+        }
+    }
+
+    // Greedy cover: from the first open cell, take the longest run along x,
+    // then add rows below it for as long as the whole run is open
+    vector<int> owner(width * depth, NO_POLYGON);
+
+    for (int z = 0; z < depth; ++z){
+        for (int x = 0; x < width; ++x){
+            if (!walkable[x + z * width] || owner[x + z * width] != NO_POLYGON){
+                continue;
+            }
+
+            Polygon polygon;
+            polygon.min_x = x;
+            polygon.min_z = z;
+            polygon.max_x = x;
+            polygon.max_z = z;
+
+            while (polygon.max_x + 1 < width && polygon.max_x + 1 - x < MAX_POLYGON_SIZE){
+                int next = (polygon.max_x + 1) + z * width;
+                if (!walkable[next] || owner[next] != NO_POLYGON){
+                    break;
+                }
+                polygon.max_x++;
+            }
+
+            while (polygon.max_z + 1 < depth && polygon.max_z + 1 - z < MAX_POLYGON_SIZE){
+                int row = (polygon.max_z + 1) * width;
+                bool row_open = true;
+                for (int run_x = x; run_x <= polygon.max_x && row_open; ++run_x){
+                    row_open = walkable[run_x + row] && owner[run_x + row] == NO_POLYGON;
+                }
+                if (!row_open){
+                    break;
+                }
+                polygon.max_z++;
+            }
+
+            int id = polygons.size();
+            for (int fill_z = polygon.min_z; fill_z <= polygon.max_z; ++fill_z){
+                std::fill(owner.begin() + polygon.min_x + fill_z * width, owner.begin() + polygon.max_x + 1 + fill_z * width, id);
+            }
+            polygons.push_back(polygon);
+        }
+    }
+
+    // Every shared border, found from the polygon on its low side. Only
+    // sides count, two rectangles meeting at a corner aren't linked.
+    for (int p = 0; p < polygons.size(); ++p){
+        Polygon& polygon = polygons[p];
+
+        if (polygon.max_x + 1 < width){
+            int beyond = polygon.max_x + 1;
+            for (int z = polygon.min_z; z <= polygon.max_z; ++z){
+                int other = owner[beyond + z * width];
+                if (other == NO_POLYGON){
+                    continue;
+                }
+
+                Portal portal;
+                portal.polygon_a = p;
+                portal.polygon_b = other;
+                portal.along_x = true;
+                portal.line = polygon.max_x;
+                portal.low = z;
+                while (z + 1 <= polygon.max_z && owner[beyond + (z + 1) * width] == other){
+                    ++z;
+                }
+                portal.high = z;
+                portals.push_back(portal);
+            }
+        }
+
+        if (polygon.max_z + 1 < depth){
+            int beyond = (polygon.max_z + 1) * width;
+            for (int x = polygon.min_x; x <= polygon.max_x; ++x){
+                int other = owner[x + beyond];
+                if (other == NO_POLYGON){
+                    continue;
+                }
+
+                Portal portal;
+                portal.polygon_a = p;
+                portal.polygon_b = other;
+                portal.along_x = false;
+                portal.line = polygon.max_z;
+                portal.low = x;
+                while (x + 1 <= polygon.max_x && owner[(x + 1) + beyond] == other){
+                    ++x;
+                }
+                portal.high = x;
+                portals.push_back(portal);
+            }
+        }
+    }
+
+    linkPolygons();
+}
+
+void NavigationMesh::linkPolygons(){
+    int polygon_count = polygons.size();
+
+    // Portals of each polygon, counted then placed
+    first_portal.assign(polygon_count + 1, 0);
+    for (Portal& portal : portals){
+        first_portal[portal.polygon_a + 1]++;
+        first_portal[portal.polygon_b + 1]++;
+    }
+    for (int p = 0; p < polygon_count; ++p){
+        first_portal[p + 1] += first_portal[p];
+    }
+
+    vector<int> next_slot(first_portal.begin(), first_portal.end() - 1);
+    polygon_portals.resize(portals.size() * 2);
+    for (int i = 0; i < portals.size(); ++i){
+        polygon_portals[next_slot[portals[i].polygon_a]++] = i;
+        polygon_portals[next_slot[portals[i].polygon_b]++] = i;
+    }
+
+    // Polygons overlapping each bucket, the same way
+    buckets_x = (width + BUCKET_SIZE - 1) / BUCKET_SIZE;
+    buckets_z = (depth + BUCKET_SIZE - 1) / BUCKET_SIZE;
+
+    first_bucket_polygon.assign(buckets_x * buckets_z + 1, 0);
+    for (int pass = 0; pass < 2; ++pass){
+        if (pass == 1){
+            for (int b = 0; b < buckets_x * buckets_z; ++b){
+                first_bucket_polygon[b + 1] += first_bucket_polygon[b];
+            }
+            next_slot.assign(first_bucket_polygon.begin(), first_bucket_polygon.end() - 1);
+            bucket_polygons.resize(first_bucket_polygon.back());
+        }
+
+        for (int p = 0; p < polygon_count; ++p){
+            Polygon& polygon = polygons[p];
+            for (int bucket_z = polygon.min_z / BUCKET_SIZE; bucket_z <= polygon.max_z / BUCKET_SIZE; ++bucket_z){
+                for (int bucket_x = polygon.min_x / BUCKET_SIZE; bucket_x <= polygon.max_x / BUCKET_SIZE; ++bucket_x){
+                    int bucket = bucket_x + bucket_z * buckets_x;
+                    if (pass == 0){
+                        first_bucket_polygon[bucket + 1]++;
+                    } else {
+                        bucket_polygons[next_slot[bucket]++] = p;
+                    }
+                }
+            }
+        }
+    }
+
+    g_score.resize(polygon_count);
+    entry_portal.resize(polygon_count);
+    entry_point.resize(polygon_count);
+    stamp.assign(polygon_count, 0);
+    search_generation = 0;
+    open_polygons.resize(polygon_count);
+}
+
+int NavigationMesh::findPolygon(int x, int z){
+    if (x < 0 || z < 0 || x >= width || z >= depth){
+        return NO_POLYGON;
+    }
+
+    int bucket = (x / BUCKET_SIZE) + (z / BUCKET_SIZE) * buckets_x;
+    for (int i = first_bucket_polygon[bucket]; i < first_bucket_polygon[bucket + 1]; ++i){
+        Polygon& polygon = polygons[bucket_polygons[i]];
+        if (x >= polygon.min_x && x <= polygon.max_x && z >= polygon.min_z && z <= polygon.max_z){
+            return bucket_polygons[i];
+        }
+    }
+
+    return NO_POLYGON;
+}
+
+bool NavigationMesh::findPath(float start_x, float start_z, float target_x, float target_z, vector<glm::vec3>& path){
+    glm::vec2 start(start_x, start_z);
+    glm::vec2 target(target_x, target_z);
+
+    int start_polygon = findPolygon(int(std::floor(start_x + 0.5f)), int(std::floor(start_z + 0.5f)));
+    int target_polygon = findPolygon(int(std::floor(target_x + 0.5f)), int(std::floor(target_z + 0.5f)));
+
+    if (start_polygon == NO_POLYGON || target_polygon == NO_POLYGON){
+        return false;
+    }
+
+    path.clear();
+
+    // Nothing is in the way inside one rectangle
+    if (start_polygon == target_polygon){
+        path.push_back(glm::vec3(target_x, 0.0f, target_z));
+        return true;
+    }
+
+    // Bumping the generation forgets the last search without clearing it
+    ++search_generation;
+    if (search_generation == 0){
+        std::fill(stamp.begin(), stamp.end(), 0);
+        search_generation = 1;
+    }
+
+    open_polygons.clear();
+
+    stamp[start_polygon] = search_generation;
+    g_score[start_polygon] = 0.0f;
+    entry_portal[start_polygon] = -1;
+    entry_point[start_polygon] = start;
+    open_polygons.push(start_polygon, glm::distance(start, target));
+
+    bool found = false;
+
+    while (!open_polygons.empty()){
+        int current = open_polygons.pop();
+
+        if (current == target_polygon){
+            found = true;
+            break;
+        }
+
+        // Each polygon is costed as if it were entered where the line to
+        // the target meets the portal, the funnel straightens the real path
+        // out later
+        for (int i = first_portal[current]; i < first_portal[current + 1]; ++i){
+            int portal_index = polygon_portals[i];
+            Portal& portal = portals[portal_index];
+            int next = (portal.polygon_a == current) ? portal.polygon_b : portal.polygon_a;
+
+            glm::vec2 point = getPortalPoint(portal, entry_point[current], target);
+            float g = g_score[current] + glm::distance(entry_point[current], point);
+
+            if (stamp[next] == search_generation){
+                if (!open_polygons.contains(next) || g >= g_score[next]){
+                    continue;
+                }
+            }
+
+            float f = g + glm::distance(point, target);
+
+            if (stamp[next] != search_generation){
+                stamp[next] = search_generation;
+                open_polygons.push(next, f);
+            } else {
+                open_polygons.decreaseKey(next, f);
+            }
+
+            g_score[next] = g;
+            entry_portal[next] = portal_index;
+            entry_point[next] = point;
+        }
+    }
+
+    if (!found){
+        return false;
+    }
+
+    // The portals crossed, start to target
+    corridor.clear();
+    for (int polygon = target_polygon; entry_portal[polygon] != -1; ){
+        Portal& portal = portals[entry_portal[polygon]];
+        corridor.push_back(entry_portal[polygon]);
+        polygon = (portal.polygon_a == polygon) ? portal.polygon_b : portal.polygon_a;
+    }
+    std::reverse(corridor.begin(), corridor.end());
+
+    funnel_left.clear();
+    funnel_right.clear();
+    funnel_left.push_back(start);
+    funnel_right.push_back(start);
+
+    int from = start_polygon;
+    for (int portal_index : corridor){
+        Portal& portal = portals[portal_index];
+        glm::vec2 left;
+        glm::vec2 right;
+        getPortalEnds(portal, from, left, right);
+        funnel_left.push_back(left);
+        funnel_right.push_back(right);
+        from = (portal.polygon_a == from) ? portal.polygon_b : portal.polygon_a;
+    }
+
+    funnel_left.push_back(target);
+    funnel_right.push_back(target);
+
+    pullFunnel(start, target, path);
+    return true;
+}
+
+glm::vec2 NavigationMesh::getPortalPoint(Portal& portal, glm::vec2 from, glm::vec2 to){
+    // Where the line from -> to crosses the border, kept on the portal
+    float border = portal.line + 0.5f;
+
+    if (portal.along_x){
+        float t = (to.x == from.x) ? 0.0f : (border - from.x) / (to.x - from.x);
+        float y = from.y + (to.y - from.y) * std::max(0.0f, std::min(t, 1.0f));
+        return glm::vec2(border, std::max(float(portal.low), std::min(y, float(portal.high))));
+    }
+    float t = (to.y == from.y) ? 0.0f : (border - from.y) / (to.y - from.y);
+    float x = from.x + (to.x - from.x) * std::max(0.0f, std::min(t, 1.0f));
+    return glm::vec2(std::max(float(portal.low), std::min(x, float(portal.high))), border);
+}
+
+void NavigationMesh::getPortalEnds(Portal& portal, int from, glm::vec2& left, glm::vec2& right){
+    // The ends stop at the middle of the end cells rather than their outer
+    // edge, so a corner of the path never sits on a blocked cell's corner
+    float border = portal.line + 0.5f;
+    glm::vec2 low_end = portal.along_x ? glm::vec2(border, portal.low) : glm::vec2(portal.low, border);
+    glm::vec2 high_end = portal.along_x ? glm::vec2(border, portal.high) : glm::vec2(portal.high, border);
+
+    // Polygon a is on the low side. Left is anticlockwise from the way we
+    // are heading, which flips with the direction of the crossing.
+    bool forwards = (portal.polygon_a == from);
+    bool high_is_left = (portal.along_x == forwards);
+
+    left = high_is_left ? high_end : low_end;
+    right = high_is_left ? low_end : high_end;
+}
+
+float NavigationMesh::triangleArea(glm::vec2 a, glm::vec2 b, glm::vec2 c){
+    // Twice the signed area, negative when c is anticlockwise of a -> b
+    return (c.x - a.x) * (b.y - a.y) - (b.x - a.x) * (c.y - a.y);
+}
+
+void NavigationMesh::pullFunnel(glm::vec2 start, glm::vec2 target, vector<glm::vec3>& path){
+    // Simple stupid funnel algorithm (Mononen). The funnel is narrowed one
+    // portal at a time, and when one side would cross the other the apex
+    // moves to that side's point, which becomes a corner of the path.
+    glm::vec2 apex = start;
+    glm::vec2 left = funnel_left[0];
+    glm::vec2 right = funnel_right[0];
+    int apex_index = 0;
+    int left_index = 0;
+    int right_index = 0;
+
+    for (int i = 1; i < funnel_left.size(); ++i){
+        glm::vec2 portal_left = funnel_left[i];
+        glm::vec2 portal_right = funnel_right[i];
+
+        if (triangleArea(apex, right, portal_right) <= 0.0f){
+            if (apex == right || triangleArea(apex, left, portal_right) > 0.0f){
+                right = portal_right;
+                right_index = i;
+            } else {
+                // Right went past left, so left is a corner
+                if (left_index == funnel_left.size() - 1){
+                    break;
+                }
+
+                addCorner(start, left, path);
+                apex = left;
+                apex_index = left_index;
+
+                left = apex;
+                right = apex;
+                left_index = apex_index;
+                right_index = apex_index;
+                i = apex_index;
+                continue;
+            }
+        }
+
+        if (triangleArea(apex, left, portal_left) >= 0.0f){
+            if (apex == left || triangleArea(apex, right, portal_left) < 0.0f){
+                left = portal_left;
+                left_index = i;
+            } else {
+                if (right_index == funnel_left.size() - 1){
+                    break;
+                }
+
+                addCorner(start, right, path);
+                apex = right;
+                apex_index = right_index;
+
+                left = apex;
+                right = apex;
+                left_index = apex_index;
+                right_index = apex_index;
+                i = apex_index;
+                continue;
+            }
+        }
+    }
+
+    path.push_back(glm::vec3(target.x, 0.0f, target.y));
+}
+
+void NavigationMesh::addCorner(glm::vec2 start, glm::vec2 corner, vector<glm::vec3>& path){
+    // A corner sits on the border between two cells. Line tests work from
+    // whole cells, so the path steps through the cells on both sides of it,
+    // the one nearest the last waypoint first.
+    glm::vec2 from = path.empty() ? start : glm::vec2(path.back().x, path.back().z);
+    glm::vec2 low_cell(std::floor(corner.x), std::floor(corner.y));
+    glm::vec2 high_cell(std::ceil(corner.x), std::ceil(corner.y));
+
+    if (glm::distance(from, high_cell) < glm::distance(from, low_cell)){
+        std::swap(low_cell, high_cell);
+    }
+
+    path.push_back(glm::vec3(low_cell.x, 0.0f, low_cell.y));
+    if (!(high_cell == low_cell)){
+        path.push_back(glm::vec3(high_cell.x, 0.0f, high_cell.y));
+    }
+}
+
+bool NavigationMesh::write(FILE* file){
+    int32_t header[4] = { width, depth, int32_t(polygons.size()), int32_t(portals.size()) };
+    if (fwrite(header, sizeof(header), 1, file) != 1){
+        return false;
+    }
+
+    for (Polygon& polygon : polygons){
+        int32_t fields[4] = { polygon.min_x, polygon.min_z, polygon.max_x, polygon.max_z };
+        if (fwrite(fields, sizeof(fields), 1, file) != 1){
+            return false;
+        }
+    }
+
+    for (Portal& portal : portals){
+        int32_t fields[6] = { portal.polygon_a, portal.polygon_b, portal.along_x, portal.line, portal.low, portal.high };
+        if (fwrite(fields, sizeof(fields), 1, file) != 1){
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool NavigationMesh::read(FILE* file){
+    int32_t header[4];
+    if (fread(header, sizeof(header), 1, file) != 1 || header[2] < 0 || header[3] < 0){
+        return false;
+    }
+
+    width = header[0];
+    depth = header[1];
+    polygons.resize(header[2]);
+    portals.resize(header[3]);
+
+    for (Polygon& polygon : polygons){
+        int32_t fields[4];
+        if (fread(fields, sizeof(fields), 1, file) != 1){
+            return false;
+        }
+        polygon.min_x = fields[0];
+        polygon.min_z = fields[1];
+        polygon.max_x = fields[2];
+        polygon.max_z = fields[3];
+    }
+
+    for (Portal& portal : portals){
+        int32_t fields[6];
+        if (fread(fields, sizeof(fields), 1, file) != 1){
+            return false;
+        }
+        portal.polygon_a = fields[0];
+        portal.polygon_b = fields[1];
+        portal.along_x = (fields[2] != 0);
+        portal.line = fields[3];
+        portal.low = fields[4];
+        portal.high = fields[5];
+
+        if (portal.polygon_a < 0 || portal.polygon_b < 0 || portal.polygon_a >= polygons.size() || portal.polygon_b >= polygons.size()){
+            return false;
+        }
+    }
+
+    // The lookup tables are quick to derive, so they aren't stored
+    linkPolygons();
+    return true;
+}
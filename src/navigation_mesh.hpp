@@ -0,0 +1,113 @@
+#ifndef NavigationMesh_h
+#define NavigationMesh_h
+
+#include "includes/glm.hpp"
+
+#include <vector>
+#include <cstdio>
+
+#include "indexed_heap.hpp"
+
+using namespace std;
+
+class PathingGrid;
+
+// The cells of a pathing grid one clearance class can stand on, covered by
+// rectangles. A rectangle is convex, so a unit can walk straight between any
+// two points in it, and two rectangles that touch are linked by the stretch
+// of border they share (a portal). Searches run over the rectangles instead
+// of the cells, and the funnel algorithm then pulls the corridor of
+// rectangles tight into as few waypoints as it needs.
+//
+// Everything is in grid indices, with cell (x, z) covering the square of
+// side 1 centred on (x, z).
+class NavigationMesh {
+public:
+    NavigationMesh();
+
+    void build(PathingGrid& ground, int clearance);
+
+    // Corners of the shortest way through the mesh, then the target, the
+    // same shape of path PathFinder gives. False if either end is off the
+    // mesh or no chain of portals joins them.
+    bool findPath(float start_x, float start_z, float target_x, float target_z, vector<glm::vec3>& path);
+
+    int getPolygonCount() {return polygons.size();}
+    int getPortalCount() {return portals.size();}
+    int getWidth() {return width;}
+    int getDepth() {return depth;}
+
+    bool write(FILE* file);
+    bool read(FILE* file);
+
+    static const int NO_POLYGON = -1;
+
+    // Rectangles are cut at this size. Long thin ones would make the portal
+    // crossing points a poor guide for the search.
+    static const int MAX_POLYGON_SIZE = 64;
+
+    // Side of the squares used to find which rectangle a point is in
+    static const int BUCKET_SIZE = 16;
+
+private:
+    struct Polygon {
+        int min_x;
+        int min_z;
+        int max_x;
+        int max_z;
+    };
+
+    // The border between two rectangles. A crossing along x sits between
+    // columns line and line + 1 and covers rows low to high, a crossing
+    // along z the other way around.
+    struct Portal {
+        int polygon_a;
+        int polygon_b;
+        bool along_x;
+        int line;
+        int low;
+        int high;
+    };
+
+    int findPolygon(int x, int z);
+    void linkPolygons();
+
+    glm::vec2 getPortalPoint(Portal& portal, glm::vec2 from, glm::vec2 to);
+    void getPortalEnds(Portal& portal, int from, glm::vec2& left, glm::vec2& right);
+    void pullFunnel(glm::vec2 start, glm::vec2 target, vector<glm::vec3>& path);
+    void addCorner(glm::vec2 start, glm::vec2 corner, vector<glm::vec3>& path);
+
+    static float triangleArea(glm::vec2 a, glm::vec2 b, glm::vec2 c);
+
+    vector<Polygon> polygons;
+    vector<Portal> portals;
+
+    // Portals of polygon p are polygon_portals[first_portal[p]] up to
+    // first_portal[p + 1]
+    vector<int> first_portal;
+    vector<int> polygon_portals;
+
+    // The same layout for the polygons overlapping each bucket
+    vector<int> first_bucket_polygon;
+    vector<int> bucket_polygons;
+
+    int width;
+    int depth;
+    int buckets_x;
+    int buckets_z;
+
+    // Search state per polygon, valid when its stamp is the current one
+    vector<float> g_score;
+    vector<int> entry_portal;
+    vector<glm::vec2> entry_point;
+    vector<unsigned int> stamp;
+    unsigned int search_generation;
+    IndexedHeap open_polygons;
+
+    // The corridor the last search found, start to target
+    vector<int> corridor;
+    vector<glm::vec2> funnel_left;
+    vector<glm::vec2> funnel_right;
+};
+
+#endif
@@ -35,6 +35,8 @@ void Emitter::initialize(Shader shader, glm::vec3 pos) {
 
     billboard = new PlaneMesh();
 
+    unstepped_time = 0.0f;
+
     particle_texture = Texture("res/textures/snow_part.png");
 
     this->maxParticles = 200;
@@ -64,9 +66,12 @@ void Emitter::draw(){
     glDepthFunc(GL_LEQUAL);
     glDepthMask(GL_FALSE);
 
-    float new_time = GameClock::getInstance()->getDeltaTime();
-    int frames = int((new_time*60.0f)) + 1;
-    frames = std::max(frames, 0);
+    // Step at 60 Hz however often we're drawn. A long frame only catches
+    // up a few steps, particles are just for show.
+    unstepped_time += GameClock::getInstance()->getDeltaTime();
+    int frames = int(unstepped_time / GameClock::SIMULATION_STEP);
+    frames = std::max(std::min(frames, GameClock::MAX_CATCH_UP_STEPS), 0);
+    unstepped_time = std::min(unstepped_time - frames * GameClock::SIMULATION_STEP, GameClock::SIMULATION_STEP);
 
     for(int j = 0; j < frames; ++j){
         for(int i = 0; i < particles.size(); ++i){
@@ -42,6 +42,9 @@ protected:
 
     float old_time;
 
+    // Frame time not yet stepped through, particles move at a fixed rate
+    float unstepped_time;
+
     int maxParticles;
     int density;
     int lifespan;
@@ -0,0 +1,166 @@
+#include "path_cache.hpp"
+
+const int PathCache::START_REGION_SIZE;
+
+PathCache::PathCache(PathingGrid& ground, int capacity) : ground(&ground), capacity(capacity), hits(0), misses(0), evictions(0), invalidations(0) {
+    PathingGrid::Change_Callback_Type callback = std::bind(&PathCache::invalidate, this,
+        std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4);
+    change_callback_id = ground.addChangeCallback(callback);
+}
+
+PathCache::~PathCache(){
+    ground->removeChangeCallback(change_callback_id);
+}
+
+bool PathCache::find(float start_x, float start_z, float target_x, float target_z, int clearance, vector<glm::vec3>& path){
+    map<Key, list<Entry>::iterator>::iterator it = lookup.find(makeKey(start_x, start_z, target_x, target_z, clearance));
+
+    if (it == lookup.end()){
+        misses++;
+        return false;
+    }
+
+    // Same region doesn't mean the same side of a wall
+    Entry& entry = *(it->second);
+    if (!ground->canPathOnLine(start_x, start_z, entry.path[0].x, entry.path[0].z, clearance)){
+        misses++;
+        return false;
+    }
+
+    entries.splice(entries.begin(), entries, it->second);
+    path = entry.path;
+    hits++;
+    return true;
+}
+
+void PathCache::insert(float start_x, float start_z, float target_x, float target_z, int clearance, vector<glm::vec3>& path){
+    if (path.empty() || capacity <= 0){
+        return;
+    }
+
+    Key key = makeKey(start_x, start_z, target_x, target_z, clearance);
+
+    map<Key, list<Entry>::iterator>::iterator it = lookup.find(key);
+    if (it != lookup.end()){
+        entries.erase(it->second);
+        lookup.erase(it);
+    }
+
+    Entry entry;
+    entry.key = key;
+    entry.start = glm::vec3(start_x, 0.0f, start_z);
+    entry.path = path;
+    entry.goal = glm::vec3(target_x, 0.0f, target_z);
+    entry.min_x = std::min(start_x, target_x);
+    entry.min_z = std::min(start_z, target_z);
+    entry.max_x = std::max(start_x, target_x);
+    entry.max_z = std::max(start_z, target_z);
+
+    for (glm::vec3& point : path){
+        entry.min_x = std::min(entry.min_x, point.x);
+        entry.min_z = std::min(entry.min_z, point.z);
+        entry.max_x = std::max(entry.max_x, point.x);
+        entry.max_z = std::max(entry.max_z, point.z);
+    }
+
+    entries.push_front(entry);
+    lookup[key] = entries.begin();
+
+    while (int(entries.size()) > capacity){
+        lookup.erase(entries.back().key);
+        entries.pop_back();
+        evictions++;
+    }
+}
+
+void PathCache::clear(){
+    entries.clear();
+    lookup.clear();
+}
+
+void PathCache::setCapacity(int capacity){
+    this->capacity = capacity;
+
+    while (int(entries.size()) > std::max(capacity, 0)){
+        lookup.erase(entries.back().key);
+        entries.pop_back();
+        evictions++;
+    }
+}
+
+PathCache::Key PathCache::makeKey(float start_x, float start_z, float target_x, float target_z, int clearance){
+    // Regions are counted from the grid's corner so they don't straddle 0
+    int region_x = (int(start_x) - ground->getStartX()) / START_REGION_SIZE;
+    int region_z = (int(start_z) - ground->getStartZ()) / START_REGION_SIZE;
+
+    return std::make_tuple(region_x, region_z, int(target_x), int(target_z), clearance);
+}
+
+void PathCache::invalidate(int min_x, int min_z, int max_x, int max_z){
+    // Cells count as the whole [x, x + 1) square
+    float area_min_x = min_x;
+    float area_min_z = min_z;
+    float area_max_x = max_x + 1;
+    float area_max_z = max_z + 1;
+
+    for (list<Entry>::iterator it = entries.begin(); it != entries.end();){
+        if (crossesArea(*it, area_min_x, area_min_z, area_max_x, area_max_z)){
+            lookup.erase(it->key);
+            it = entries.erase(it);
+            invalidations++;
+        } else {
+            ++it;
+        }
+    }
+}
+
+bool PathCache::crossesArea(Entry& entry, float min_x, float min_z, float max_x, float max_z){
+    if (entry.max_x < min_x || entry.min_x > max_x || entry.max_z < min_z || entry.min_z > max_z){
+        return false;
+    }
+
+    glm::vec3 previous = entry.start;
+    for (glm::vec3& point : entry.path){
+        if (segmentCrossesArea(previous, point, min_x, min_z, max_x, max_z)){
+            return true;
+        }
+        previous = point;
+    }
+
+    return segmentCrossesArea(previous, entry.goal, min_x, min_z, max_x, max_z);
+}
+
+bool PathCache::segmentCrossesArea(glm::vec3 a, glm::vec3 b, float min_x, float min_z, float max_x, float max_z){
+    // Liang-Barsky: clip the segment's parameter range against each slab
+    float t_enter = 0.0f;
+    float t_exit = 1.0f;
+
+    float delta[2] = { b.x - a.x, b.z - a.z };
+    float origin[2] = { a.x, a.z };
+    float low[2] = { min_x, min_z };
+    float high[2] = { max_x, max_z };
+
+    for (int axis = 0; axis < 2; ++axis){
+        if (delta[axis] == 0.0f){
+            if (origin[axis] < low[axis] || origin[axis] > high[axis]){
+                return false;
+            }
+            continue;
+        }
+
+        float t_low = (low[axis] - origin[axis]) / delta[axis];
+        float t_high = (high[axis] - origin[axis]) / delta[axis];
+        if (t_low > t_high){
+            std::swap(t_low, t_high);
+        }
+
+        t_enter = std::max(t_enter, t_low);
+        t_exit = std::min(t_exit, t_high);
+
+        if (t_enter > t_exit){
+            return false;
+        }
+    }
+
+    return true;
+}
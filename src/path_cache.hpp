@@ -0,0 +1,80 @@
+#ifndef PathCache_h
+#define PathCache_h
+
+#include "includes/glm.hpp"
+
+#include <vector>
+#include <list>
+#include <map>
+#include <tuple>
+
+#include "pathing_grid.hpp"
+
+using namespace std;
+
+// Least recently used cache of finished paths. Entries are keyed by the
+// START_REGION_SIZE square the path started in, the goal cell and the
+// clearance class, so repeated orders from roughly the same place to the
+// same spot skip the search. A cached path is only handed out if its first
+// waypoint can be walked to in a straight line from the new start.
+//
+// Any grid edit that touches a cached route drops that entry.
+class PathCache {
+public:
+    PathCache(PathingGrid& ground, int capacity = 256);
+    ~PathCache();
+
+    bool find(float start_x, float start_z, float target_x, float target_z, int clearance, vector<glm::vec3>& path);
+    void insert(float start_x, float start_z, float target_x, float target_z, int clearance, vector<glm::vec3>& path);
+
+    void clear();
+    void setCapacity(int capacity);
+
+    int getSize() {return entries.size();}
+    int getCapacity() {return capacity;}
+    int getHits() {return hits;}
+    int getMisses() {return misses;}
+    int getEvictions() {return evictions;}
+    int getInvalidations() {return invalidations;}
+
+    static const int START_REGION_SIZE = 4;
+
+private:
+    typedef tuple<int, int, int, int, int> Key;
+
+    struct Entry {
+        Key key;
+        glm::vec3 start;
+        vector<glm::vec3> path;
+
+        // Searches don't always end the path on the goal, and the last leg
+        // to it is walked too
+        glm::vec3 goal;
+
+        // Bounding box of the whole route, to skip most edits quickly
+        float min_x;
+        float min_z;
+        float max_x;
+        float max_z;
+    };
+
+    Key makeKey(float start_x, float start_z, float target_x, float target_z, int clearance);
+    void invalidate(int min_x, int min_z, int max_x, int max_z);
+    static bool crossesArea(Entry& entry, float min_x, float min_z, float max_x, float max_z);
+    static bool segmentCrossesArea(glm::vec3 a, glm::vec3 b, float min_x, float min_z, float max_x, float max_z);
+
+    // Most recently used at the front
+    list<Entry> entries;
+    map<Key, list<Entry>::iterator> lookup;
+
+    PathingGrid* ground;
+    int change_callback_id;
+    int capacity;
+
+    int hits;
+    int misses;
+    int evictions;
+    int invalidations;
+};
+
+#endif
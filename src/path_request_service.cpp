@@ -0,0 +1,368 @@
+#include "path_request_service.hpp"
+
+#include <limits>
+#include <algorithm>
+
+const int PathRequestService::AUTO_WORKERS;
+const int PathRequestService::NODES_PER_SLICE;
+const int PathRequestService::MAX_SLICED_SEARCHES;
+
+PathRequestService::PathRequestService(PathingGrid& ground, int worker_count, float slice_budget_ms) : ground(&ground), shutting_down(false), next_ticket(1), busy_workers(0), workers_started(0), first_changed_area(0), slice_budget_ms(slice_budget_ms), next_slice(0), path_cache(ground) {
+    time_sliced = (worker_count == 0);
+
+    PathingGrid::Change_Callback_Type callback = std::bind(&PathRequestService::publishSnapshot, this,
+        std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4);
+    change_callback_id = ground.addChangeCallback(callback);
+
+    if (time_sliced){
+        return;
+    }
+
+    snapshot = makeSnapshot(ground);
+
+    if (worker_count < 0){
+        worker_count = std::max(int(std::thread::hardware_concurrency()) - 1, 1);
+    }
+
+    // Every worker starts from the snapshot, at version 0
+    worker_versions.assign(worker_count, 0);
+
+    for (int i = 0; i < worker_count; ++i){
+        workers.push_back(std::thread(&PathRequestService::workerLoop, this, i));
+    }
+}
+
+PathRequestService::~PathRequestService(){
+    ground->removeChangeCallback(change_callback_id);
+
+    {
+        std::lock_guard<std::mutex> lock(request_mutex);
+        shutting_down = true;
+    }
+    request_available.notify_all();
+
+    for (std::thread& worker : workers){
+        worker.join();
+    }
+}
+
+int PathRequestService::pushRequest(Request& request){
+    request.ticket = next_ticket++;
+    request.grid_version = getGridVersion();
+
+    {
+        std::lock_guard<std::mutex> lock(request_mutex);
+        requests.push_back(request);
+    }
+    request_available.notify_one();
+
+    return request.ticket;
+}
+
+int PathRequestService::requestPath(float start_x, float start_z, float target_x, float target_z, float radius){
+    Request request;
+    request.start_x = start_x;
+    request.start_z = start_z;
+    request.target_x = target_x;
+    request.target_z = target_z;
+    request.radius = radius;
+    request.wants_flow_field = false;
+
+    PathResult cached;
+    if (path_cache.find(start_x, start_z, target_x, target_z, PathingGrid::getClearanceClass(radius), cached.path)){
+        request.ticket = next_ticket++;
+        cached.request = request;
+        cached.from_cache = true;
+
+        std::lock_guard<std::mutex> lock(result_mutex);
+        results[request.ticket] = cached;
+        return request.ticket;
+    }
+
+    return pushRequest(request);
+}
+
+int PathRequestService::requestFlowField(float target_x, float target_z, float radius){
+    Request request;
+    request.start_x = target_x;
+    request.start_z = target_z;
+    request.target_x = target_x;
+    request.target_z = target_z;
+    request.radius = radius;
+    request.wants_flow_field = true;
+
+    return pushRequest(request);
+}
+
+bool PathRequestService::takeResult(int ticket, vector<glm::vec3>& path){
+    PathResult result;
+    {
+        std::lock_guard<std::mutex> lock(result_mutex);
+
+        map<int, PathResult>::iterator it = results.find(ticket);
+        if (it == results.end()){
+            return false;
+        }
+
+        result.request = it->second.request;
+        result.from_cache = it->second.from_cache;
+        path.swap(it->second.path);
+        results.erase(it);
+    }
+
+    // A worker may have searched an older grid than the one the cache is
+    // checked against now, so only keep paths that no edit has overtaken.
+    int grid_version = getGridVersion();
+
+    Request& request = result.request;
+    if (!result.from_cache && request.grid_version == grid_version){
+        path_cache.insert(request.start_x, request.start_z, request.target_x, request.target_z, PathingGrid::getClearanceClass(request.radius), path);
+    }
+
+    return true;
+}
+
+bool PathRequestService::getPartialPath(int ticket, vector<glm::vec3>& path){
+    for (SlicedSearch& search : sliced_searches){
+        if (search.request.ticket == ticket){
+            path = search.pathfinder->getPath();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool PathRequestService::takeFlowField(int ticket, shared_ptr<FlowField>& field){
+    std::lock_guard<std::mutex> lock(result_mutex);
+
+    map<int, shared_ptr<FlowField>>::iterator it = flow_field_results.find(ticket);
+    if (it == flow_field_results.end()){
+        return false;
+    }
+
+    field = it->second;
+    flow_field_results.erase(it);
+    return true;
+}
+
+void PathRequestService::workerLoop(int worker){
+    // Everything a search touches is private to this thread
+    shared_ptr<const PathingGrid> start;
+    {
+        std::lock_guard<std::mutex> lock(snapshot_mutex);
+        start = snapshot;
+
+        // Nobody needs the whole grid again once every worker has it
+        if (++workers_started == worker_versions.size()){
+            snapshot.reset();
+        }
+    }
+
+    PathingGrid local_ground(start->getWidth(), start->getDepth(), start->getStartX(), start->getStartZ());
+    local_ground.copyArea(*start, start->getStartX(), start->getStartZ(),
+        start->getStartX() + start->getWidth() - 1, start->getStartZ() + start->getDepth() - 1);
+    start.reset();
+
+    vector<shared_ptr<const PathingGrid::Area>> changes;
+
+    // The navigation mesh answers most queries in a few dozen microseconds,
+    // and falls back to jump points for the few it can't
+    PathFinder pathfinder(local_ground, PathFinder::Mode::NAVIGATION_MESH);
+
+    while (true){
+        Request request;
+        {
+            std::unique_lock<std::mutex> lock(request_mutex);
+            while (requests.empty() && !shutting_down){
+                request_available.wait(lock);
+            }
+            if (shutting_down){
+                return;
+            }
+            request = requests.front();
+            requests.pop_front();
+            busy_workers++;
+        }
+
+        // Catch up with any edits made since the last search
+        changes.clear();
+        takeChanges(worker, changes);
+        for (shared_ptr<const PathingGrid::Area>& area : changes){
+            local_ground.loadArea(*area);
+        }
+
+        if (request.wants_flow_field){
+            buildFlowField(local_ground, request);
+        } else {
+            vector<glm::vec3> path = pathfinder.find_path(request.start_x, request.start_z, request.target_x, request.target_z, request.radius);
+            finishRequest(request, path);
+        }
+
+        std::lock_guard<std::mutex> lock(request_mutex);
+        if (--busy_workers == 0 && requests.empty()){
+            requests_finished.notify_all();
+        }
+    }
+}
+
+void PathRequestService::finishAll(){
+    if (time_sliced){
+        // Without a budget update only stops once nothing is left
+        float budget = slice_budget_ms;
+        slice_budget_ms = std::numeric_limits<float>::infinity();
+        update();
+        slice_budget_ms = budget;
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(request_mutex);
+    requests_finished.wait(lock, [this]{ return requests.empty() && busy_workers == 0; });
+}
+
+void PathRequestService::update(){
+    if (!time_sliced){
+        return;
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    int grid_version = getGridVersion();
+
+    // Searches run on the live grid, so one that an edit overtook might be
+    // heading through something that is no longer there. Start it again.
+    for (int i = 0; i < sliced_searches.size(); ++i){
+        SlicedSearch& search = sliced_searches[i];
+        if (search.request.grid_version != grid_version){
+            search.request.grid_version = grid_version;
+            if (!startSlicedSearch(search, search.request)){
+                vector<glm::vec3> path = search.pathfinder->getPath();
+                finishRequest(search.request, path);
+                idle_pathfinders.push_back(search.pathfinder);
+                sliced_searches.erase(sliced_searches.begin() + i);
+                --i;
+            }
+        }
+    }
+
+    do {
+        // Fill the free search slots from the queue
+        while (sliced_searches.size() < MAX_SLICED_SEARCHES && !requests.empty()){
+            Request request = requests.front();
+            requests.pop_front();
+            request.grid_version = grid_version;
+
+            if (request.wants_flow_field){
+                // Not sliced, a field is built in one go
+                buildFlowField(*ground, request);
+                continue;
+            }
+
+            SlicedSearch search;
+            if (startSlicedSearch(search, request)){
+                sliced_searches.push_back(search);
+            } else {
+                vector<glm::vec3> path = search.pathfinder->getPath();
+                finishRequest(request, path);
+                idle_pathfinders.push_back(search.pathfinder);
+            }
+        }
+
+        if (sliced_searches.empty()){
+            break;
+        }
+
+        // Round robin, so a long search can't hold up the short ones
+        next_slice %= sliced_searches.size();
+        SlicedSearch& search = sliced_searches[next_slice];
+
+        if (search.pathfinder->continuePath(NODES_PER_SLICE)){
+            vector<glm::vec3> path = search.pathfinder->getPath();
+            finishRequest(search.request, path);
+            idle_pathfinders.push_back(search.pathfinder);
+            sliced_searches.erase(sliced_searches.begin() + next_slice);
+        } else {
+            next_slice++;
+        }
+    } while (std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count() < slice_budget_ms);
+}
+
+bool PathRequestService::startSlicedSearch(SlicedSearch& search, Request& request){
+    search.request = request;
+
+    if (!search.pathfinder){
+        if (idle_pathfinders.empty()){
+            // Plain A*, since a node budget only bounds the time when every
+            // node costs about the same. A jump point can scan half the map.
+            search.pathfinder = make_shared<PathFinder>(*ground, PathFinder::Mode::ASTAR);
+        } else {
+            search.pathfinder = idle_pathfinders.back();
+            idle_pathfinders.pop_back();
+        }
+    }
+
+    return search.pathfinder->startPath(request.start_x, request.start_z, request.target_x, request.target_z, request.radius);
+}
+
+void PathRequestService::finishRequest(Request& request, vector<glm::vec3>& path){
+    std::lock_guard<std::mutex> lock(result_mutex);
+    PathResult& result = results[request.ticket];
+    result.request = request;
+    result.path.swap(path);
+    result.from_cache = false;
+}
+
+void PathRequestService::buildFlowField(PathingGrid& grid, Request& request){
+    int clearance = PathingGrid::getClearanceClass(request.radius);
+    shared_ptr<FlowField> field = make_shared<FlowField>(grid, request.target_x, request.target_z, clearance);
+
+    std::lock_guard<std::mutex> lock(result_mutex);
+    flow_field_results[request.ticket] = field;
+}
+
+void PathRequestService::publishSnapshot(int min_x, int min_z, int max_x, int max_z){
+    // Runs on the thread that edited the grid. Time sliced searches read the
+    // live grid, so they only need the version to move on. Workers get a
+    // copy of the area, taken now, so later edits can't change it under them.
+    shared_ptr<PathingGrid::Area> area;
+    if (!time_sliced){
+        area = make_shared<PathingGrid::Area>();
+        ground->saveArea(min_x, min_z, max_x, max_z, *area);
+    }
+
+    std::lock_guard<std::mutex> lock(snapshot_mutex);
+    if (area){
+        changed_areas.push_back(area);
+    } else {
+        first_changed_area++;
+    }
+}
+
+void PathRequestService::takeChanges(int worker, vector<shared_ptr<const PathingGrid::Area>>& changes){
+    std::lock_guard<std::mutex> lock(snapshot_mutex);
+
+    int version = worker_versions[worker];
+    changes.insert(changes.end(), changed_areas.begin() + (version - first_changed_area), changed_areas.end());
+    worker_versions[worker] = first_changed_area + changed_areas.size();
+
+    // Let go of the areas every worker has copied
+    int oldest = *std::min_element(worker_versions.begin(), worker_versions.end());
+    while (first_changed_area < oldest){
+        changed_areas.pop_front();
+        first_changed_area++;
+    }
+}
+
+int PathRequestService::getGridVersion(){
+    std::lock_guard<std::mutex> lock(snapshot_mutex);
+    return first_changed_area + changed_areas.size();
+}
+
+shared_ptr<const PathingGrid> PathRequestService::makeSnapshot(PathingGrid& ground){
+    // Built from an empty grid rather than copied, so the snapshot doesn't
+    // inherit the live grid's change callbacks.
+    shared_ptr<PathingGrid> copy = make_shared<PathingGrid>(ground.getWidth(), ground.getDepth(), ground.getStartX(), ground.getStartZ());
+    copy->copyArea(ground, ground.getStartX(), ground.getStartZ(),
+        ground.getStartX() + ground.getWidth() - 1, ground.getStartZ() + ground.getDepth() - 1);
+    return copy;
+}
@@ -0,0 +1,155 @@
+#ifndef PathRequestService_h
+#define PathRequestService_h
+
+#include "includes/glm.hpp"
+
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#include "pathing_grid.hpp"
+#include "pathfinder.hpp"
+#include "navigation_mesh.hpp"
+#include "flow_field.hpp"
+#include "path_cache.hpp"
+
+using namespace std;
+
+// Finds paths on worker threads so the frame never waits on a search. Each
+// request returns a ticket, and the path is collected with takeResult once a
+// worker is done with it. Paths found in the cache are ready straight away.
+//
+// Workers never read the live PathingGrid. They start from a copy of it
+// taken when the service starts, and every edit to it publishes an
+// immutable copy of just the area it changed, which each worker puts into
+// its own grid before its next search. Workers search the grid's navigation meshes,
+// which start out as copies of the live grid's (loaded with the map).
+//
+// With no workers at all the searches run on the calling thread instead, a
+// slice at a time from update, so a frame never spends more than the budget
+// on them. Partial paths can be peeked at while a search is unfinished.
+class PathRequestService {
+public:
+    // AUTO_WORKERS picks one less than the number of cores, and 0 workers
+    // searches time sliced within slice_budget_ms per update
+    PathRequestService(PathingGrid& ground, int worker_count = AUTO_WORKERS, float slice_budget_ms = 2.0f);
+    ~PathRequestService();
+
+    // Runs time sliced searches until this frame's budget is spent. Does
+    // nothing when there are workers.
+    void update();
+
+    // Waits until every request made so far has its result. Replays use it
+    // so units get their paths on the same step however long searches take.
+    void finishAll();
+
+    int requestPath(float start_x, float start_z, float target_x, float target_z, float radius);
+    bool takeResult(int ticket, vector<glm::vec3>& path);
+
+    // Same as a path, but for a whole flow field towards the target
+    int requestFlowField(float target_x, float target_z, float radius);
+    bool takeFlowField(int ticket, shared_ptr<FlowField>& field);
+
+    // The best path so far for a time sliced search that is still running.
+    // False if the search hasn't started, or isn't time sliced.
+    bool getPartialPath(int ticket, vector<glm::vec3>& path);
+
+    int getWorkerCount() {return workers.size();}
+    bool isTimeSliced() {return time_sliced;}
+    PathCache& getPathCache() {return path_cache;}
+
+    static const int AUTO_WORKERS = -1;
+
+    // Nodes a time sliced search expands before the next one gets a turn
+    static const int NODES_PER_SLICE = 256;
+
+    // Searches running side by side when time sliced, each with its own
+    // search arrays. Later requests wait for one of them to finish.
+    static const int MAX_SLICED_SEARCHES = 4;
+
+private:
+    struct Request {
+        int ticket;
+        float start_x;
+        float start_z;
+        float target_x;
+        float target_z;
+        float radius;
+        bool wants_flow_field;
+
+        // How many grid edits had been published when this was asked for.
+        // Results from before an edit are not cached.
+        int grid_version;
+    };
+
+    struct PathResult {
+        Request request;
+        vector<glm::vec3> path;
+        bool from_cache;
+    };
+
+    struct SlicedSearch {
+        Request request;
+        shared_ptr<PathFinder> pathfinder;
+    };
+
+    int pushRequest(Request& request);
+    void workerLoop(int worker);
+    bool startSlicedSearch(SlicedSearch& search, Request& request);
+    void finishRequest(Request& request, vector<glm::vec3>& path);
+    void buildFlowField(PathingGrid& grid, Request& request);
+    void publishSnapshot(int min_x, int min_z, int max_x, int max_z);
+    void takeChanges(int worker, vector<shared_ptr<const PathingGrid::Area>>& changes);
+    int getGridVersion();
+
+    static shared_ptr<const PathingGrid> makeSnapshot(PathingGrid& ground);
+
+    PathingGrid* ground;
+    int change_callback_id;
+
+    vector<std::thread> workers;
+    bool shutting_down;
+    bool time_sliced;
+    int next_ticket;
+
+    // Requests waiting for a worker
+    deque<Request> requests;
+    std::mutex request_mutex;
+    std::condition_variable request_available;
+
+    // Workers part way through a request, for finishAll
+    int busy_workers;
+    std::condition_variable requests_finished;
+
+    // Finished paths, by ticket
+    map<int, PathResult> results;
+    map<int, shared_ptr<FlowField>> flow_field_results;
+    std::mutex result_mutex;
+
+    // The grid as it was when the service started, until every worker has
+    // its own copy, then each area changed since. The version counts every
+    // change ever published. A worker at version v still has to copy the
+    // areas from v on, and areas every worker is past are let go.
+    shared_ptr<const PathingGrid> snapshot;
+    int workers_started;
+    deque<shared_ptr<const PathingGrid::Area>> changed_areas;
+    int first_changed_area;
+    vector<int> worker_versions;
+    std::mutex snapshot_mutex;
+
+    // Time sliced searches on the live grid, taken in turns
+    float slice_budget_ms;
+    vector<SlicedSearch> sliced_searches;
+    vector<shared_ptr<PathFinder>> idle_pathfinders;
+    int next_slice;
+
+    // Only touched from the thread making requests
+    PathCache path_cache;
+};
+
+#endif
@@ -3,288 +3,434 @@
 
 #include "pathfinder.hpp"
 
-PathFinder::PathFinder(Terrain& ground) : ground(&ground) {
-	allocateArray(ground);
+const int PathFinder::NO_PARENT;
+
+// The eight neighbours of a cell and the cost of stepping to each one
+static const int NEIGHBOR_X[8] = { 1, 1, 1, 0, 0, -1, -1, -1 };
+static const int NEIGHBOR_Y[8] = { -1, 0, 1, -1, 1, -1, 0, 1 };
+static const float NEIGHBOR_COST[8] = { 1.4f, 1.0f, 1.4f, 1.0f, 1.0f, 1.4f, 1.0f, 1.4f };
+
+PathFinder::PathFinder(PathingGrid& ground, PathFinder::Mode mode) : ground(&ground), mode(mode) {
+	width = 0;
+	depth = 0;
+	nodes_expanded = 0;
+	searching = false;
+	allocateArrays();
 }
 
-void PathFinder::allocateArray(Terrain& ground){
-	depth = ground.getDepth();
-	width = ground.getWidth();
-
-	node_state_array = new int*[width];
-    for(int i = 0; i < width; ++i){
-        node_state_array[i] = new int[depth];
-        for(int j = 0; j < depth; ++j){
-        	node_state_array[i][j] = UNVISITED;
-        }
-    }
+void PathFinder::allocateArrays(){
+	depth = ground->getDepth();
+	width = ground->getWidth();
+	x_offset = -ground->getStartX();
+	y_offset = -ground->getStartZ();
+
+	int cell_count = width * depth;
+
+	g_score.assign(cell_count, 0.0f);
+	parent_of.assign(cell_count, NO_PARENT);
+	stamp.assign(cell_count, 0);
+	node_state.assign(cell_count, 0);
+	search_generation = 0;
+
+	frontier_nodes.resize(cell_count);
+}
+
+void PathFinder::beginSearch(){
+	// The terrain can be replaced after we were constructed (the game map
+	// assigns its ground after loading), so make sure the arrays still fit.
+	if(width != ground->getWidth() || depth != ground->getDepth()){
+		allocateArrays();
+	}
+
+	frontier_nodes.clear();
+	nodes_expanded = 0;
+
+	// Bumping the generation invalidates every cell from the last query.
+	// Only when the counter wraps around do the stamps need a real reset.
+	++search_generation;
+	if(search_generation == 0){
+		std::fill(stamp.begin(), stamp.end(), 0);
+		search_generation = 1;
+	}
+}
+
+bool PathFinder::isStamped(int index){
+	return stamp[index] == search_generation;
 }
 
 std::vector<glm::vec3> PathFinder::find_path(float start_x, float start_y, float target_x, float target_y, float radius){
+	return find_path(start_x, start_y, target_x, target_y, radius, mode);
+}
+
+std::vector<glm::vec3> PathFinder::find_path(float start_x, float start_y, float target_x, float target_y, float radius, PathFinder::Mode search_mode){
+	if(startPath(start_x, start_y, target_x, target_y, radius, search_mode)){
+		continuePath(0);
+	}
+
+	// Done with it, so hand the path over rather than copying it
+	std::vector<glm::vec3> path;
+	path.swap(found_path);
+	return path;
+}
+
+bool PathFinder::startPath(float start_x, float start_y, float target_x, float target_y, float radius){
+	return startPath(start_x, start_y, target_x, target_y, radius, mode);
+}
+
+bool PathFinder::startPath(float start_x, float start_y, float target_x, float target_y, float radius, PathFinder::Mode search_mode){
+	searching = false;
+	found_path.clear();
+	nodes_expanded = 0;
+
+	// Units fit anywhere the clearance is at least their radius
+	int clearance = PathingGrid::getClearanceClass(radius);
+
+	// A target in another region can't be reached, and searching for it would
+	// flood everything we can reach before giving up. Head for the closest
+	// cell that can be reached instead.
+	if(!ground->findReachableTarget(start_x, start_y, target_x, target_y, clearance)){
+		// Never searched for, the straight line is as good as it gets
+		found_path.push_back(glm::vec3(target_x, 0.0f, target_y));
+		return false;
+	}
+
 	// No A* search if there is a straight line from start to target
-	if( canPathOnLine(ground, start_x, start_y, target_x, target_y, radius) ){
-		std::vector<glm::vec3> temp;
-		temp.push_back(glm::vec3(target_x, 0.0f, target_y));
-		return temp;
+	if( ground->canPathOnLine(start_x, start_y, target_x, target_y, clearance) ){
+		found_path.push_back(glm::vec3(target_x, 0.0f, target_y));
+		return false;
 	}
 
-	int start_x_int = int(start_x);
-	int start_y_int = int(start_y);
-	int target_x_int = int(target_x);
-	int target_y_int = int(target_y);
+	if(search_mode == PathFinder::Mode::NAVIGATION_MESH){
+		if(ground->findNavigationMeshPath(start_x, start_y, target_x, target_y, clearance, found_path)){
+			return false;
+		}
 
-	int x_offset = width/2;
-	int y_offset = depth/2;
+		// Cells the mesh doesn't link up, like a squeeze between two
+		// diagonal corners, still need searching cell by cell
+		found_path.clear();
+		search_mode = PathFinder::Mode::JUMP_POINT;
+	}
 
-	std::vector<Node*> visited_nodes;											    // The set of nodes already evaluated.
+	beginSearch();
+
+	search_mode_in_use = search_mode;
+	search_clearance = clearance;
+	search_target_x = int(target_x) + x_offset;
+	search_target_y = int(target_y) + y_offset;
+
+	int start_index_x = int(start_x) + x_offset;
+	int start_index_y = int(start_y) + y_offset;
+
+	if(! isInside(start_index_x, start_index_y)){
+		return false;
+	}
+
+	int start_index = start_index_x + start_index_y * width;
+
+	// A target off the map can never be reached, head for the closest node
+	search_target_index = -1;
+	if(isInside(search_target_x, search_target_y)){
+		search_target_index = search_target_x + search_target_y * width;
+	}
 
-	std::priority_queue<Node*, std::vector<Node*>, LessThanByGScore> frontier_nodes;// The set of tentative nodes to be evaluated...
+	stamp[start_index] = search_generation;
+	g_score[start_index] = 0.0f;
+	parent_of[start_index] = NO_PARENT;
+	node_state[start_index] = IN_FRONTIER;
+	frontier_nodes.push(start_index, heuristic_estimate(start_index_x, start_index_y, search_target_x, search_target_y));
 
-	Node *start_node = new Node(start_x_int, start_y_int, 0.0f);					// ...initially containing the start node
-	frontier_nodes.push(start_node);												// Cost from start along best known path (included)
+	// Closest node is where we go if the target can't be reached
+	closest_node = start_index;
+	closest_node_distance = 99999.0f;
 
-	std::unordered_map<Node*, Node*> parent_of;										// The map of navigated nodes.
+	searching = true;
+	return true;
+}
 
-	int count = 0;
-	int index_x, index_y;
-	float temp_g_score;
-	float distance_to_goal;
-	bool can_move_to;
-	bool is_not_visited;
-	bool is_not_in_frontier;
-	int node_state;
+bool PathFinder::continuePath(int max_nodes){
+	if(! searching){
+		return true;
+	}
 
-	// Closest node is buggy
-	Node* closest_node;
-	float closest_node_distance = 99999.0f;
+	int budget_end = nodes_expanded + max_nodes;
 
 	while(! frontier_nodes.empty()){
-		count ++;
-		Node* current_node = frontier_nodes.top();
-
-        if(current_node->x == target_x_int && current_node->y == target_y_int){
-        	// Clear out the old visited nodes
-        	while(! frontier_nodes.empty()){
-        		node_state_array[frontier_nodes.top()->x + x_offset][frontier_nodes.top()->y + y_offset] = UNVISITED;
-        		frontier_nodes.pop();
-        	}
-        	for(int i = 0; i < visited_nodes.size(); ++i){
-        		node_state_array[visited_nodes[i]->x + x_offset][visited_nodes[i]->y + y_offset] = UNVISITED;
-        	}
-        	return reconstruct_path(ground, parent_of, current_node, radius);
-        }
-
-		distance_to_goal = distance_between(current_node->x, current_node->y, target_x, target_y);
-        if(distance_to_goal < closest_node_distance){
-        	closest_node_distance = distance_to_goal;
-        	closest_node = current_node;
-        }
-
-        frontier_nodes.pop();
-
-        visited_nodes.push_back(current_node);
-        node_state_array[current_node->x + x_offset][current_node->y + y_offset] = VISITED;
-
-        std::vector<Node*> neighbor_nodes = getNeighborNodes(current_node);
-
-        for(int i = 0; i < neighbor_nodes.size(); ++i){
-
-        	Node* n = neighbor_nodes[i];
-        	index_x = n->x + x_offset;
-        	index_y = n->y + y_offset;
-
-        	temp_g_score = current_node->g + distance_between(current_node->x, current_node->y, n->x, n->y);
-
-        	can_move_to = checkCircle(ground, n->x, n->y, radius);
-
-        	is_not_visited = false;
-        	is_not_in_frontier = false;
-
-        	if(index_y > 0 && index_y < depth && index_x > 0 && index_x < width){
-        		node_state = node_state_array[n->x + x_offset][n->y + y_offset];
-        		is_not_visited = node_state == UNVISITED;
-        		is_not_in_frontier = node_state != IN_FRONTIER;
-        	}
-
-        	if(is_not_visited && can_move_to && (is_not_in_frontier || temp_g_score < n->g)){
-        		parent_of[n] = current_node;
-        		n->g = temp_g_score;
-
-        		if(is_not_in_frontier){
-        			frontier_nodes.push(n);
-    				node_state_array[n->x + x_offset][n->y + y_offset] = IN_FRONTIER;
-        		}
-        	}
-        }
- 	}
-
- 	// Clear out the old visited nodes
-	for(int i = 0; i < visited_nodes.size(); ++i){
-		node_state_array[visited_nodes[i]->x + x_offset][visited_nodes[i]->y + y_offset] = 0;
+		if(max_nodes > 0 && nodes_expanded >= budget_end){
+			return false;
+		}
+
+		int current = frontier_nodes.pop();
+		node_state[current] = VISITED;
+		nodes_expanded++;
+
+		if(current == search_target_index){
+			finishSearch(current);
+			return true;
+		}
+
+		float distance_to_goal = distance_between(current % width, current / width, search_target_x, search_target_y);
+		if(distance_to_goal < closest_node_distance){
+			closest_node_distance = distance_to_goal;
+			closest_node = current;
+		}
+
+		if(search_mode_in_use == PathFinder::Mode::JUMP_POINT){
+			expandJumpPoints(current);
+		} else {
+			expandNeighbors(current);
+		}
 	}
-	return reconstruct_path(ground, parent_of, closest_node, radius);
+
+	finishSearch(closest_node);
+	return true;
 }
 
-float PathFinder::distance_between(int current_x, int current_y, int target_x, int target_y){
-	int x_delta = abs(current_x - target_x);
-	int y_delta = abs(current_y - target_y);
+vector<glm::vec3> PathFinder::getPath(){
+	if(searching){
+		// Not done yet, so the best we have is the way to whatever node
+		// has come closest to the target so far
+		return reconstruct_path(ground, closest_node, search_clearance);
+	}
 
-	return sqrt(float(x_delta*x_delta + y_delta*y_delta));
+	return found_path;
 }
 
+void PathFinder::finishSearch(int node){
+	found_path = reconstruct_path(ground, node, search_clearance);
+	searching = false;
+}
 
-float PathFinder::heuristic_estimate(int a, int b, int c, int d){
-	// Heuristic function
-	return distance_between(a, b, c, d);
+void PathFinder::setMode(PathFinder::Mode mode){
+	this->mode = mode;
 }
 
-std::vector<glm::vec3> PathFinder::reconstruct_path(Terrain *ground, std::unordered_map<Node*, Node*> parent_of, Node* origin, float radius){
+void PathFinder::expandNeighbors(int current){
+	int current_x = current % width;
+	int current_y = current / width;
 
-	std::vector<Node*> temp;
-	std::vector<glm::vec3> final;
+	for(int i = 0; i < 8; ++i){
+		int index_x = current_x + NEIGHBOR_X[i];
+		int index_y = current_y + NEIGHBOR_Y[i];
+
+		if(! isInside(index_x, index_y)){
+			continue;
+		}
+
+		int n = index_x + index_y * width;
+
+		if(isStamped(n) && node_state[n] != IN_FRONTIER){
+			// Already expanded, or already known to be blocked
+			continue;
+		}
+
+		if(! isStamped(n) && ! isWalkable(index_x, index_y)){
+			stamp[n] = search_generation;
+			node_state[n] = UNPATHABLE;
+			continue;
+		}
 
-	if(! origin){
-		return final;
+		relaxNode(current, n, NEIGHBOR_COST[i]);
 	}
+}
 
-	temp.push_back(origin);
+void PathFinder::expandJumpPoints(int current){
+	// Jump Point Search (Harabor & Grastien). On a uniform-cost grid most
+	// cells only have one sensible way through them, so rather than adding
+	// every neighbour we run along each direction that can't be reached more
+	// cheaply through our parent, and only stop where the path could turn.
+	int x = current % width;
+	int y = current / width;
+
+	if(parent_of[current] == NO_PARENT){
+		for(int i = 0; i < 8; ++i){
+			addJumpPoint(current, NEIGHBOR_X[i], NEIGHBOR_Y[i]);
+		}
+		return;
+	}
 
-	while(parent_of[origin]){
-		origin = parent_of[origin];
-		temp.push_back(origin);
+	int parent = parent_of[current];
+	int dx = sign(x - (parent % width));
+	int dy = sign(y - (parent / width));
+
+	if(dx != 0 && dy != 0){
+		addJumpPoint(current, 0, dy);
+		addJumpPoint(current, dx, 0);
+		addJumpPoint(current, dx, dy);
+
+		// Forced neighbours around the corners we came past
+		if(! isWalkable(x - dx, y)){
+			addJumpPoint(current, -dx, dy);
+		}
+		if(! isWalkable(x, y - dy)){
+			addJumpPoint(current, dx, -dy);
+		}
+	} else if(dx != 0){
+		addJumpPoint(current, dx, 0);
+
+		if(! isWalkable(x, y + 1)){
+			addJumpPoint(current, dx, 1);
+		}
+		if(! isWalkable(x, y - 1)){
+			addJumpPoint(current, dx, -1);
+		}
+	} else {
+		addJumpPoint(current, 0, dy);
+
+		if(! isWalkable(x + 1, y)){
+			addJumpPoint(current, 1, dy);
+		}
+		if(! isWalkable(x - 1, y)){
+			addJumpPoint(current, -1, dy);
+		}
 	}
+}
 
-	Node* anchor = temp[0];
-	Node* current = 0;
-	Node* previous = 0;
+void PathFinder::addJumpPoint(int current, int dx, int dy){
+	int jump_point = jump(current % width, current / width, dx, dy);
 
-	for(int i = 0; i < temp.size(); ++i){
-		// Get the current node
-		current = temp[i];
+	if(jump_point == NO_PARENT){
+		return;
+	}
 
-		// see if we can path between the anchor and the current
-		bool line_between = (i == 0) || (canPathOnLine(ground, anchor->x, anchor->y, current->x, current->y, radius));
+	if(isStamped(jump_point) && node_state[jump_point] != IN_FRONTIER){
+		return;
+	}
+
+	int x_delta = abs((jump_point % width) - (current % width));
+	int y_delta = abs((jump_point / width) - (current / width));
 
-		if(line_between){
-			previous = current;
+	relaxNode(current, jump_point, octile_distance(x_delta, y_delta));
+}
+
+int PathFinder::jump(int x, int y, int dx, int dy){
+	// Walks from (x, y) in direction (dx, dy) until it hits something that
+	// makes the cell interesting: the target, or a forced neighbour.
+	while(true){
+		x += dx;
+		y += dy;
+
+		if(! isWalkable(x, y)){
+			return NO_PARENT;
+		}
+
+		if(x == search_target_x && y == search_target_y){
+			return x + y * width;
+		}
+
+		if(dx != 0 && dy != 0){
+			if((isWalkable(x - dx, y + dy) && ! isWalkable(x - dx, y)) ||
+			   (isWalkable(x + dx, y - dy) && ! isWalkable(x, y - dy))){
+				return x + y * width;
+			}
+
+			// A diagonal step is a jump point if either of its straight
+			// components leads somewhere interesting.
+			if(jump(x, y, dx, 0) != NO_PARENT || jump(x, y, 0, dy) != NO_PARENT){
+				return x + y * width;
+			}
+		} else if(dx != 0){
+			if((isWalkable(x + dx, y + 1) && ! isWalkable(x, y + 1)) ||
+			   (isWalkable(x + dx, y - 1) && ! isWalkable(x, y - 1))){
+				return x + y * width;
+			}
 		} else {
-			final.insert(final.begin(), glm::vec3(previous->x, 0.0f, previous->y));
-			anchor = previous;
-			previous = current;
+			if((isWalkable(x + 1, y + dy) && ! isWalkable(x + 1, y)) ||
+			   (isWalkable(x - 1, y + dy) && ! isWalkable(x - 1, y))){
+				return x + y * width;
+			}
 		}
 	}
+}
 
-	return final;
+void PathFinder::relaxNode(int current, int n, float step_cost){
+	float temp_g_score = g_score[current] + step_cost;
+	float f_score = temp_g_score + heuristic_estimate(n % width, n / width, search_target_x, search_target_y);
+
+	if(! isStamped(n)){
+		stamp[n] = search_generation;
+		g_score[n] = temp_g_score;
+		parent_of[n] = current;
+		node_state[n] = IN_FRONTIER;
+		frontier_nodes.push(n, f_score);
+	} else if(temp_g_score < g_score[n]){
+		g_score[n] = temp_g_score;
+		parent_of[n] = current;
+		frontier_nodes.decreaseKey(n, f_score);
+	}
 }
 
-std::vector<Node*> PathFinder::getNeighborNodes(Node *current_node){
-	std::vector<Node*> temp;
-	// could do up/down/right/left only
-	temp.push_back(new Node(current_node->x + 1, current_node->y - 1, current_node->g + 1.4f));
-	temp.push_back(new Node(current_node->x + 1, current_node->y + 0, current_node->g + 1.0f));
-	temp.push_back(new Node(current_node->x + 1, current_node->y + 1, current_node->g + 1.4f));
-	temp.push_back(new Node(current_node->x + 0, current_node->y - 1, current_node->g + 1.0f));
-	temp.push_back(new Node(current_node->x + 0, current_node->y + 1, current_node->g + 1.0f));
-	temp.push_back(new Node(current_node->x - 1, current_node->y - 1, current_node->g + 1.4f));
-	temp.push_back(new Node(current_node->x - 1, current_node->y + 0, current_node->g + 1.0f));
-	temp.push_back(new Node(current_node->x - 1, current_node->y + 1, current_node->g + 1.4f));
-	return temp;
+bool PathFinder::isInside(int index_x, int index_y){
+	return index_x >= 0 && index_x < width && index_y >= 0 && index_y < depth;
 }
 
-bool PathFinder::canPathOnLine(Terrain* ground, float x1, float y1, float x2, float y2, float radius){
+bool PathFinder::isWalkable(int index_x, int index_y){
+	return isInside(index_x, index_y) && ground->canPath(index_x - x_offset, index_y - y_offset, search_clearance);
+}
 
- 	// http://rosettacode.org/wiki/Bitmap/Bresenham%27s_line_algorithm#C.2B.2B
-	// Bresenham's line algorithm
+int PathFinder::sign(int value){
+	return (value > 0) - (value < 0);
+}
 
-	const bool steep = (fabs(y2 - y1) > fabs(x2 - x1));
+float PathFinder::distance_between(int current_x, int current_y, int target_x, int target_y){
+	int x_delta = abs(current_x - target_x);
+	int y_delta = abs(current_y - target_y);
 
-	if(steep){
-	  std::swap(x1, y1);
-	  std::swap(x2, y2);
-	}
+	return sqrt(float(x_delta*x_delta + y_delta*y_delta));
+}
 
-	if(x1 > x2){
-	  std::swap(x1, x2);
-	  std::swap(y1, y2);
-	}
 
-	const float dx = x2 - x1;
-	const float dy = fabs(y2 - y1);
+float PathFinder::heuristic_estimate(int a, int b, int c, int d){
+	// Heuristic function
+	return octile_distance(abs(a - c), abs(b - d));
+}
 
-	float error = dx / 2.0f;
-	const int ystep = (y1 < y2) ? 1 : -1;
-	int y = (int)y1;
+float PathFinder::octile_distance(int x_delta, int y_delta){
+	// Cost of the cheapest grid walk covering the deltas, using the same
+	// straight and diagonal step costs as the neighbour expansion so it never
+	// overestimates.
+	int straight = std::max(x_delta, y_delta);
+	int diagonal = std::min(x_delta, y_delta);
 
-	const int maxX = int(x2);
+	return float(straight) + (NEIGHBOR_COST[0] - 1.0f) * float(diagonal);
+}
 
-	int x_path, y_path;
+std::vector<glm::vec3> PathFinder::reconstruct_path(PathingGrid *ground, int origin, int clearance){
 
-	for(int x = int(x1); x < maxX; x++){
+	std::vector<glm::vec3> final;
 
-		if(steep){
-		  x_path = y;
-		  y_path = x;
-		} else {
-		  x_path = x;
-		  y_path = y;
-		}
+	path_cells.clear();
+	path_cells.push_back(origin);
 
-		if(checkCircle(ground, x_path, y_path, radius) == false){
-			return false;
-		}
+	while(parent_of[origin] != NO_PARENT){
+		origin = parent_of[origin];
+		path_cells.push_back(origin);
+	}
+
+	int anchor = path_cells[0];
+	int previous = anchor;
+
+	for(int i = 1; i < path_cells.size(); ++i){
+		// Get the current node
+		int current = path_cells[i];
+
+		int anchor_x = (anchor % width) - x_offset;
+		int anchor_y = (anchor / width) - y_offset;
+		int current_x = (current % width) - x_offset;
+		int current_y = (current / width) - y_offset;
 
-		error -= dy;
-		if(error < 0) {
-		  y += ystep;
-		  error += dx;
+		// see if we can path between the anchor and the current
+		bool line_between = ground->canPathOnLine(anchor_x, anchor_y, current_x, current_y, clearance);
+
+		if(! line_between){
+			final.push_back(glm::vec3((previous % width) - x_offset, 0.0f, (previous / width) - y_offset));
+			anchor = previous;
 		}
+
+		previous = current;
 	}
 
-	return true;
-}
+	// The chain was walked from the goal back to the start
+	std::reverse(final.begin(), final.end());
 
-bool PathFinder::checkCircle(Terrain* ground, int x0, int y0, int radius){
-	// http://rosettacode.org/wiki/Bitmap/Midpoint_circle_algorithm#C
-	// Circle drawing algorithm
-
-  	int f = 1 - radius;
-    int ddF_x = 0;
-    int ddF_y = -2 * radius;
-    int x = 0;
-    int y = radius;
-
-    bool radius_path = true;
-
-    radius_path &= ground->canPath(x0, y0 + radius);
-    radius_path &= ground->canPath(x0, y0 - radius);
-    radius_path &= ground->canPath(x0 + radius, y0);
-    radius_path &= ground->canPath(x0 - radius, y0);
-
-    while(x < y)
-    {
-        if(f >= 0)
-        {
-            y--;
-            ddF_y += 2;
-            f += ddF_y;
-        }
-        x++;
-        ddF_x += 2;
-        f += ddF_x + 1;
-
-        radius_path &= ground->canPath(x0 + x, y0 + y);
-        radius_path &= ground->canPath(x0 - x, y0 + y);
-        radius_path &= ground->canPath(x0 + x, y0 - y);
-        radius_path &= ground->canPath(x0 - x, y0 - y);
-        radius_path &= ground->canPath(x0 + y, y0 + x);
-        radius_path &= ground->canPath(x0 - y, y0 + x);
-        radius_path &= ground->canPath(x0 + y, y0 - x);
-        radius_path &= ground->canPath(x0 - y, y0 - x);
-
-        if(!radius_path){
-        	return false;
-        }
-    }
-
-    return true;
+	return final;
 }
@@ -4,61 +4,106 @@
 #ifndef PathFinder_h
 #define PathFinder_h
 
-#include "includes/gl.hpp"
+#include "includes/glm.hpp"
 
-#include <unordered_map>  // std::unordered_map
-#include <queue>          // std::priority_queue
 #include <vector>         // std::vector
-#include <algorithm>	  // std::swap
+#include <algorithm>	  // std::reverse
 
-#include "terrain.hpp"
+#include "pathing_grid.hpp"
+#include "indexed_heap.hpp"
 
 using namespace std;
 
-class Node{
-public:
-	Node(int x, int y, int g){
-		this->x = x;
-		this->y = y;
-		this->g = g;
-	}
-
-	int x;
-	int y;
-	float g;
-};
-
-struct LessThanByGScore{
-  bool operator()(const Node* lhs, const Node* rhs) const {
-  	// Reverse ordering for lowest
-    return lhs->g > rhs->g;
-  }
-};
-
 class PathFinder {
 public:
-	PathFinder(Terrain&);
+	// ASTAR expands every neighbour, JUMP_POINT skips over the runs of open
+	// cells that a uniform-cost grid is mostly made of. NAVIGATION_MESH
+	// searches the ground's rectangles instead, and only falls back to jump
+	// points when the mesh can't answer.
+	enum class Mode{ ASTAR, JUMP_POINT, NAVIGATION_MESH };
+
+	PathFinder(PathingGrid&, PathFinder::Mode mode = PathFinder::Mode::ASTAR);
 	vector<glm::vec3> find_path(float, float, float, float, float);
-	
+	vector<glm::vec3> find_path(float, float, float, float, float, PathFinder::Mode);
+
+	// The same search, spread over as many calls as it takes. startPath
+	// returns false when there is nothing to search for (the path is already
+	// known), continuePath expands at most max_nodes nodes (0 for no limit)
+	// and returns true once the search is done. Until then getPath gives the
+	// best partial path so far.
+	bool startPath(float, float, float, float, float);
+	bool startPath(float, float, float, float, float, PathFinder::Mode);
+	bool continuePath(int max_nodes);
+	bool isSearching(){ return searching; }
+	vector<glm::vec3> getPath();
+
+	void setMode(PathFinder::Mode mode);
+
+	int getNodesExpanded(){ return nodes_expanded; }
+
 private:
-	void allocateArray(Terrain&);
+	void allocateArrays();
+	void beginSearch();
+	bool isStamped(int);
+	bool isInside(int, int);
+	bool isWalkable(int, int);
+
+	void expandNeighbors(int);
+	void expandJumpPoints(int);
+	void addJumpPoint(int, int, int);
+	int jump(int, int, int, int);
+	void relaxNode(int, int, float);
+	void finishSearch(int);
 
 	float distance_between(int, int, int, int);
 	float heuristic_estimate(int, int, int, int);
-	vector<glm::vec3> reconstruct_path(Terrain*, std::unordered_map<Node*, Node*>, Node*, float);
-	std::vector<Node*> getNeighborNodes(Node*);
-	bool canPathOnLine(Terrain*, float, float, float, float, float);
-	bool checkCircle(Terrain*, int, int, int);
+	float octile_distance(int, int);
+	static int sign(int);
+	vector<glm::vec3> reconstruct_path(PathingGrid*, int, int);
+
+	// Per-cell search state, indexed by x + z*width. A cell only holds valid
+	// data for the current query when its stamp matches search_generation,
+	// which means nothing has to be cleared between queries.
+	vector<float> g_score;
+	vector<int> parent_of;
+	vector<unsigned int> stamp;
+	vector<unsigned char> node_state;
+	unsigned int search_generation;
+
+	IndexedHeap frontier_nodes;
+
+	// Reused between queries for walking the parent chain
+	vector<int> path_cells;
 
-	int **node_state_array;
 	int depth;
 	int width;
+	int x_offset;
+	int y_offset;
+	int nodes_expanded;
+
+	// The query being searched, in grid indices
+	int search_clearance;
+	int search_target_x;
+	int search_target_y;
+	int search_target_index;
+	PathFinder::Mode search_mode_in_use;
+
+	// Where the search has come closest to the target
+	int closest_node;
+	float closest_node_distance;
+
+	bool searching;
+	vector<glm::vec3> found_path;
+
+	PathingGrid* ground;
+
+	PathFinder::Mode mode;
 
-	Terrain* ground;
+	static const unsigned char IN_FRONTIER = 1;
+	static const unsigned char VISITED = 2;
+	static const unsigned char UNPATHABLE = 3;
 
-	const int UNVISITED = 0;
-	const int IN_FRONTIER = 1;
-	const int VISITED = 2;
+	static const int NO_PARENT = -1;
 };
 
 #endif
@@ -0,0 +1,714 @@
+#include "pathing_grid.hpp"
+
+#include <cstring>
+
+#include "debug.hpp"
+
+const int PathingGrid::MAX_CLEARANCE;
+const int PathingGrid::NO_REGION;
+const int PathingGrid::MAX_REDIRECT_DISTANCE;
+
+static const char NAVIGATION_MESH_MAGIC[4] = { 'N', 'A', 'V', '1' };
+
+// Stand-in for infinity in the distance transform. A real infinity would
+// turn the parabola intersections into inf - inf.
+static const float FAR_AWAY = 1e20f;
+
+static inline bool testBit(const vector<uint64_t>& bits, int index){
+    return (bits[index >> 6] >> (index & 63)) & 1;
+}
+
+static inline void assignBit(vector<uint64_t>& bits, int index, bool value){
+    uint64_t mask = uint64_t(1) << (index & 63);
+    if (value){
+        bits[index >> 6] |= mask;
+    } else {
+        bits[index >> 6] &= ~mask;
+    }
+}
+
+PathingGrid::PathingGrid() : row_stride(0), column_stride(0), width(0), depth(0), start_x(0), start_z(0), next_callback_id(0) {
+    line_bits.resize(MAX_CLEARANCE + 1);
+}
+
+PathingGrid::PathingGrid(int width, int depth, int start_x, int start_z) : width(width), depth(depth), start_x(start_x), start_z(start_z), next_callback_id(0) {
+    row_stride = ((width + 63) / 64) * 64;
+    column_stride = ((depth + 63) / 64) * 64;
+
+    pathable.assign((row_stride / 64) * depth, ~uint64_t(0));
+    line_bits.resize(MAX_CLEARANCE + 1);
+    clearance.assign(width * depth, 0);
+}
+
+bool PathingGrid::isInside(int x, int z){
+    x -= start_x;
+    z -= start_z;
+
+    return !(x < 0 || z < 0 || x > width - 1 || z > depth - 1);
+}
+
+bool PathingGrid::canPath(int x, int z){
+    if (!isInside(x, z)){
+        return false;
+    }
+
+    return isPathableIndex(x - start_x, z - start_z);
+}
+
+bool PathingGrid::canPath(int x, int z, int clearance){
+    // A single compare replaces testing every cell under the unit's circle
+    return getClearance(x, z) >= clearance && canPath(x, z);
+}
+
+bool PathingGrid::canPathOnLine(float x1, float z1, float x2, float z2, int clearance){
+
+    // http://rosettacode.org/wiki/Bitmap/Bresenham%27s_line_algorithm#C.2B.2B
+    // Bresenham's line algorithm, a run of cells at a time. Between two
+    // steps across, the line covers a straight run along the long axis,
+    // which is one masked compare per 64 cells in the class's bitset.
+
+    LineBits& bits = getLineBits(clearance);
+
+    const bool steep = (fabs(z2 - z1) > fabs(x2 - x1));
+
+    if (steep){
+        std::swap(x1, z1);
+        std::swap(x2, z2);
+    }
+
+    if (x1 > x2){
+        std::swap(x1, x2);
+        std::swap(z1, z2);
+    }
+
+    const float dx = x2 - x1;
+    const float dz = fabs(z2 - z1);
+
+    float error = dx / 2.0f;
+    const int zstep = (z1 < z2) ? 1 : -1;
+    int z = (int)z1;
+
+    const int max_x = int(x2);
+
+    // The long axis is z for steep lines, so they walk the columns
+    const vector<uint64_t>& lines = steep ? bits.columns : bits.rows;
+    const int stride = steep ? column_stride : row_stride;
+    const int run_limit = steep ? depth : width;
+    const int line_limit = steep ? width : depth;
+
+    int first = int(x1) - (steep ? start_z : start_x);
+    int last = max_x - 1 - (steep ? start_z : start_x);
+    int line = z - (steep ? start_x : start_z);
+
+    if (first > last){
+        return true;
+    }
+
+    // Off the grid counts as blocked
+    if (first < 0 || last >= run_limit || line < 0 || line >= line_limit){
+        return false;
+    }
+
+    // Close to diagonal the runs are a cell or two long, and working out
+    // their length costs more than testing them one bit at a time
+    const bool short_runs = dz * 4.0f > dx;
+
+    int index = line * stride + first;
+    int remaining = last - first + 1;
+
+    while (remaining > 0){
+        // Cells until the error goes negative all share this z
+        int run = 1;
+        if (!short_runs){
+            run = remaining;
+            if (dz > 0.0f){
+                float steps = floor(error / dz) + 1.0f;
+                if (steps < run){
+                    run = int(steps);
+                }
+            }
+        }
+
+        if (run == 1 ? !testBit(lines, index) : !isRunClear(lines, index, index + run - 1)){
+            return false;
+        }
+
+        index += run;
+        remaining -= run;
+
+        error -= dz * run;
+        if (error < 0){
+            line += zstep;
+            if (remaining > 0 && (line < 0 || line >= line_limit)){
+                return false;
+            }
+            index += zstep * stride;
+            error += dx;
+        }
+    }
+
+    return true;
+}
+
+void PathingGrid::setPathable(int x, int z, bool pathable){
+    if (isInside(x, z)){
+        setPathableIndex(x - start_x, z - start_z, pathable);
+        markRegionsDirty(x - start_x, z - start_z, x - start_x, z - start_z);
+        updateAllLineBits(x - start_x, z - start_z, x - start_x, z - start_z);
+    }
+}
+
+void PathingGrid::setAreaPathable(int min_x, int min_z, int max_x, int max_z, bool pathable){
+    // Clamp the area to the grid and switch to grid indices
+    min_x = std::max(min_x - start_x, 0);
+    min_z = std::max(min_z - start_z, 0);
+    max_x = std::min(max_x - start_x, width - 1);
+    max_z = std::min(max_z - start_z, depth - 1);
+
+    if (min_x > max_x || min_z > max_z){
+        return;
+    }
+
+    // Only report what really changed: the edited cells, plus any cell
+    // within MAX_CLEARANCE of them whose clearance moved.
+    int changed_min_x = max_x + 1;
+    int changed_min_z = max_z + 1;
+    int changed_max_x = min_x - 1;
+    int changed_max_z = min_z - 1;
+
+    for (int z = min_z; z <= max_z; ++z){
+        for (int x = min_x; x <= max_x; ++x){
+            if (isPathableIndex(x, z) != pathable){
+                setPathableIndex(x, z, pathable);
+                changed_min_x = std::min(changed_min_x, x);
+                changed_min_z = std::min(changed_min_z, z);
+                changed_max_x = std::max(changed_max_x, x);
+                changed_max_z = std::max(changed_max_z, z);
+            }
+        }
+    }
+
+    if (changed_min_x > changed_max_x){
+        return;
+    }
+
+    int window_min_x = std::max(changed_min_x - MAX_CLEARANCE, 0);
+    int window_min_z = std::max(changed_min_z - MAX_CLEARANCE, 0);
+    int window_max_x = std::min(changed_max_x + MAX_CLEARANCE, width - 1);
+    int window_max_z = std::min(changed_max_z + MAX_CLEARANCE, depth - 1);
+    int window_width = window_max_x - window_min_x + 1;
+
+    vector<unsigned char> old_clearance;
+    for (int z = window_min_z; z <= window_max_z; ++z){
+        old_clearance.insert(old_clearance.end(), clearance.begin() + window_min_x + z * width, clearance.begin() + window_max_x + 1 + z * width);
+    }
+
+    computeClearance(window_min_x, window_min_z, window_max_x, window_max_z);
+
+    for (int z = window_min_z; z <= window_max_z; ++z){
+        for (int x = window_min_x; x <= window_max_x; ++x){
+            if (clearance[x + z * width] != old_clearance[(x - window_min_x) + (z - window_min_z) * window_width]){
+                changed_min_x = std::min(changed_min_x, x);
+                changed_min_z = std::min(changed_min_z, z);
+                changed_max_x = std::max(changed_max_x, x);
+                changed_max_z = std::max(changed_max_z, z);
+            }
+        }
+    }
+
+    markRegionsDirty(changed_min_x, changed_min_z, changed_max_x, changed_max_z);
+    updateAllLineBits(changed_min_x, changed_min_z, changed_max_x, changed_max_z);
+
+    for (auto& callback : change_callbacks){
+        callback.second(changed_min_x + start_x, changed_min_z + start_z, changed_max_x + start_x, changed_max_z + start_z);
+    }
+}
+
+void PathingGrid::copyArea(const PathingGrid& source, int min_x, int min_z, int max_x, int max_z){
+    if (source.width != width || source.depth != depth){
+        return;
+    }
+
+    min_x = std::max(min_x - start_x, 0);
+    min_z = std::max(min_z - start_z, 0);
+    max_x = std::min(max_x - start_x, width - 1);
+    max_z = std::min(max_z - start_z, depth - 1);
+
+    if (min_x > max_x || min_z > max_z){
+        return;
+    }
+
+    for (int z = min_z; z <= max_z; ++z){
+        int row = z * width;
+        for (int x = min_x; x <= max_x; ++x){
+            setPathableIndex(x, z, source.isPathableIndex(x, z));
+        }
+        std::copy(source.clearance.begin() + row + min_x, source.clearance.begin() + row + max_x + 1, clearance.begin() + row + min_x);
+    }
+
+    markRegionsDirty(min_x, min_z, max_x, max_z);
+    updateAllLineBits(min_x, min_z, max_x, max_z);
+
+    // A copy of the whole grid can keep the source's meshes as they are
+    if (min_x == 0 && min_z == 0 && max_x == width - 1 && max_z == depth - 1){
+        navigation_meshes = source.navigation_meshes;
+    }
+
+    for (auto& callback : change_callbacks){
+        callback.second(min_x + start_x, min_z + start_z, max_x + start_x, max_z + start_z);
+    }
+}
+
+void PathingGrid::saveArea(int min_x, int min_z, int max_x, int max_z, Area& area){
+    min_x = std::max(min_x - start_x, 0);
+    min_z = std::max(min_z - start_z, 0);
+    max_x = std::min(max_x - start_x, width - 1);
+    max_z = std::min(max_z - start_z, depth - 1);
+
+    area.min_x = min_x + start_x;
+    area.min_z = min_z + start_z;
+    area.max_x = max_x + start_x;
+    area.max_z = max_z + start_z;
+    area.pathable.clear();
+    area.clearance.clear();
+
+    if (min_x > max_x || min_z > max_z){
+        return;
+    }
+
+    area.pathable.reserve((max_x - min_x + 1) * (max_z - min_z + 1));
+    area.clearance.reserve((max_x - min_x + 1) * (max_z - min_z + 1));
+
+    for (int z = min_z; z <= max_z; ++z){
+        int row = z * width;
+        for (int x = min_x; x <= max_x; ++x){
+            area.pathable.push_back(isPathableIndex(x, z));
+        }
+        area.clearance.insert(area.clearance.end(), clearance.begin() + row + min_x, clearance.begin() + row + max_x + 1);
+    }
+}
+
+void PathingGrid::loadArea(const Area& area){
+    int min_x = area.min_x - start_x;
+    int min_z = area.min_z - start_z;
+    int max_x = area.max_x - start_x;
+    int max_z = area.max_z - start_z;
+
+    if (min_x > max_x || min_z > max_z || min_x < 0 || min_z < 0 || max_x >= width || max_z >= depth){
+        return;
+    }
+
+    int area_width = max_x - min_x + 1;
+    for (int z = min_z; z <= max_z; ++z){
+        int first = (z - min_z) * area_width;
+        for (int x = min_x; x <= max_x; ++x){
+            setPathableIndex(x, z, area.pathable[first + x - min_x]);
+        }
+        std::copy(area.clearance.begin() + first, area.clearance.begin() + first + area_width, clearance.begin() + z * width + min_x);
+    }
+
+    markRegionsDirty(min_x, min_z, max_x, max_z);
+    updateAllLineBits(min_x, min_z, max_x, max_z);
+
+    for (auto& callback : change_callbacks){
+        callback.second(area.min_x, area.min_z, area.max_x, area.max_z);
+    }
+}
+
+int PathingGrid::addChangeCallback(Change_Callback_Type callback){
+    int id = next_callback_id++;
+    change_callbacks[id] = callback;
+    return id;
+}
+
+void PathingGrid::removeChangeCallback(int id){
+    change_callbacks.erase(id);
+}
+
+int PathingGrid::getClearance(int x, int z){
+    if (!isInside(x, z)){
+        return 0;
+    }
+
+    return clearance[getIndex(x, z)];
+}
+
+void PathingGrid::generateClearance(){
+    computeClearance(0, 0, width - 1, depth - 1);
+    regions.clear();
+    navigation_meshes.clear();
+    line_bits.clear();
+    line_bits.resize(MAX_CLEARANCE + 1);
+}
+
+int PathingGrid::getClearanceClass(float radius){
+    // Radii are truncated, the same way the old circle test treated them
+    int clearance_class = int(radius);
+    return std::max(0, std::min(clearance_class, int(MAX_CLEARANCE)));
+}
+
+int PathingGrid::getRegion(int x, int z, int clearance){
+    map<int, ConnectivityRegions>::iterator it = regions.find(clearance);
+
+    if (it == regions.end()){
+        it = regions.insert(std::make_pair(clearance, ConnectivityRegions(width, depth, clearance))).first;
+    }
+
+    return it->second.getRegion(*this, x - start_x, z - start_z);
+}
+
+bool PathingGrid::findNearestInRegion(int& x, int& z, int region, int clearance, int max_distance){
+    // Targets off the map search from the nearest edge
+    int center_x = std::max(start_x, std::min(x, start_x + width - 1));
+    int center_z = std::max(start_z, std::min(z, start_z + depth - 1));
+
+    int best_x = 0;
+    int best_z = 0;
+    int best_distance = -1;
+
+    // Walk square rings outwards. Everything on ring r is at least r away,
+    // so once that is further than the best match we can stop.
+    for (int r = 0; r <= max_distance; ++r){
+        if (best_distance >= 0 && r * r > best_distance){
+            break;
+        }
+
+        for (int dz = -r; dz <= r; ++dz){
+            // Inner rows only have their two end cells on the ring
+            int step = (dz == -r || dz == r) ? 1 : std::max(2 * r, 1);
+
+            for (int dx = -r; dx <= r; dx += step){
+                int distance = dx * dx + dz * dz;
+                if (best_distance >= 0 && distance >= best_distance){
+                    continue;
+                }
+
+                if (getRegion(center_x + dx, center_z + dz, clearance) == region){
+                    best_x = center_x + dx;
+                    best_z = center_z + dz;
+                    best_distance = distance;
+                }
+            }
+        }
+    }
+
+    if (best_distance < 0){
+        return false;
+    }
+
+    x = best_x;
+    z = best_z;
+    return true;
+}
+
+bool PathingGrid::findReachableTarget(float start_x, float start_z, float& target_x, float& target_z, int clearance){
+    int start_region = getRegion(int(start_x), int(start_z), clearance);
+    if (start_region == NO_REGION || getRegion(int(target_x), int(target_z), clearance) == start_region){
+        return true;
+    }
+
+    int reachable_x = int(target_x);
+    int reachable_z = int(target_z);
+    int whole_grid = width + depth;
+
+    if (!findNearestInRegion(reachable_x, reachable_z, start_region, clearance, MAX_REDIRECT_DISTANCE) &&
+        !findNearestInRegion(reachable_x, reachable_z, start_region, clearance, whole_grid)){
+        return false;
+    }
+
+    target_x = reachable_x;
+    target_z = reachable_z;
+    return true;
+}
+
+int PathingGrid::getIndex(int x, int z){
+    return (x - start_x) + ((z - start_z) * width);
+}
+
+bool PathingGrid::isPathableIndex(int index_x, int index_z) const {
+    return testBit(pathable, index_x + index_z * row_stride);
+}
+
+void PathingGrid::setPathableIndex(int index_x, int index_z, bool pathable){
+    assignBit(this->pathable, index_x + index_z * row_stride, pathable);
+}
+
+PathingGrid::LineBits& PathingGrid::getLineBits(int clearance){
+    // Clearance classes are capped, see getClearanceClass
+    clearance = std::max(0, std::min(clearance, int(MAX_CLEARANCE)));
+    LineBits& bits = line_bits[clearance];
+
+    if (bits.rows.empty() && width > 0){
+        bits.rows.assign((row_stride / 64) * depth, 0);
+        bits.columns.assign((column_stride / 64) * width, 0);
+        updateLineBits(bits, clearance, 0, 0, width - 1, depth - 1);
+    }
+
+    return bits;
+}
+
+void PathingGrid::updateLineBits(LineBits& bits, int clearance, int min_x, int min_z, int max_x, int max_z){
+    // Grid indices, like computeClearance
+    for (int z = min_z; z <= max_z; ++z){
+        for (int x = min_x; x <= max_x; ++x){
+            bool clear = this->clearance[x + z * width] >= clearance && isPathableIndex(x, z);
+            assignBit(bits.rows, x + z * row_stride, clear);
+            assignBit(bits.columns, z + x * column_stride, clear);
+        }
+    }
+}
+
+void PathingGrid::updateAllLineBits(int min_x, int min_z, int max_x, int max_z){
+    for (int clearance = 0; clearance < line_bits.size(); ++clearance){
+        if (!line_bits[clearance].rows.empty()){
+            updateLineBits(line_bits[clearance], clearance, min_x, min_z, max_x, max_z);
+        }
+    }
+}
+
+bool PathingGrid::isRunClear(const vector<uint64_t>& bits, int first, int last){
+    // Bits first..last inclusive, all set
+    int first_word = first >> 6;
+    int last_word = last >> 6;
+    uint64_t first_mask = ~uint64_t(0) << (first & 63);
+    uint64_t last_mask = ~uint64_t(0) >> (63 - (last & 63));
+
+    if (first_word == last_word){
+        uint64_t mask = first_mask & last_mask;
+        return (bits[first_word] & mask) == mask;
+    }
+
+    if ((bits[first_word] & first_mask) != first_mask){
+        return false;
+    }
+
+    for (int word = first_word + 1; word < last_word; ++word){
+        if (bits[word] != ~uint64_t(0)){
+            return false;
+        }
+    }
+
+    return (bits[last_word] & last_mask) == last_mask;
+}
+
+void PathingGrid::computeClearance(int min_x, int min_z, int max_x, int max_z){
+    // Recomputes the clearance of the cells in [min, max] (grid indices, not
+    // world positions). The nearest blocked cell that matters is at most
+    // MAX_CLEARANCE + 1 away, so only a margin that size is looked at. Cells
+    // off the edge of the map count as blocked.
+    int margin = MAX_CLEARANCE + 1;
+    int window_min_x = std::max(min_x - margin, -1);
+    int window_min_z = std::max(min_z - margin, -1);
+    int window_max_x = std::min(max_x + margin, width);
+    int window_max_z = std::min(max_z + margin, depth);
+
+    int window_width = window_max_x - window_min_x + 1;
+    int window_depth = window_max_z - window_min_z + 1;
+    int longest = std::max(window_width, window_depth);
+
+    vector<float> squared(window_width * window_depth);
+    vector<float> f(longest);
+    vector<float> d(longest);
+    vector<int> v(longest);
+    vector<float> z(longest + 1);
+
+    for (int j = 0; j < window_depth; ++j){
+        for (int i = 0; i < window_width; ++i){
+            int x = window_min_x + i;
+            int row = window_min_z + j;
+            bool blocked = x < 0 || row < 0 || x >= width || row >= depth || !isPathableIndex(x, row);
+            squared[i + j * window_width] = blocked ? 0.0f : FAR_AWAY;
+        }
+    }
+
+    // Felzenszwalb & Huttenlocher: a 1D squared distance transform down
+    // every column, then along every row, gives the exact 2D result.
+    for (int i = 0; i < window_width; ++i){
+        for (int j = 0; j < window_depth; ++j){
+            f[j] = squared[i + j * window_width];
+        }
+        distanceTransform(&f[0], &d[0], &v[0], &z[0], window_depth);
+        for (int j = 0; j < window_depth; ++j){
+            squared[i + j * window_width] = d[j];
+        }
+    }
+
+    for (int j = 0; j < window_depth; ++j){
+        distanceTransform(&squared[j * window_width], &d[0], &v[0], &z[0], window_width);
+
+        int row = window_min_z + j;
+        if (row < min_z || row > max_z){
+            continue;
+        }
+
+        for (int x = min_x; x <= max_x; ++x){
+            // Largest radius whose disc around this cell is still clear,
+            // i.e. the largest c with c*c < distance squared.
+            // Open stretches leave it near FAR_AWAY, far past what an int
+            // holds, so it's capped before converting
+            float distance = std::min(sqrt(d[x - window_min_x]), float(MAX_CLEARANCE + 1));
+            int cell_clearance = int(ceil(distance)) - 1;
+            cell_clearance = std::max(0, std::min(cell_clearance, int(MAX_CLEARANCE)));
+            clearance[x + row * width] = cell_clearance;
+        }
+    }
+}
+
+void PathingGrid::markRegionsDirty(int min_x, int min_z, int max_x, int max_z){
+    for (auto& class_regions : regions){
+        class_regions.second.markDirty(min_x, min_z, max_x, max_z);
+    }
+
+    // Unlike the regions, a mesh is rebuilt whole
+    navigation_meshes.clear();
+}
+
+bool PathingGrid::findNavigationMeshPath(float start_x, float start_z, float target_x, float target_z, int clearance, vector<glm::vec3>& path){
+    NavigationMesh& mesh = getNavigationMesh(clearance);
+
+    if (!mesh.findPath(start_x - this->start_x, start_z - this->start_z, target_x - this->start_x, target_z - this->start_z, path)){
+        return false;
+    }
+
+    for (glm::vec3& waypoint : path){
+        waypoint.x += this->start_x;
+        waypoint.z += this->start_z;
+    }
+
+    // Corners come as a step through a cell on each side of them, and most
+    // of those steps can be cut. The rest are kept, as long as the line test
+    // agrees with the funnel that they are clear.
+    glm::vec3 anchor(start_x, 0.0f, start_z);
+    int kept = 0;
+
+    for (int i = 0; i < path.size(); ++i){
+        if (i + 1 < path.size() && canPathOnLine(anchor.x, anchor.z, path[i + 1].x, path[i + 1].z, clearance)){
+            continue;
+        }
+
+        if (!canPathOnLine(anchor.x, anchor.z, path[i].x, path[i].z, clearance)){
+            return false;
+        }
+
+        anchor = path[i];
+        path[kept++] = path[i];
+    }
+
+    path.resize(kept);
+    return true;
+}
+
+NavigationMesh& PathingGrid::getNavigationMesh(int clearance){
+    map<int, NavigationMesh>::iterator it = navigation_meshes.find(clearance);
+
+    if (it == navigation_meshes.end()){
+        it = navigation_meshes.insert(std::make_pair(clearance, NavigationMesh())).first;
+        it->second.build(*this, clearance);
+    }
+
+    return it->second;
+}
+
+bool PathingGrid::saveNavigationMeshes(string filename){
+    FILE* file = fopen(filename.c_str(), "wb");
+    if (!file){
+        Debug::error("Could not open %s to save the navigation meshes.\n", filename.c_str());
+        return false;
+    }
+
+    uint64_t hash = getPathingHash();
+    int32_t mesh_count = navigation_meshes.size();
+
+    bool written = fwrite(NAVIGATION_MESH_MAGIC, 4, 1, file) == 1 &&
+        fwrite(&hash, sizeof(hash), 1, file) == 1 &&
+        fwrite(&mesh_count, sizeof(mesh_count), 1, file) == 1;
+
+    for (auto& class_mesh : navigation_meshes){
+        int32_t mesh_clearance = class_mesh.first;
+        written = written && fwrite(&mesh_clearance, sizeof(mesh_clearance), 1, file) == 1 && class_mesh.second.write(file);
+    }
+
+    fclose(file);
+
+    if (!written){
+        Debug::error("Could not write the navigation meshes to %s.\n", filename.c_str());
+    }
+    return written;
+}
+
+bool PathingGrid::loadNavigationMeshes(string filename){
+    FILE* file = fopen(filename.c_str(), "rb");
+    if (!file){
+        // Not saved yet, they get built when they are needed
+        return false;
+    }
+
+    char magic[4];
+    uint64_t hash;
+    int32_t mesh_count;
+
+    bool valid = fread(magic, 4, 1, file) == 1 && memcmp(magic, NAVIGATION_MESH_MAGIC, 4) == 0 &&
+        fread(&hash, sizeof(hash), 1, file) == 1 && hash == getPathingHash() &&
+        fread(&mesh_count, sizeof(mesh_count), 1, file) == 1;
+
+    map<int, NavigationMesh> loaded;
+    for (int i = 0; valid && i < mesh_count; ++i){
+        int32_t mesh_clearance;
+        valid = fread(&mesh_clearance, sizeof(mesh_clearance), 1, file) == 1 && loaded[mesh_clearance].read(file);
+        valid = valid && loaded[mesh_clearance].getWidth() == width && loaded[mesh_clearance].getDepth() == depth;
+    }
+
+    fclose(file);
+
+    if (!valid){
+        Debug::warning("Navigation meshes in %s don't match the map, they will be rebuilt.\n", filename.c_str());
+        return false;
+    }
+
+    navigation_meshes.swap(loaded);
+    return true;
+}
+
+uint64_t PathingGrid::getPathingHash(){
+    // FNV-1a, a word at a time, over the size and the pathing bits. Clearance follows from
+    // the pathing, so it doesn't need hashing as well.
+    uint64_t hash = 14695981039346656037ULL;
+    uint64_t values[2] = { uint64_t(width), uint64_t(depth) };
+
+    for (uint64_t value : values){
+        hash = (hash ^ value) * 1099511628211ULL;
+    }
+    for (uint64_t word : pathable){
+        hash = (hash ^ word) * 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+void PathingGrid::distanceTransform(const float* f, float* d, int* v, float* z, int n){
+    // Lower envelope of the parabolas rooted at each f[q]
+    int k = 0;
+    v[0] = 0;
+    z[0] = -FAR_AWAY;
+    z[1] = FAR_AWAY;
+
+    for (int q = 1; q < n; ++q){
+        float s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2 * q - 2 * v[k]);
+        while (s <= z[k]){
+            --k;
+            s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2 * q - 2 * v[k]);
+        }
+        ++k;
+        v[k] = q;
+        z[k] = s;
+        z[k + 1] = FAR_AWAY;
+    }
+
+    k = 0;
+    for (int q = 0; q < n; ++q){
+        while (z[k + 1] < q){
+            ++k;
+        }
+        d[q] = (q - v[k]) * (q - v[k]) + f[v[k]];
+    }
+}
@@ -0,0 +1,171 @@
+#ifndef PathingGrid_h
+#define PathingGrid_h
+
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "connectivity_regions.hpp"
+#include "navigation_mesh.hpp"
+
+using namespace std;
+
+// Which terrain cells a unit may stand on, plus a clearance map: for every
+// cell, how far it is to the nearest cell that can't be pathed. Positions
+// are in world coordinates, the grid starts at (start_x, start_z).
+//
+// Pathing is stored a bit per cell. Line tests use a bitset per clearance
+// class, so a straight stretch of a line is checked 64 cells at a time.
+class PathingGrid {
+public:
+    // Called with the world-space area (min_x, min_z, max_x, max_z) whose
+    // pathing or clearance changed.
+    typedef std::function<void(int, int, int, int)> Change_Callback_Type;
+
+    PathingGrid();
+    PathingGrid(int width, int depth, int start_x, int start_z);
+
+    int getWidth() const {return width;}
+    int getDepth() const {return depth;}
+    int getStartX() const {return start_x;}
+    int getStartZ() const {return start_z;}
+
+    bool isInside(int x, int z);
+
+    bool canPath(int x, int z);
+    bool canPath(int x, int z, int clearance);
+
+    bool canPathOnLine(float x1, float z1, float x2, float z2, int clearance);
+
+    // Edits after generation go through here, so clearance, regions and
+    // everything listening for changes hear about them
+    void setAreaPathable(int min_x, int min_z, int max_x, int max_z, bool pathable);
+
+    // Copies pathing and clearance for an area from a grid of the same size,
+    // then notifies the change callbacks as if it had been edited.
+    void copyArea(const PathingGrid& source, int min_x, int min_z, int max_x, int max_z);
+
+    // Pathing and clearance for an area, in world coordinates clamped to the
+    // grid, a row at a time. Lets another grid of the same size catch up
+    // with an edit without the whole grid being copied.
+    struct Area {
+        int min_x;
+        int min_z;
+        int max_x;
+        int max_z;
+        vector<bool> pathable;
+        vector<unsigned char> clearance;
+    };
+
+    void saveArea(int min_x, int min_z, int max_x, int max_z, Area& area);
+
+    // Same as copyArea, from a saved area
+    void loadArea(const Area& area);
+
+    int addChangeCallback(Change_Callback_Type callback);
+    void removeChangeCallback(int id);
+
+    int getClearance(int x, int z);
+    void generateClearance();
+
+    static int getClearanceClass(float radius);
+
+    // Connected area the cell belongs to for units of this clearance class,
+    // or NO_REGION if they can't stand there. Cells in different regions
+    // can't reach each other.
+    int getRegion(int x, int z, int clearance);
+
+    // Moves (x, z) to the closest cell of the region, looking at most
+    // max_distance cells away. Returns false if there is none that close.
+    bool findNearestInRegion(int& x, int& z, int region, int clearance, int max_distance);
+
+    // Moves a target in another region than the start to the closest cell
+    // that can be reached from it. Past MAX_REDIRECT_DISTANCE the whole grid
+    // is looked over. Returns false if nothing can be reached. A start units
+    // can't stand on leaves the target alone.
+    bool findReachableTarget(float start_x, float start_z, float& target_x, float& target_z, int clearance);
+
+    // Path over the navigation mesh of the clearance class, in world
+    // coordinates. False if the mesh has no way through, or the path it
+    // gives cuts a corner the line test won't allow.
+    bool findNavigationMeshPath(float start_x, float start_z, float target_x, float target_z, int clearance, vector<glm::vec3>& path);
+
+    // Built from the grid the first time a class asks for it, and again
+    // after any edit
+    NavigationMesh& getNavigationMesh(int clearance);
+
+    // The meshes built so far, stored with a hash of the pathing so a file
+    // from a different grid is ignored
+    bool saveNavigationMeshes(string filename);
+    bool loadNavigationMeshes(string filename);
+
+    static const int NO_REGION = ConnectivityRegions::NO_REGION;
+
+    // Clearance values are capped so they fit in a byte
+    static const int MAX_CLEARANCE = 32;
+
+    // How far around an unreachable target to look for a reachable cell
+    static const int MAX_REDIRECT_DISTANCE = 64;
+
+private:
+    // Only while TerrainPathing fills in a new grid, before its clearance is
+    // generated and anything listens to it
+    friend class TerrainPathing;
+    void setPathable(int x, int z, bool pathable);
+
+    int getIndex(int x, int z);
+    bool isPathableIndex(int index_x, int index_z) const;
+    void setPathableIndex(int index_x, int index_z, bool pathable);
+
+    void computeClearance(int min_x, int min_z, int max_x, int max_z);
+    void markRegionsDirty(int min_x, int min_z, int max_x, int max_z);
+    uint64_t getPathingHash();
+
+    // Cells a clearance class can stand on. Rows run along x and columns
+    // along z, so steep lines are tested a word at a time as well.
+    struct LineBits {
+        vector<uint64_t> rows;
+        vector<uint64_t> columns;
+    };
+
+    LineBits& getLineBits(int clearance);
+    void updateLineBits(LineBits& bits, int clearance, int min_x, int min_z, int max_x, int max_z);
+    void updateAllLineBits(int min_x, int min_z, int max_x, int max_z);
+    static bool isRunClear(const vector<uint64_t>& bits, int first, int last);
+    static void distanceTransform(const float* f, float* d, int* v, float* z, int n);
+
+    // A bit per cell, each row padded out to whole words
+    vector<uint64_t> pathable;
+    vector<unsigned char> clearance;
+
+    // Bits per row, and per column in the transposed LineBits
+    int row_stride;
+    int column_stride;
+
+    // By clearance class, empty until the class is first line tested
+    vector<LineBits> line_bits;
+
+    // One set of regions per clearance class, labelled the first time a
+    // unit of that size asks
+    std::map<int, ConnectivityRegions> regions;
+
+    // By clearance class, only the ones that have been used
+    std::map<int, NavigationMesh> navigation_meshes;
+
+    int width;
+    int depth;
+    int start_x;
+    int start_z;
+
+    std::map<int, Change_Callback_Type> change_callbacks;
+    int next_callback_id;
+
+};
+
+#endif
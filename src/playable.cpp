@@ -2,8 +2,7 @@
 // Trevor Westphal
 
 #include "playable.hpp"
-
-Doodad* Playable::selection_ring;
+#include "unit_holder.hpp"
 
 // Magical numbers
 #define AT_TARGET_PATH_RADIUS 0.1f
@@ -17,6 +16,22 @@ Doodad* Playable::selection_ring;
 
 #define PATH_WIDTH 2.0f
 
+#define FLOW_FIELD_ARRIVE_RADIUS 6.0f
+
+// Collision avoidance, horizons in simulation steps
+#define AVOID_UNIT_COUNT 10
+#define AVOID_OBSTACLE_COUNT 8
+#define AVOID_UNIT_HORIZON 20.0f
+#define AVOID_OBSTACLE_HORIZON 10.0f
+
+// Target acquisition. A unit looks for someone better to shoot once every
+// RESCAN_STEPS, staggered so only a share of the units look on any step. A
+// point of attack priority is worth PRIORITY_SCORE of distance, and
+// whoever shot us last is worth THREAT_SCORE.
+#define RESCAN_STEPS 8
+#define PRIORITY_SCORE 10.0f
+#define THREAT_SCORE 5.0f
+
 //#############################################
 // Text headers from
 // http://www.network-science.de/ascii/
@@ -35,30 +50,76 @@ Doodad* Playable::selection_ring;
 //
 //##################################################################################################
 
-Playable::Playable() : Drawable(){
+Playable::Playable(){
 
+    this->position = glm::vec3(0.0f, 0.0f, 0.0f);
+    this->rotation = glm::vec3(0.0f, 0.0f, 0.0f);
+
+    initialize();
 }
 
-Playable::Playable(Mesh& mesh, Shader& shader, glm::vec3 position, GLfloat scale) : Drawable(mesh, shader, position, scale) {
+Playable::Playable(glm::vec3 position) {
 
-    if(! selection_ring){
-    	Mesh* selection_ring_mesh = new Mesh("res/models/selection_ring.dae");
-    	selection_ring = new Doodad(*selection_ring_mesh, shader, position, 2.0f);
-    	selection_ring->setEmissive(Texture("res/textures/selection_ring.png"));
-        selection_ring->rotateGlobalEuler(M_PI/2.0f, 0.0f, 0.0f);
-    }
+    this->position = position;
+    this->rotation = glm::vec3(0.0f, 0.0f, 0.0f);
+
+    initialize();
+}
+
+void Playable::initialize(){
 
 	selected = false;
     temp_selected = false;
 
+    // Given out when it's added to a UnitHolder
+    id = -1;
+    handle = -1;
+    unit_to_attack = -1;
+    shot_target = -1;
+    attack_target = -1;
+    last_attacker = -1;
+    was_attacked = false;
+    attack_priority = 1;
+    obstacle_lines = 0;
+
+    nearest_enemy_attack = -1;
+    nearest_friendly_hurt = -1;
+    nearest_friendly_town_hall = -1;
+    nearest_resource = -1;
+
     #warning Fix the 90* offset bug
     // rotateGlobalEuler(M_PI/2.0f, 0.0f, 0.0f);
 
     target_position = position;
+    previous_position = position;
+    previous_rotation = rotation;
 
+    target_order = Playable::Order::STOP;
+    target_direction = 0.0f;
+    old_target_position = position;
+    flow_field_target = position;
     first_step_since_order = false;
+    turning_during_first_step = false;
+    distance_off_ground = 0.0f;
+    ground_pos = 0.0f;
+
+    enemy_in_sight_range = false;
+    has_been_given_attack_order = false;
+
+    // Set by setTeam, and the rest by loadFromXML
+    team_number = 0;
+    speed = 0.0f;
+    acceleration = 0.0f;
+    turning_speed = 0.0f;
+    radius = 0.0f;
+    sight_radius = 0.0f;
 
-    last_attack_timestamp = GameClock::getInstance()->getCurrentTime();
+    level = 1;
+    per_level_health_boost = 0;
+    per_level_strength_boost = 0;
+    healing_rate = 0;
+
+    last_attack_timestamp = GameClock::getInstance()->getSimulationTime();
 
     // remove me when weapon is implemented
     health = 200;
@@ -68,10 +129,6 @@ Playable::Playable(Mesh& mesh, Shader& shader, glm::vec3 position, GLfloat scale
     weapon_damage = 20;
 }
 
-Drawable* Playable::clone() {
-    return new Playable(*this);
-}
-
 void Playable::loadFromXML(std::string filepath){
     pugi::xml_document doc;
     pugi::xml_parse_result result = doc.load_file(filepath.c_str());
@@ -92,10 +149,12 @@ void Playable::loadFromXML(std::string filepath){
     radius = std::stof(unit_node.child_value("radius"));
     sight_radius = std::stof(unit_node.child_value("sight_radius"));
 
-}
+    // Units without one are all shot at alike
+    pugi::xml_node priority_node = unit_node.child("attack_priority");
+    if(priority_node){
+        attack_priority = std::stoi(priority_node.child_value());
+    }
 
-void Playable::updateUniformData(){
-	glUniform1f(glGetUniformLocation(shader->getGLId(), "scale"), scale);
 }
 
 //##################################################################################################
@@ -110,12 +169,12 @@ void Playable::updateUniformData(){
 //
 //##################################################################################################
 
-void Playable::receiveOrder(Playable::Order order, glm::vec3 target, bool should_enqueue, std::vector<glm::vec3> path, Playable* targeted_unit){
+void Playable::receiveOrder(Playable::Order order, glm::vec3 target, bool should_enqueue, std::vector<glm::vec3> path, int targeted_unit){
 
     // Error that exists: Pathing is done from current position, not future position. Need to fix that.
 
     // Are we targeting another playable?
-    bool is_targeting = bool(targeted_unit);
+    bool is_targeting = targeted_unit != -1;
 
     // Get the corresponding body and final orders
     Playable::Order body_order = determineBodyOrder(order, is_targeting);
@@ -123,7 +182,7 @@ void Playable::receiveOrder(Playable::Order order, glm::vec3 target, bool should
 
     // Allocate the temp queues
     std::queue<std::tuple<Playable::Order, glm::vec3>> temp_order_queue;
-    std::queue<Playable*> temp_target_queue;
+    std::queue<int> temp_target_queue;
 
     // Feed the path and the body orders into the queue
     int size = path.size();
@@ -132,7 +191,7 @@ void Playable::receiveOrder(Playable::Order order, glm::vec3 target, bool should
         // Protect from 0-length paths
         if(size > 0){
             temp_order_queue.push(std::make_tuple(body_order, path[i]));
-            temp_target_queue.push(NULL);
+            temp_target_queue.push(-1);
         }
     }
 
@@ -144,6 +203,7 @@ void Playable::receiveOrder(Playable::Order order, glm::vec3 target, bool should
     if(!should_enqueue){
 
         first_step_since_order = true;
+        flow_field.reset();
 
         // These could theoretically be together, because they should always be
         // the same length. However, I feel more comfortable with them apart.
@@ -171,6 +231,14 @@ void Playable::receiveOrder(Playable::Order order, glm::vec3 target, bool should
     setTargetPositionAndDirection(std::get<1>(order_queue.front()));
 }
 
+void Playable::receiveFlowFieldOrder(Playable::Order order, glm::vec3 target, std::shared_ptr<FlowField> field, int targeted_unit){
+    // Queue it like a path with no waypoints, the field does the rest
+    receiveOrder(order, target, false, std::vector<glm::vec3>(), targeted_unit);
+
+    flow_field = field;
+    flow_field_target = target;
+}
+
 Playable::Order Playable::determineBodyOrder(Playable::Order order, bool is_targeting){
     if(order == Playable::Order::MOVE){
         return Playable::Order::MOVE;
@@ -236,11 +304,6 @@ void Playable::tempDeSelect(){
 }
 
 void Playable::setTeam(int t){
-    if (t == 1){
-        Drawable::setEmissive(Texture(glm::vec4(0.5, 0.5, 1, 0.1)));
-    } else if (t == 2) {
-        Drawable::setEmissive(Texture(glm::vec4(0.172f, 0.855f, 0.424f, 0.1)));
-    }
     team_number = t;
 }
 
@@ -351,12 +414,120 @@ int Playable::steerToStayOnPath(){
     return TURN_NONE;
 }
 
-int Playable::steerAwayFromUnit(Playable *unit){
+int Playable::steerAlongFlowField(){
+
+    // Near the end, or off the field, go for our own spot in the group
+    glm::vec3 flow_direction;
+    if(getDistance(position.x, position.z, target_position.x, target_position.z) < FLOW_FIELD_ARRIVE_RADIUS ||
+       !flow_field->getDirection(position.x, position.z, flow_direction)){
+        return steerToStayOnPath();
+    }
+
+    float flow_angle = atan2(flow_direction.x, flow_direction.z);
+    float angle_delta = atan2(sin(flow_angle-rotation.y), cos(flow_angle-rotation.y));
+
+    if(fabs(angle_delta) > ANGLE_PRECISION){
+        if(angle_delta < 0){
+            return TURN_CCW;
+        }
+        return TURN_CW;
+    }
+    return TURN_NONE;
+}
+
+void Playable::steerAwayFromUnit(UnitHolder *otherUnits, int other_unit){
+
+    glm::vec2 relative_position = glm::vec2(otherUnits->getPositionX(other_unit) - position.x,
+                                            otherUnits->getPositionZ(other_unit) - position.z);
+
+    // Exactly on top of each other there's no way apart to pick, so take
+    // one from the ids that the other unit picks the opposite of
+    if(glm::dot(relative_position, relative_position) == 0.0f){
+        float angle = (std::min(id, other_unit) + std::max(id, other_unit)) * 2.4f;
+        float sign = (other_unit > id) ? 1.0f : -1.0f;
+        relative_position = glm::vec2(sin(angle), cos(angle)) * (0.01f * sign);
+    }
+
+    glm::vec2 velocity = glm::vec2(getVelocity().x, getVelocity().z);
+    glm::vec2 other_velocity = glm::vec2(otherUnits->getVelocityX(other_unit), otherUnits->getVelocityZ(other_unit));
+
+    // They're avoiding us as well, so we only take half
+    avoidance_lines.push_back(CollisionAvoidance::avoid(relative_position, velocity - other_velocity, velocity,
+        radius + otherUnits->getRadius(other_unit), AVOID_UNIT_HORIZON, 0.5f));
+}
+
+void Playable::steerAwayFromObstacle(Terrain *ground){
+
+    PathingGrid& grid = ground->getPathingGrid();
+
+    // Cells that can't be pathed count as points. Paths already keep a
+    // unit's clearance class away from them, less a bit for being between
+    // cell centres.
+    float obstacle_radius = std::max(PathingGrid::getClearanceClass(radius) - 0.5f, 0.5f);
+    float reach = obstacle_radius + speed * AVOID_OBSTACLE_HORIZON;
+
+    int cell_x = int(floor(position.x + 0.5f));
+    int cell_z = int(floor(position.z + 0.5f));
+
+    // Out in the open, the clearance map says there's nothing to find
+    if(grid.getClearance(cell_x, cell_z) >= reach + 1.0f){
+        return;
+    }
+
+    // The nearest few blocked cells, nearest first
+    float found_distance[AVOID_OBSTACLE_COUNT];
+    glm::vec2 found_position[AVOID_OBSTACLE_COUNT];
+    int found = 0;
 
+    int cells = int(ceil(reach));
+    for(int z = cell_z - cells; z <= cell_z + cells; ++z){
+        for(int x = cell_x - cells; x <= cell_x + cells; ++x){
+            if(grid.canPath(x, z)){
+                continue;
+            }
+
+            float distance = getDistance(position.x, position.z, x, z);
+
+            int slot;
+            if(distance > reach){
+                continue;
+            } else if(found < AVOID_OBSTACLE_COUNT){
+                slot = found++;
+            } else if(distance < found_distance[found - 1]){
+                slot = found - 1;
+            } else {
+                continue;
+            }
+
+            while(slot > 0 && found_distance[slot - 1] > distance){
+                found_distance[slot] = found_distance[slot - 1];
+                found_position[slot] = found_position[slot - 1];
+                --slot;
+            }
+
+            found_distance[slot] = distance;
+            found_position[slot] = glm::vec2(x, z);
+        }
+    }
+
+    glm::vec2 here = glm::vec2(position.x, position.z);
+    glm::vec2 velocity = glm::vec2(getVelocity().x, getVelocity().z);
+
+    // Obstacles don't move out of the way, we take all of it
+    for(int i(0); i < found; ++i){
+        avoidance_lines.push_back(CollisionAvoidance::avoid(found_position[i] - here, velocity, velocity,
+            obstacle_radius, AVOID_OBSTACLE_HORIZON, 1.0f));
+    }
 }
 
-int Playable::steerAwayFromObstacle(Terrain *ground){
+glm::vec2 Playable::avoidCollisions(glm::vec2 step){
 
+    // Nothing close enough to matter
+    if(avoidance_lines.empty()){
+        return step;
+    }
+
+    return CollisionAvoidance::findVelocity(avoidance_lines, obstacle_lines, speed, step);
 }
 
 float Playable::distanceFromPointToLine(glm::vec2 line_0, glm::vec2 line_1, glm::vec2 point){
@@ -396,40 +567,101 @@ bool Playable::isEnemy(int t){
     return team_number != t;
 }
 
-void Playable::attack(Playable *enemy){
+void Playable::attack(int enemy){
 
-    if(health < 1 || enemy == NULL){
+    if(health < 1 || enemy == -1){
         // Can't attack when dead
         // Also can't attack null targets
         return;
     }
 
-    float delta_time = GameClock::getInstance()->getCurrentTime() - last_attack_timestamp;
+    // Simulated time, so fast forwarding speeds up fights as well
+    float delta_time = GameClock::getInstance()->getSimulationTime() - last_attack_timestamp;
 
+    // The enemy takes the hit in resolveAttack, once nobody is reading it
     if(delta_time > weapon_cooldown){
-        enemy->takeDamage(weapon_damage);
-        last_attack_timestamp = GameClock::getInstance()->getCurrentTime();
+        shot_target = enemy;
+        last_attack_timestamp = GameClock::getInstance()->getSimulationTime();
+    }
+}
+
+void Playable::resolveAttack(UnitHolder *otherUnits){
+    if(shot_target != -1){
+        otherUnits->getUnit(shot_target).takeDamage(weapon_damage, handle);
+        shot_target = -1;
     }
 }
 
-void Playable::takeDamage(int damage_amount){
+void Playable::takeDamage(int damage_amount, int attacker){
     health = std::max(health - damage_amount, 0);
+
+    last_attacker = attacker;
+    was_attacked = true;
 }
 
-Playable* Playable::getUnitToAttack(std::vector<Playable*> *otherUnits){
+int Playable::getUnitToAttack(UnitHolder *otherUnits){
 
     // Find the highest priority unit -or- the unit that is attacking you -or- unit you attacked last
-    Playable* other_unit = 0;
+    // Whatever scores best out of those in range
+    int other_unit = -1;
+    float best_score = 0.0f;
+
+    for(int i(0); i < attackable_units.size(); ++i){
+        int current_unit = attackable_units[i];
+        float distance_to_unit = getDistance(position.x, position.z, otherUnits->getPositionX(current_unit), otherUnits->getPositionZ(current_unit));
+
+        float score = otherUnits->getUnit(current_unit).getAttackPriority() * PRIORITY_SCORE - distance_to_unit;
+        if(otherUnits->getHandle(current_unit) == last_attacker){
+            score += THREAT_SCORE;
+        }
 
-    for(int i(0); i < otherUnits->size(); ++i){
-        if(otherUnits->at(i) != this){
-            other_unit = otherUnits->at(i);
+        if(other_unit == -1 || score > best_score){
+            best_score = score;
+            other_unit = current_unit;
         }
     }
 
     return other_unit;
 }
 
+bool Playable::isInRange(UnitHolder *otherUnits, int other_unit){
+    // The same reach scanUnits looks over
+    float distance_to_unit = getDistance(position.x, position.z, otherUnits->getPositionX(other_unit), otherUnits->getPositionZ(other_unit));
+    return distance_to_unit <= radius + weapon_range + otherUnits->getRadius(other_unit);
+}
+
+void Playable::acquireTarget(UnitHolder *otherUnits){
+    // Only attack moves shoot back, nobody else needs a target
+    if(target_order != Playable::Order::ATTACK_MOVE){
+        attack_target = -1;
+        unit_to_attack = -1;
+        return;
+    }
+
+    // The target's id this step, unless it died, got away or went into the
+    // fog
+    unit_to_attack = otherUnits->findId(attack_target);
+
+    bool lost_target = attack_target != -1 && (unit_to_attack == UnitHolder::NO_ID || !isInRange(otherUnits, unit_to_attack) ||
+        !otherUnits->getVisibility().isVisible(team_number, otherUnits->getPositionX(unit_to_attack), otherUnits->getPositionZ(unit_to_attack)));
+    if(lost_target){
+        attack_target = -1;
+        unit_to_attack = -1;
+    }
+
+    // Handles spread the looking out over the steps
+    bool rescan_due = (GameClock::getInstance()->getSimulationSteps() + handle) % RESCAN_STEPS == 0;
+
+    if(!lost_target && !was_attacked && !rescan_due){
+        return;
+    }
+    was_attacked = false;
+
+    scanUnits(otherUnits);
+    unit_to_attack = getUnitToAttack(otherUnits);
+    attack_target = (unit_to_attack == -1) ? -1 : otherUnits->getHandle(unit_to_attack);
+}
+
 
 //##################################################################################################
 //
@@ -443,35 +675,23 @@ Playable* Playable::getUnitToAttack(std::vector<Playable*> *otherUnits){
 //
 //##################################################################################################
 
-void Playable::scanUnits(std::vector<Playable*> *otherUnits){
-    // Scan all units, looking for a stuff
+void Playable::scanUnits(UnitHolder *otherUnits){
+    // Scan nearby units, looking for a stuff
     // Nearest friendly, hurt unit - for healing or repair
     // Nearest friendly town hall  - resource return
     // Nearest Enemy unit/struct   - to attack if in engage range
     // Nearest resource            - to gather
 
-    attackable_units.clear();
-
-    Playable* current_unit = 0;
-
-    for(int i = 0; i < otherUnits->size(); ++i){
-
-        current_unit = otherUnits->at(i);
-
-        if(current_unit != this){
-
-            // If it is an enemy and in range, we could potentially attack it
-            float distance_to_unit = getDistance(position.x, position.z, current_unit->getPosition().x, current_unit->getPosition().z);
-
-            if(current_unit->getTeam() != team_number && distance_to_unit <= radius + current_unit->radius + weapon_range){
-                attackable_units.push_back(current_unit);
-            }
-
-        }
-    }
+    // If it is an enemy and in range, we could potentially attack it. Only
+    // the cells around us are looked at, however many units there are.
+    otherUnits->getSpatialHash().findInRadius(position.x, position.z, radius + weapon_range, attackable_units, [this, otherUnits](int current_unit){
+        // Nobody can shoot what their team can't see
+        return current_unit != id && otherUnits->getTeam(current_unit) != team_number &&
+            otherUnits->getVisibility().isVisible(team_number, otherUnits->getPositionX(current_unit), otherUnits->getPositionZ(current_unit));
+    });
 }
 
-void Playable::update(Terrain* ground, std::vector<Playable*> *otherUnits){
+void Playable::scan(UnitHolder *otherUnits, Terrain *ground){
 
     // Setting up attack variables
     // Playable* enemy_to_attack = getNearestEnemyToAttack(otherUnits);
@@ -482,9 +702,31 @@ void Playable::update(Terrain* ground, std::vector<Playable*> *otherUnits){
 
     // Attacking         Weapon range + our size + their size
 
-    scanUnits(otherUnits);
+    acquireTarget(otherUnits);
+
+    // Avoiding, against the nearest few units and where they were going.
+    // Anyone further than both of us could close in over the horizon is
+    // left out by findNearest.
+    avoidance_lines.clear();
+    steerAwayFromObstacle(ground);
+    obstacle_lines = avoidance_lines.size();
+
+    float avoid_distance = radius + otherUnits->getSpatialHash().getMaxUnitRadius() + 2.0f * speed * AVOID_UNIT_HORIZON;
+    otherUnits->getSpatialHash().findNearest(position.x, position.z, AVOID_UNIT_COUNT, avoid_distance, nearby_units, [this](int current_unit){
+        return current_unit != id;
+    });
+
+    for(int i(0); i < nearby_units.size(); ++i){
+        steerAwayFromUnit(otherUnits, nearby_units[i]);
+    }
+}
 
-    Playable* unit_to_attack = getUnitToAttack(otherUnits);
+void Playable::update(Terrain* ground){
+
+    // Called once per fixed simulation step, so everything here moves by a
+    // step's worth
+    previous_position = position;
+    previous_rotation = rotation;
 
     bool should_engage_enemies = target_order == Playable::Order::ATTACK_MOVE;
 
@@ -496,6 +738,10 @@ void Playable::update(Terrain* ground, std::vector<Playable*> *otherUnits){
 
 
 
+    // Where we'd go if nobody was in the way
+    glm::vec2 step = glm::vec2(0.0f);
+    bool idle = false;
+
     // Turning on the first step
     if(first_step_since_order){
         first_step_since_order = false;
@@ -511,6 +757,11 @@ void Playable::update(Terrain* ground, std::vector<Playable*> *otherUnits){
         order_queue.pop();
         target_queue.pop();
 
+        // Let go of the field once we're past the order that used it
+        if(flow_field && target_position != flow_field_target){
+            flow_field.reset();
+        }
+
     } else if(!atTargetPosition()){
 
         // All if we're not a flying unit
@@ -519,8 +770,7 @@ void Playable::update(Terrain* ground, std::vector<Playable*> *otherUnits){
 
         if(turning_during_first_step){
 
-            position.x += sin(target_direction)*speed;
-            position.z += cos(target_direction)*speed;
+            step = glm::vec2(sin(target_direction), cos(target_direction)) * speed;
 
             // http://stackoverflow.com/questions/1878907/the-smallest-difference-between-2-angles
             float angle_delta = atan2(sin(target_direction-rotation.y), cos(target_direction-rotation.y));
@@ -535,30 +785,50 @@ void Playable::update(Terrain* ground, std::vector<Playable*> *otherUnits){
                 }
 
                 if(fabs(angle_delta) < turning_speed){
-                    setRotationEuler(rotation.x, target_direction, rotation.z);
+                    rotation.y = target_direction;
                     turning_during_first_step = false;
                 } else {
-                    setRotationEuler(rotation.x, rotation.y + (turning_speed*sign), rotation.z);
+                    rotation.y += turning_speed*sign;
                 }
             }
 
         } else {
 
-            int path_steer = steerToStayOnPath();
+            int path_steer;
+            if(flow_field && target_position == flow_field_target){
+                path_steer = steerAlongFlowField();
+            } else {
+                path_steer = steerToStayOnPath();
+            }
 
-            position.x += sin(rotation.y + (turning_speed * path_steer))*speed;
-            position.z += cos(rotation.y + (turning_speed * path_steer))*speed;
+            step = glm::vec2(sin(rotation.y + (turning_speed * path_steer)),
+                             cos(rotation.y + (turning_speed * path_steer))) * speed;
 
-            setRotationEuler(rotation.x, rotation.y + (turning_speed * path_steer), rotation.z);
+            rotation.y += turning_speed * path_steer;
 
         }
 
     } else {
 
+        // Arrived, the field can go back to the cache (or away)
+        flow_field.reset();
+        idle = true;
+
         // Do nothing... Randomly turn and idle animate
 
     }
 
+    // Everyone nearby bends their step a little so nobody collides
+    step = avoidCollisions(step);
+    position.x += step.x;
+    position.z += step.y;
+
+    // Standing units make way, and stay where they were pushed to
+    if(idle){
+        target_position.x = position.x;
+        target_position.z = position.z;
+    }
+
     ground_pos = ground->getHeightInterpolated(position.x, position.z);
     position.y = ground_pos + distance_off_ground;
 }
@@ -575,23 +845,139 @@ void Playable::update(Terrain* ground, std::vector<Playable*> *otherUnits){
 //
 //##################################################################################################
 
-void Playable::draw(){
+glm::vec3 Playable::getRenderPosition(){
+    float blend = GameClock::getInstance()->getInterpolation();
+    return previous_position + (position - previous_position) * blend;
+}
 
-    if(health > 0){
-        Drawable::draw();
+float Playable::getRenderRotation(){
+    float blend = GameClock::getInstance()->getInterpolation();
 
+    // The shortest way round, or a unit turning through +-pi spins
+    float turn = atan2(sin(rotation.y - previous_rotation.y), cos(rotation.y - previous_rotation.y));
+    return previous_rotation.y + turn * blend;
+}
 
-        if(selected || temp_selected ){
-            selection_ring->setPosition(glm::vec3(position.x, ground_pos + 0.5, position.z));
-            selection_ring->setRotationEuler(glm::vec3(M_PI/2.0f, rotation.y, 0.0));
-            selection_ring->draw();
-        }
+//##################################################################################################
+//
+//  ######     ###    ##     ## #### ##    ##  ######
+// ##    ##   ## ##   ##     ##  ##  ###   ## ##    ##
+// ##        ##   ##  ##     ##  ##  ####  ## ##
+//  ######  ##     ## ##     ##  ##  ## ## ## ##   ####
+//       ## #########  ##   ##   ##  ##  #### ##    ##
+// ##    ## ##     ##   ## ##    ##  ##   ### ##    ##
+//  ######  ##     ##    ###    #### ##    ##  ######
+//
+//##################################################################################################
+
+void Playable::saveState(Snapshot& snapshot){
+    snapshot.write(position);
+    snapshot.write(rotation);
+    snapshot.write(previous_position);
+    snapshot.write(previous_rotation);
+
+    snapshot.write(team_number);
+    snapshot.write(health);
+    snapshot.write(level);
+    snapshot.write(distance_off_ground);
+    snapshot.write(ground_pos);
+
+    // Cooldowns are timed from this, against the clock's simulation time
+    snapshot.write(last_attack_timestamp);
+    snapshot.write(attack_target);
+    snapshot.write(last_attacker);
+    snapshot.write(was_attacked);
+
+    snapshot.write(target_position);
+    snapshot.write(target_direction);
+    snapshot.write(uint8_t(target_order));
+    snapshot.write(old_target_position);
+    snapshot.write(first_step_since_order);
+    snapshot.write(turning_during_first_step);
+
+    // The two queues always have the same length, so they go together
+    std::queue<std::tuple<Playable::Order, glm::vec3>> orders = order_queue;
+    std::queue<int> targets = target_queue;
+
+    snapshot.write(uint32_t(orders.size()));
+    while(!orders.empty()){
+        snapshot.write(uint8_t(std::get<0>(orders.front())));
+        snapshot.write(std::get<1>(orders.front()));
+        snapshot.write(targets.front());
+
+        orders.pop();
+        targets.pop();
+    }
+
+    // Only what the field leads to, it's built again on load
+    bool has_flow_field = bool(flow_field);
+    snapshot.write(has_flow_field);
+    if(has_flow_field){
+        snapshot.write(flow_field->getGoalX());
+        snapshot.write(flow_field->getGoalZ());
+        snapshot.write(flow_field->getClearance());
+        snapshot.write(flow_field_target);
     }
 }
 
-string Playable::asJsonString() {
-    // No defined format for a playable in json string
-    string json_string = "";
+void Playable::loadState(Snapshot& snapshot, Flow_Field_Source_Type flow_field_source){
+    snapshot.read(position);
+    snapshot.read(rotation);
+    snapshot.read(previous_position);
+    snapshot.read(previous_rotation);
+
+    snapshot.read(team_number);
+    snapshot.read(health);
+    snapshot.read(level);
+    snapshot.read(distance_off_ground);
+    snapshot.read(ground_pos);
+
+    snapshot.read(last_attack_timestamp);
+    snapshot.read(attack_target);
+    snapshot.read(last_attacker);
+    snapshot.read(was_attacked);
+
+    snapshot.read(target_position);
+    snapshot.read(target_direction);
+    uint8_t saved_order = 0;
+    snapshot.read(saved_order);
+    target_order = Playable::Order(saved_order);
+    snapshot.read(old_target_position);
+    snapshot.read(first_step_since_order);
+    snapshot.read(turning_during_first_step);
+
+    order_queue = std::queue<std::tuple<Playable::Order, glm::vec3>>();
+    target_queue = std::queue<int>();
+
+    uint32_t order_count = 0;
+    snapshot.read(order_count);
+
+    for(uint32_t i = 0; i < order_count && snapshot.isGood(); ++i){
+        uint8_t order = 0;
+        glm::vec3 target;
+        int target_handle;
+
+        snapshot.read(order);
+        snapshot.read(target);
+        snapshot.read(target_handle);
+
+        order_queue.push(std::make_tuple(Playable::Order(order), target));
+        target_queue.push(target_handle);
+    }
+
+    flow_field.reset();
 
-    return json_string;
+    bool has_flow_field = false;
+    snapshot.read(has_flow_field);
+    if(has_flow_field){
+        int goal_x, goal_z, clearance;
+        snapshot.read(goal_x);
+        snapshot.read(goal_z);
+        snapshot.read(clearance);
+        snapshot.read(flow_field_target);
+
+        if(snapshot.isGood()){
+            flow_field = flow_field_source(goal_x, goal_z, clearance);
+        }
+    }
 }
@@ -9,38 +9,59 @@
 #include <vector>
 #include <string>
 #include <queue>
+#include <memory>
+#include <functional>
 
 #include "pugixml.hpp" // PUGI xml library
 
 
-#include "doodad.hpp"
-#include "mesh.hpp"
-#include "drawable.hpp"
+#include "includes/glm.hpp"
 #include "terrain.hpp"
 #include "game_clock.hpp"
 #include "pathfinder.hpp"
+#include "flow_field.hpp"
+#include "collision_avoidance.hpp"
+#include "snapshot.hpp"
 
-class Playable : public Drawable {
+class UnitHolder;
+
+// A unit as the simulation sees it. What it's drawn with is kept apart, in
+// a UnitModel.
+class Playable {
 public:
 	// Not a complete list
 	enum class Order{ MOVE, MOVE_TARGET, ATTACK, ATTACK_MOVE, ATTACK_TARGET, HOLD_POSITION, STOP };
 	enum class PlayableAttribute{ MASSIVE, ARMORED, ARMY, WORKER, FLYING, INVULNERABLE, MECHANICAL };
 
 	Playable();
-	Playable(Mesh&, Shader& shader, glm::vec3, GLfloat);
-	Drawable* clone();
-
-	void update(Terrain*, std::vector<Playable*>*);
+	Playable(glm::vec3);
+
+	// Hands out the flow field for a goal and clearance, shared with anyone
+	// else following it
+	typedef std::function<std::shared_ptr<FlowField>(int, int, int)> Flow_Field_Source_Type;
+
+	// Everything about the unit that changes as the game goes on. What comes
+	// from its XML isn't saved, so it loads back into the same unit. Units
+	// it's after are saved by handle.
+	void saveState(Snapshot&);
+	void loadState(Snapshot&, Flow_Field_Source_Type);
+
+	// A simulation step comes in three parts. scan only reads the other
+	// units, as they were at the end of the last step. update only changes
+	// this unit, and resolveAttack hands out the damage it decided on. Each
+	// part can run for every unit at once before the next one starts.
+	void scan(UnitHolder*, Terrain*);
+	void update(Terrain*);
+	void resolveAttack(UnitHolder*);
 	void loadFromXML(std::string filepath);
 
-	void draw();
-
 	void select();
 	void deSelect();
 	void tempSelect();
 	void tempDeSelect();
 
-	void receiveOrder(Playable::Order, glm::vec3, bool, std::vector<glm::vec3>, Playable*);
+	void receiveOrder(Playable::Order, glm::vec3, bool, std::vector<glm::vec3>, int);
+	void receiveFlowFieldOrder(Playable::Order, glm::vec3, std::shared_ptr<FlowField>, int);
 
 	void holdPosition();
 	void stop();
@@ -51,13 +72,36 @@ public:
 
 	bool isSelected(){ return selected; }
 	bool isTempSelected(){ return temp_selected; }
-
-	string asJsonString();
+	bool isIdle(){ return order_queue.empty() && atTargetPosition(); }
+	bool isAlive(){ return health > 0; }
+	int getHealth(){ return health; }
+	int getAttackPriority(){ return attack_priority; }
+	std::shared_ptr<FlowField> getFlowField(){ return flow_field; }
 
 	float getRadius(){ return radius; }
+	float getSightRadius(){ return sight_radius; }
+
+	glm::vec3 getPosition(){ return position; }
+	void setPosition(glm::vec3 p){ position = p; }
+	glm::vec3 getRotation(){ return rotation; }
+	float getGroundHeight(){ return ground_pos; }
+
+	// Where to draw the unit this frame, between its last two steps
+	glm::vec3 getRenderPosition();
+	float getRenderRotation();
+
+	// How far the unit moved in the last simulation step
+	glm::vec3 getVelocity(){ return position - previous_position; }
 
 	int getTeam(){return team_number;}
 
+	// Where the unit is kept in its UnitHolder. The id changes when units
+	// before it are removed, the handle never does.
+	int getId(){return id;}
+	void setId(int i){id = i;}
+	int getHandle(){return handle;}
+	void setHandle(int h){handle = h;}
+
 	// Temporary - REMOVE ME LATER
 	void setTeam(int t);
 
@@ -70,27 +114,55 @@ private:
 
 	// Order queues
 	std::queue<std::tuple<Playable::Order, glm::vec3>> order_queue;
-	std::queue<Playable*> target_queue;
+	// Handles of the units the orders are after, -1 for none
+	std::queue<int> target_queue;
 
 	// Tracking the first turn
 	bool first_step_since_order;
 	bool turning_during_first_step;
 
+	// Where the unit is and which way it faces
+	glm::vec3 position;
+	glm::vec3 rotation;
+
+	// Where the unit was before the last simulation step, drawn from to
+	// smooth out frames that fall between steps
+	glm::vec3 previous_position;
+	glm::vec3 previous_rotation;
+
 	// Current/Old Target Location, Direction, and Order
 	glm::vec3 target_position;
 	float target_direction;
 	Playable::Order target_order;
 	glm::vec3 old_target_position;
 
-	// Selection
-	static Doodad* selection_ring;
+	// Flow field leading to flow_field_target, held only while following it
+	std::shared_ptr<FlowField> flow_field;
+	glm::vec3 flow_field_target;
 
 	// Attacking
 	bool enemy_in_sight_range;
 	bool has_been_given_attack_order;
 
-	// Scanning stuff
-	std::vector<Playable*> attackable_units;
+	// Scanning stuff, ids in the UnitHolder
+	std::vector<int> attackable_units;
+	int unit_to_attack;
+
+	// Who we're shooting at, by handle, kept between the steps we look for
+	// someone better. Whoever shot us last scores higher, and being shot
+	// makes us look again straight away.
+	int attack_target;
+	int last_attacker;
+	bool was_attacked;
+
+	// Who this step's shot hit, -1 if we didn't fire
+	int shot_target;
+
+	// Avoidance, the nearest few units and what scan found we must steer
+	// clear of this step. The lines for obstacles come first.
+	std::vector<int> nearby_units;
+	std::vector<CollisionAvoidance::Line> avoidance_lines;
+	int obstacle_lines;
 
 	//################################
 	// In-game Variables (Private)
@@ -98,6 +170,8 @@ private:
 
 	// Type
 	std::string unit_type;
+	int id;
+	int handle;
 
 	// Team
 	// Stuff for now
@@ -163,30 +237,35 @@ private:
 	// Combat (Private)
 	//################################
 
-	Playable* nearest_enemy_attack;
-	Playable* nearest_friendly_hurt;
-	Playable* nearest_friendly_town_hall;
-	Playable* nearest_resource;
+	// Handles, -1 for none
+	int nearest_enemy_attack;
+	int nearest_friendly_hurt;
+	int nearest_friendly_town_hall;
+	int nearest_resource;
 
-	void attack(Playable*);
-	void takeDamage(int);
-	Playable* getUnitToAttack(std::vector<Playable*>*);
+	void attack(int);
+	void takeDamage(int, int);
+	void acquireTarget(UnitHolder*);
+	bool isInRange(UnitHolder*, int);
+	int getUnitToAttack(UnitHolder*);
 
 	//################################
 	// Steering (Private)
 	//################################
 
 	int steerToStayOnPath();
-	int steerAwayFromUnit(Playable*);
-	int steerAwayFromObstacle(Terrain*);
+	int steerAlongFlowField();
+	void steerAwayFromUnit(UnitHolder*, int);
+	void steerAwayFromObstacle(Terrain*);
+	glm::vec2 avoidCollisions(glm::vec2);
 	static float distanceFromPointToLine(glm::vec2, glm::vec2, glm::vec2);
 
 	//################################
 	// Other Stuff (Private)
 	//################################
 
-	void scanUnits(std::vector<Playable*>*);
-	void updateUniformData();
+	void initialize();
+	void scanUnits(UnitHolder*);
 
 };
 
@@ -28,6 +28,12 @@ Profile::Profile(){
     resolution_map[8] = std::make_tuple(3840, 2160);
     resolution_map[9] = std::make_tuple(5120, 2880);
 
+	// Older settings files don't have these
+	path_workers = -1;
+	path_budget = 2.0f;
+	unit_threads = -1;
+	fog_occlusion_on = true;
+
 	loadSettings();
 }
 
@@ -134,6 +140,14 @@ void Profile::loadSettings(){
 				normals_on = (strcmp(value, "true") == 0);
 			} else if(strcmp(keyword, "depthmap") == 0){
 				depthmap_on = (strcmp(value, "true") == 0);
+			} else if(strcmp(keyword, "pathworkers") == 0){
+				path_workers = (strcmp(value, "auto") == 0) ? -1 : atoi(value);
+			} else if(strcmp(keyword, "pathbudget") == 0){
+				path_budget = atof(value);
+			} else if(strcmp(keyword, "unitthreads") == 0){
+				unit_threads = (strcmp(value, "auto") == 0) ? -1 : atoi(value);
+			} else if(strcmp(keyword, "fogocclusion") == 0){
+				fog_occlusion_on = (strcmp(value, "true") == 0);
 			}
         }
     }
@@ -28,6 +28,17 @@ public:
 	int getWindowHeight();
 	int getWindowWidth();
 
+	// Negative picks the worker count from the cores, 0 searches on the
+	// main thread within the per frame budget
+	int getPathWorkers() {return path_workers;}
+	float getPathBudget() {return path_budget;}
+
+	// Threads the unit update is spread over, counting the main thread.
+	// Negative picks it from the cores, 1 updates on the main thread only.
+	int getUnitThreads() {return unit_threads;}
+
+	// Whether higher ground hides what's behind it from units
+	bool isFogOcclusionOn() {return fog_occlusion_on;}
 
 	void toggleShadows();
 	void toggleVsync();
@@ -49,6 +60,11 @@ private:
 	bool lighting_on;
 	bool normals_on;
 	bool depthmap_on;
+
+	int path_workers;
+	float path_budget;
+	int unit_threads;
+	bool fog_occlusion_on;
 	
 	int resolution_index;
 	std::map<int, std::tuple<int, int>> resolution_map;
@@ -0,0 +1,139 @@
+#include "replay.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+
+#include "debug.hpp"
+
+const int Replay::VERSION;
+
+Replay::Replay() : seed(0), unit_count(0), step_count(0) {
+
+}
+
+void Replay::addSelection(long step, vector<int>& unit_ids){
+    Command command;
+    command.step = step;
+    command.type = Type::SELECT;
+    command.unit_ids = unit_ids;
+    command.order = Playable::Order::STOP;
+    command.target = glm::vec3(0.0f);
+    command.should_enqueue = false;
+    commands.push_back(command);
+}
+
+void Replay::addOrder(long step, Playable::Order order, glm::vec3 target, bool should_enqueue){
+    Command command;
+    command.step = step;
+    command.type = Type::ORDER;
+    command.order = order;
+    command.target = target;
+    command.should_enqueue = should_enqueue;
+    commands.push_back(command);
+}
+
+bool Replay::save(string filename){
+    ofstream output(filename);
+    if (!output){
+        Debug::error("Could not write replay %s.\n", filename.c_str());
+        return false;
+    }
+
+    // Enough digits that every float reads back as the same float
+    output << std::setprecision(9);
+
+    output << "replay " << VERSION << "\n";
+    output << "map " << map_filename << "\n";
+    output << "seed " << seed << "\n";
+    output << "units " << unit_count << "\n";
+    output << "steps " << step_count << "\n";
+
+    for (Command& command : commands){
+        if (command.type == Type::SELECT){
+            output << "select " << command.step;
+            for (int id : command.unit_ids){
+                output << " " << id;
+            }
+            output << "\n";
+        } else {
+            output << "order " << command.step << " " << int(command.order) << " "
+                   << command.target.x << " " << command.target.y << " " << command.target.z << " "
+                   << int(command.should_enqueue) << "\n";
+        }
+    }
+
+    return true;
+}
+
+bool Replay::load(string filename){
+    ifstream input(filename);
+    if (!input){
+        Debug::error("Could not open replay %s.\n", filename.c_str());
+        return false;
+    }
+
+    commands.clear();
+
+    int version = -1;
+    string line;
+
+    while (getline(input, line)){
+        istringstream fields(line);
+        string key;
+        if (!(fields >> key)){
+            continue;
+        }
+
+        bool parsed = true;
+
+        if (key == "replay"){
+            parsed = bool(fields >> version);
+        } else if (key == "map"){
+            parsed = bool(getline(fields >> std::ws, map_filename));
+        } else if (key == "seed"){
+            parsed = bool(fields >> seed);
+        } else if (key == "units"){
+            parsed = bool(fields >> unit_count);
+        } else if (key == "steps"){
+            parsed = bool(fields >> step_count);
+        } else if (key == "select"){
+            long step;
+            vector<int> unit_ids;
+            parsed = bool(fields >> step);
+
+            int id;
+            while (parsed && fields >> id){
+                unit_ids.push_back(id);
+            }
+
+            if (parsed){
+                addSelection(step, unit_ids);
+            }
+        } else if (key == "order"){
+            long step;
+            int order;
+            glm::vec3 target;
+            int should_enqueue;
+            parsed = bool(fields >> step >> order >> target.x >> target.y >> target.z >> should_enqueue);
+
+            if (parsed){
+                addOrder(step, Playable::Order(order), target, should_enqueue != 0);
+            }
+        } else {
+            parsed = false;
+        }
+
+        if (!parsed){
+            Debug::error("Bad line in replay %s: %s\n", filename.c_str(), line.c_str());
+            return false;
+        }
+    }
+
+    if (version != VERSION){
+        Debug::error("Replay %s is version %d, expected %d.\n", filename.c_str(), version, VERSION);
+        return false;
+    }
+
+    return true;
+}
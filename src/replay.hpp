@@ -0,0 +1,79 @@
+#ifndef Replay_h
+#define Replay_h
+
+#include "includes/glm.hpp"
+
+#include <string>
+#include <vector>
+
+#include "playable.hpp"
+
+using namespace std;
+
+// Everything the player told the units to do, tagged with the simulation
+// step it was done before, and what the game started from. Played back into
+// a UnitManager on the same map with the same seed, it makes the same game
+// step for step, as long as the build and the path settings are the same.
+//
+// Saved as text, one line per command:
+//     replay 1
+//     map res/maps/newformat.map
+//     seed 1
+//     units 500
+//     steps 3600
+//     select <step> <unit id>...
+//     order <step> <order> <x> <y> <z> <enqueue>
+// units is how many units the headless simulation spawned, or 0 for the
+// game's own units.
+class Replay {
+public:
+    enum class Type { SELECT, ORDER };
+
+    struct Command {
+        long step;
+        Type type;
+
+        // The whole selection after a SELECT
+        vector<int> unit_ids;
+
+        Playable::Order order;
+        glm::vec3 target;
+        bool should_enqueue;
+    };
+
+    Replay();
+
+    bool load(string filename);
+    bool save(string filename);
+
+    void setMapFilename(string map_filename) {this->map_filename = map_filename;}
+    string getMapFilename() {return map_filename;}
+
+    void setSeed(unsigned int seed) {this->seed = seed;}
+    unsigned int getSeed() {return seed;}
+
+    void setUnitCount(int unit_count) {this->unit_count = unit_count;}
+    int getUnitCount() {return unit_count;}
+
+    // How many steps the recording ran for, commands or not
+    void setStepCount(long step_count) {this->step_count = step_count;}
+    long getStepCount() {return step_count;}
+
+    void addSelection(long step, vector<int>& unit_ids);
+    void addOrder(long step, Playable::Order order, glm::vec3 target, bool should_enqueue);
+
+    // In the order they were made
+    vector<Command>& getCommands() {return commands;}
+
+    static const int VERSION = 1;
+
+private:
+    string map_filename;
+    unsigned int seed;
+    int unit_count;
+    long step_count;
+
+    vector<Command> commands;
+};
+
+#endif
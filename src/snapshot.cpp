@@ -0,0 +1,53 @@
+#include "snapshot.hpp"
+
+#include <cstdio>
+
+#include "debug.hpp"
+
+Snapshot::Snapshot() : read_offset(0), good(true) {
+
+}
+
+bool Snapshot::save(string filename){
+    // One write of the whole buffer
+    FILE* file = fopen(filename.c_str(), "wb");
+    if (!file){
+        Debug::error("Could not write snapshot %s.\n", filename.c_str());
+        return false;
+    }
+
+    size_t written = fwrite(data.data(), 1, data.size(), file);
+    fclose(file);
+
+    if (written != data.size()){
+        Debug::error("Could not write all of snapshot %s.\n", filename.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool Snapshot::load(string filename){
+    FILE* file = fopen(filename.c_str(), "rb");
+    if (!file){
+        Debug::error("Could not open snapshot %s.\n", filename.c_str());
+        return false;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    data.resize(size > 0 ? size : 0);
+    size_t read_size = fread(data.data(), 1, data.size(), file);
+    fclose(file);
+
+    read_offset = 0;
+    good = (read_size == data.size());
+
+    if (!good){
+        Debug::error("Could not read snapshot %s.\n", filename.c_str());
+    }
+
+    return good;
+}
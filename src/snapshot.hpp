@@ -0,0 +1,153 @@
+#ifndef Snapshot_h
+#define Snapshot_h
+
+#include "includes/glm.hpp"
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+
+using namespace std;
+
+// The bytes of a binary save, written and read back in the same order.
+// Values are copied in as they are in memory, with no text in between, so
+// a snapshot only loads on a machine with the same byte order and float
+// layout as the one that saved it. The header written by UnitManager checks
+// for that.
+//
+// Only types that are the same size everywhere go in. Bools are written as
+// a byte, anything else (a long, an enum) has to be converted to one of
+// these first.
+class Snapshot {
+public:
+    Snapshot();
+
+    void write(uint8_t value) {writeBytes(value);}
+    void write(int32_t value) {writeBytes(value);}
+    void write(uint32_t value) {writeBytes(value);}
+    void write(int64_t value) {writeBytes(value);}
+    void write(uint64_t value) {writeBytes(value);}
+    void write(float value) {writeBytes(value);}
+    void write(bool value) {writeBytes(uint8_t(value ? 1 : 0));}
+
+    void write(const glm::vec3& value){
+        write(value.x);
+        write(value.y);
+        write(value.z);
+    }
+
+    template <typename T>
+    void writeVector(const vector<T>& values){
+        write(uint32_t(values.size()));
+        for (const T& value : values){
+            write(value);
+        }
+    }
+
+    // Flow fields are mostly these, copied in one go
+    void writeVector(const vector<float>& values) {writeArray(values);}
+    void writeVector(const vector<unsigned char>& values) {writeArray(values);}
+
+    // Once a read runs past the end every later one fails too, so a whole
+    // section can be read and checked once with isGood
+    bool read(uint8_t& value) {return readBytes(value);}
+    bool read(int32_t& value) {return readBytes(value);}
+    bool read(uint32_t& value) {return readBytes(value);}
+    bool read(int64_t& value) {return readBytes(value);}
+    bool read(uint64_t& value) {return readBytes(value);}
+    bool read(float& value) {return readBytes(value);}
+
+    bool read(bool& value){
+        uint8_t byte = 0;
+        if (!readBytes(byte)){
+            return false;
+        }
+
+        value = byte != 0;
+        return true;
+    }
+
+    bool read(glm::vec3& value){
+        return read(value.x) && read(value.y) && read(value.z);
+    }
+
+    template <typename T>
+    bool readVector(vector<T>& values){
+        uint32_t size;
+        if (!read(size) || read_offset + size_t(size) * sizeof(T) > data.size()){
+            good = false;
+            return false;
+        }
+
+        values.resize(size);
+        for (T& value : values){
+            read(value);
+        }
+        return good;
+    }
+
+    bool readVector(vector<float>& values) {return readArray(values);}
+    bool readVector(vector<unsigned char>& values) {return readArray(values);}
+
+    bool isGood() {return good;}
+
+    // Whether the last bytes are value, to tell a whole file from a cut off
+    // one before reading any of it
+    template <typename T>
+    bool endsWith(const T& value){
+        return data.size() >= sizeof(T) && memcmp(data.data() + data.size() - sizeof(T), &value, sizeof(T)) == 0;
+    }
+
+    // Makes room for about this many bytes, before a large save
+    void reserve(size_t size) {data.reserve(size);}
+
+    bool save(string filename);
+    bool load(string filename);
+
+private:
+    template <typename T>
+    void writeBytes(const T& value){
+        const char* bytes = reinterpret_cast<const char*>(&value);
+        data.insert(data.end(), bytes, bytes + sizeof(T));
+    }
+
+    template <typename T>
+    bool readBytes(T& value){
+        if (!good || read_offset + sizeof(T) > data.size()){
+            good = false;
+            return false;
+        }
+
+        memcpy(&value, data.data() + read_offset, sizeof(T));
+        read_offset += sizeof(T);
+        return true;
+    }
+
+    template <typename T>
+    void writeArray(const vector<T>& values){
+        write(uint32_t(values.size()));
+        const char* bytes = reinterpret_cast<const char*>(values.data());
+        data.insert(data.end(), bytes, bytes + values.size() * sizeof(T));
+    }
+
+    template <typename T>
+    bool readArray(vector<T>& values){
+        uint32_t size;
+        if (!read(size) || read_offset + size_t(size) * sizeof(T) > data.size()){
+            good = false;
+            return false;
+        }
+
+        values.resize(size);
+        memcpy(values.data(), data.data() + read_offset, size_t(size) * sizeof(T));
+        read_offset += size_t(size) * sizeof(T);
+        return true;
+    }
+
+    vector<char> data;
+    size_t read_offset;
+    bool good;
+};
+
+#endif
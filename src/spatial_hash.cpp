@@ -0,0 +1,222 @@
+#include "spatial_hash.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+#include "unit_holder.hpp"
+
+// A bit more than a unit plus its weapon range, so most queries touch a
+// handful of cells
+const float SpatialHash::DEFAULT_CELL_SIZE = 8.0f;
+const int SpatialHash::NO_CELL;
+
+SpatialHash::SpatialHash(UnitHolder& units, float cell_size) : units(&units), cell_size(cell_size), min_x(0.0f), min_z(0.0f), cells_x(1), cells_z(1), cells(1), unit_count(0), max_unit_radius(0.0f) {
+    // Until the bounds are set everything shares one cell
+}
+
+void SpatialHash::setBounds(float min_x, float min_z, float width, float depth){
+    this->min_x = min_x;
+    this->min_z = min_z;
+    cells_x = std::max(1, int(std::ceil(width / cell_size)));
+    cells_z = std::max(1, int(std::ceil(depth / cell_size)));
+
+    cells.assign(cells_x * cells_z, vector<int>());
+
+    for (int id = 0; id < unit_cells.size(); ++id){
+        if (unit_cells[id] != NO_CELL){
+            unit_cells[id] = getCell(id);
+            cells[unit_cells[id]].push_back(id);
+        }
+    }
+}
+
+int SpatialHash::getCellX(float x){
+    return std::max(0, std::min(int(std::floor((x - min_x) / cell_size)), cells_x - 1));
+}
+
+int SpatialHash::getCellZ(float z){
+    return std::max(0, std::min(int(std::floor((z - min_z) / cell_size)), cells_z - 1));
+}
+
+int SpatialHash::getCell(int id){
+    return getCellX(units->getPositionX(id)) + getCellZ(units->getPositionZ(id)) * cells_x;
+}
+
+void SpatialHash::insert(int id){
+    if (id >= unit_cells.size()){
+        unit_cells.resize(id + 1, NO_CELL);
+    }
+
+    if (unit_cells[id] != NO_CELL){
+        update(id);
+        return;
+    }
+
+    int cell = getCell(id);
+    cells[cell].push_back(id);
+    unit_cells[id] = cell;
+    unit_count++;
+
+    max_unit_radius = std::max(max_unit_radius, units->getRadius(id));
+}
+
+void SpatialHash::remove(int id){
+    if (id >= unit_cells.size() || unit_cells[id] == NO_CELL){
+        return;
+    }
+
+    removeFromCell(id, unit_cells[id]);
+    unit_cells[id] = NO_CELL;
+    unit_count--;
+}
+
+void SpatialHash::update(int id){
+    if (id >= unit_cells.size() || unit_cells[id] == NO_CELL){
+        return;
+    }
+
+    max_unit_radius = std::max(max_unit_radius, units->getRadius(id));
+
+    // Most moves stay inside the cell
+    int cell = getCell(id);
+    if (cell == unit_cells[id]){
+        return;
+    }
+
+    removeFromCell(id, unit_cells[id]);
+    cells[cell].push_back(id);
+    unit_cells[id] = cell;
+}
+
+void SpatialHash::clear(){
+    for (vector<int>& cell : cells){
+        cell.clear();
+    }
+    unit_cells.clear();
+    unit_count = 0;
+    max_unit_radius = 0.0f;
+}
+
+void SpatialHash::removeFromCell(int id, int cell){
+    // Order in a cell doesn't matter, swap with the last one
+    vector<int>& ids = cells[cell];
+    for (int i = 0; i < ids.size(); ++i){
+        if (ids[i] == id){
+            ids[i] = ids.back();
+            ids.pop_back();
+            return;
+        }
+    }
+}
+
+void SpatialHash::findInRadius(float x, float z, float radius, vector<int>& result, const Unit_Filter_Type& accept){
+    result.clear();
+
+    float reach = radius + max_unit_radius;
+    int low_x = getCellX(x - reach);
+    int high_x = getCellX(x + reach);
+    int low_z = getCellZ(z - reach);
+    int high_z = getCellZ(z + reach);
+
+    for (int cell_z = low_z; cell_z <= high_z; ++cell_z){
+        for (int cell_x = low_x; cell_x <= high_x; ++cell_x){
+            for (int id : cells[cell_x + cell_z * cells_x]){
+                float x_diff = units->getPositionX(id) - x;
+                float z_diff = units->getPositionZ(id) - z;
+                float touching = radius + units->getRadius(id);
+
+                if (x_diff * x_diff + z_diff * z_diff <= touching * touching && (!accept || accept(id))){
+                    result.push_back(id);
+                }
+            }
+        }
+    }
+}
+
+void SpatialHash::findInBox(float min_x, float min_z, float max_x, float max_z, vector<int>& result, const Unit_Filter_Type& accept){
+    result.clear();
+
+    int low_x = getCellX(min_x - max_unit_radius);
+    int high_x = getCellX(max_x + max_unit_radius);
+    int low_z = getCellZ(min_z - max_unit_radius);
+    int high_z = getCellZ(max_z + max_unit_radius);
+
+    for (int cell_z = low_z; cell_z <= high_z; ++cell_z){
+        for (int cell_x = low_x; cell_x <= high_x; ++cell_x){
+            for (int id : cells[cell_x + cell_z * cells_x]){
+                float position_x = units->getPositionX(id);
+                float position_z = units->getPositionZ(id);
+                float radius = units->getRadius(id);
+
+                if (min_x - radius < position_x && max_x + radius > position_x &&
+                    min_z - radius < position_z && max_z + radius > position_z &&
+                    (!accept || accept(id))){
+                    result.push_back(id);
+                }
+            }
+        }
+    }
+}
+
+void SpatialHash::findNearest(float x, float z, int count, float max_distance, vector<int>& result, const Unit_Filter_Type& accept){
+    result.clear();
+
+    if (count <= 0){
+        return;
+    }
+
+    vector<pair<float, int>> found;
+
+    int centre_x = getCellX(x);
+    int centre_z = getCellZ(z);
+    int last_ring = std::max(cells_x, cells_z);
+
+    // Rings of cells outwards from the one (x, z) is in. Everything in ring
+    // n + 1 or beyond is at least n cells away, so once the closest count
+    // are nearer than that the search can stop.
+    for (int ring = 0; ring <= last_ring; ++ring){
+        if ((ring - 1) * cell_size > max_distance){
+            break;
+        }
+
+        for (int cell_z = centre_z - ring; cell_z <= centre_z + ring; ++cell_z){
+            if (cell_z < 0 || cell_z >= cells_z){
+                continue;
+            }
+
+            // Rows in the middle of the ring only have their two ends
+            bool whole_row = (cell_z == centre_z - ring || cell_z == centre_z + ring);
+            int step = whole_row ? 1 : std::max(1, 2 * ring);
+
+            for (int cell_x = centre_x - ring; cell_x <= centre_x + ring; cell_x += step){
+                if (cell_x < 0 || cell_x >= cells_x){
+                    continue;
+                }
+
+                for (int id : cells[cell_x + cell_z * cells_x]){
+                    float x_diff = units->getPositionX(id) - x;
+                    float z_diff = units->getPositionZ(id) - z;
+                    float distance = std::sqrt(x_diff * x_diff + z_diff * z_diff);
+
+                    if (distance <= max_distance && (!accept || accept(id))){
+                        found.push_back(make_pair(distance, id));
+                    }
+                }
+            }
+        }
+
+        if (found.size() >= count){
+            std::nth_element(found.begin(), found.begin() + (count - 1), found.end());
+            if (found[count - 1].first <= ring * cell_size){
+                break;
+            }
+        }
+    }
+
+    int kept = std::min(int(found.size()), count);
+    std::partial_sort(found.begin(), found.begin() + kept, found.end());
+
+    for (int i = 0; i < kept; ++i){
+        result.push_back(found[i].second);
+    }
+}
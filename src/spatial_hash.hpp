@@ -0,0 +1,74 @@
+#ifndef SpatialHash_h
+#define SpatialHash_h
+
+#include <vector>
+#include <functional>
+
+using namespace std;
+
+class UnitHolder;
+
+// Unit ids bucketed into a uniform grid of square cells over the map, so
+// queries only look at the cells around them instead of every unit. Units
+// are filed by their centre, read from the UnitHolder's arrays. Anything
+// off the map is kept in the nearest edge cell, which only makes queries
+// there a little less tight.
+//
+// A unit has to be moved with update() whenever its position changes.
+class SpatialHash {
+public:
+    // Queries only return units this accepts, when it's set
+    typedef std::function<bool(int)> Unit_Filter_Type;
+
+    SpatialHash(UnitHolder& units, float cell_size = DEFAULT_CELL_SIZE);
+
+    // World-space area the cells cover. Units already held are filed again.
+    void setBounds(float min_x, float min_z, float width, float depth);
+
+    void insert(int id);
+    void remove(int id);
+    void update(int id);
+    void clear();
+
+    int size() {return unit_count;}
+    float getMaxUnitRadius() {return max_unit_radius;}
+
+    // Units whose circle touches the circle around (x, z)
+    void findInRadius(float x, float z, float radius, vector<int>& result, const Unit_Filter_Type& accept = Unit_Filter_Type());
+
+    // Units whose circle overlaps the rectangle
+    void findInBox(float min_x, float min_z, float max_x, float max_z, vector<int>& result, const Unit_Filter_Type& accept = Unit_Filter_Type());
+
+    // Up to count units whose centres are closest to (x, z) and no further
+    // than max_distance, closest first
+    void findNearest(float x, float z, int count, float max_distance, vector<int>& result, const Unit_Filter_Type& accept = Unit_Filter_Type());
+
+    static const float DEFAULT_CELL_SIZE;
+    static const int NO_CELL = -1;
+
+private:
+    int getCellX(float x);
+    int getCellZ(float z);
+    int getCell(int id);
+
+    void removeFromCell(int id, int cell);
+
+    UnitHolder* units;
+
+    float cell_size;
+    float min_x;
+    float min_z;
+    int cells_x;
+    int cells_z;
+
+    vector<vector<int>> cells;
+
+    // The cell each unit id is filed under, NO_CELL if it isn't
+    vector<int> unit_cells;
+    int unit_count;
+
+    // Units reach into cells around their own by up to this much
+    float max_unit_radius;
+};
+
+#endif
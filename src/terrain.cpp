@@ -63,6 +63,25 @@ Terrain::Terrain(Shader& shader, string heightmap_filename, float amplification)
 
 }
 
+Terrain::Terrain(const vector<float>& heights, int width, int depth, float amplification) : Drawable() {
+    this->amplification = amplification;
+    this->tile_size = 16;
+    this->width = width;
+    this->depth = depth;
+
+    max_height = amplification;
+
+    start_x = -width / 2;
+    start_z = -depth / 2;
+
+    initializeBaseMesh(heights);
+    generatePathingArray();
+
+    // Nothing to paint on
+    splatmap_painter = 0;
+    layered_textures = 0;
+}
+
 Drawable* Terrain::clone() {
     return new Terrain(*this);
 }
@@ -101,25 +120,14 @@ void Terrain::initializer(Shader& shader, string heightmap_filename, float ampli
 }
 
 void Terrain::generatePathingArray(){
-    // Could do bit-packing here but it really doesn't matter
-    pathing_array = new bool*[depth];
-    for(int i = 0; i < depth; ++i){
-        pathing_array[i] = new bool[width];
+    // The heights are all the pathing needs, so the same grid can be built
+    // without a mesh (see TerrainPathing)
+    vector<float> heights(width * depth);
+    for(int i = 0; i < heights.size(); ++i){
+        heights[i] = vertices[i].position.y;
     }
 
-    // Iterate through the pathing array, filling in all the places where we can't go
-    for(int z = 0; z < depth; ++z){
-        for(int x = 0; x < width; ++x){
-            pathing_array[z][x] = (getSteepness(GLfloat(x) + start_x, GLfloat(z) + start_z) < 0.8f);
-
-            if(pathing_array[z][x]){
-                // printf("  ");
-            } else {
-                // printf("██");
-            }
-        }
-        // printf("\n");
-    }
+    pathing_grid = TerrainPathing::generate(heights, width, depth);
 }
 
 void Terrain::paintSplatmap(glm::vec3 mouse_position){
@@ -135,21 +143,18 @@ void Terrain::eraseSplatmap(glm::vec3 mouse_position){
 }
 
 bool Terrain::canPath(int x, int z){
-    x -= int(start_x);
-    z -= int(start_z);
-
-    if(x < 0 || z < 0 || x > width - 1 || z > depth - 1){
-        return false;
-    }
+    return pathing_grid.canPath(x, z);
+}
 
-    return pathing_array[z][x];
+PathingGrid& Terrain::getPathingGrid(){
+    return pathing_grid;
 }
 
 void Terrain::printPathing(){
     Debug::info("Pathing array:\n");
     for (int x = 0; x < width - 1; ++x){
         for (int z = 0; z < depth - 1; ++ z){
-            printf(" %d", pathing_array[z][x]);
+            printf(" %d", pathing_grid.canPath(x + start_x, z + start_z));
         }
         printf("\n");
     }
@@ -256,7 +261,7 @@ bool Terrain::isOnTerrain(GLfloat x_pos, GLfloat z_pos, GLfloat tolerance){
     return is_on_terrain;
 }
 
-void Terrain::initializeBaseMesh(Heightmap& heightmap){
+void Terrain::initializeBaseMesh(const vector<float>& heights){
     // This generates the mesh that will be used for the
     // top level terrain data, like height and normals.
     // This is just the basic layout of the mesh though
@@ -267,7 +272,7 @@ void Terrain::initializeBaseMesh(Heightmap& heightmap){
     for (int x = 0; x < width; ++x){
         for (int z = 0; z < depth; ++z){
             TerrainVertex current;
-            float height = heightmap.getMapHeight(x, z);
+            float height = heights[getIndex(x, z)];
             current.position = glm::vec3(x + start_x, height, z + start_z);
 
             float u = x / (float)width;
@@ -340,7 +345,13 @@ Mesh* Terrain::generateMesh(Heightmap& heightmap){
     start_z = -depth / 2;
 
     // Generate the mesh for gameplay data
-    initializeBaseMesh(heightmap);
+    vector<float> heights(width * depth);
+    for (int x = 0; x < width; ++x){
+        for (int z = 0; z < depth; ++z){
+            heights[getIndex(x, z)] = heightmap.getMapHeight(x, z);
+        }
+    }
+    initializeBaseMesh(heights);
 
     // Now make it look nice!
 
@@ -440,6 +451,8 @@ void Terrain::updateUniformData(){
     glUniform1f(scale_loc, scale);
     glUniform1f(time_loc, GameClock::getInstance()->getCurrentTime());
 
+    glUniform1i(glGetUniformLocation(shader->getGLId(), "fog_of_war_on"), fog_of_war != 0);
+
 }
 
 void Terrain::bindTextures(){
@@ -456,6 +469,9 @@ void Terrain::bindTextures(){
     glActiveTexture(GL_TEXTURE3);
     glBindTexture(GL_TEXTURE_2D, normal.getGLId());
 
+    glActiveTexture(GL_TEXTURE5);
+    glBindTexture(GL_TEXTURE_2D, fog_of_war);
+
     layered_textures->updateUniforms(shader->getGLId());
 
 }
@@ -466,6 +482,7 @@ void Terrain::setTextureLocations(){
     glUniform1i(glGetUniformLocation(shader->getGLId(), "emissive_texture"), 2);
     glUniform1i(glGetUniformLocation(shader->getGLId(), "normal_map"), 3);
     glUniform1i(glGetUniformLocation(shader->getGLId(), "shadow_map"), 4);
+    glUniform1i(glGetUniformLocation(shader->getGLId(), "fog_of_war"), 5);
 
     layered_textures->setTextureLocations(shader->getGLId());
 
@@ -19,6 +19,8 @@
 #include "texture_painter.hpp"
 #include "resource_loader.hpp"
 #include "jsonable.hpp"
+#include "pathing_grid.hpp"
+#include "terrain_pathing.hpp"
 
 using namespace std;
 
@@ -29,6 +31,10 @@ public:
     Terrain(string heightmap_filename, float amplification);
     Terrain (Shader& shader, string h) : Terrain(shader, h, 10.0f) {;}
     Terrain (Shader& shader, string, float);
+
+    // Only the heights and pathing, with no mesh or textures, so it can be
+    // used without a GL context (see HeadlessSimulation). It can't be drawn.
+    Terrain(const vector<float>& heights, int width, int depth, float amplification);
     Drawable* clone();
 
     int getDepth() {return depth;}
@@ -48,6 +54,7 @@ public:
     bool isOnTerrain(GLfloat, GLfloat, GLfloat);
 
     bool canPath(int, int);
+    PathingGrid& getPathingGrid();
 
     void paintSplatmap(glm::vec3 position);
     void eraseSplatmap(glm::vec3 position);
@@ -62,13 +69,17 @@ public:
     LayeredTextures* getLayeredTextures();
     TexturePainter* getTexturePainter();
 
+    // What the viewing team sees, a byte per heightmap point. Zero turns the
+    // fog off.
+    void setFogOfWar(GLuint texture) {fog_of_war = texture;}
+
 private:
     void initializer(Shader&, string, float, int tile_size);
     void updateUniformData();
 
     GLubyte* renderHeightmapAsImage();
 
-    void initializeBaseMesh(Heightmap&);
+    void initializeBaseMesh(const vector<float>& heights);
     Mesh* generateMesh(Heightmap&);
     void generatePathingArray();
     int getIndex(int x, int y);
@@ -77,7 +88,7 @@ private:
     virtual void bindTextures();
     virtual void setTextureLocations();
 
-    bool** pathing_array;
+    PathingGrid pathing_grid;
 
     vector<TerrainVertex> vertices;
 
@@ -95,6 +106,8 @@ private:
 
     Heightmap heightmap;
 
+    GLuint fog_of_war = 0;
+
 };
 
 #endif
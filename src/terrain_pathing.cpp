@@ -0,0 +1,88 @@
+#include "terrain_pathing.hpp"
+
+#include <SOIL.h>
+
+#include "debug.hpp"
+
+const float TerrainPathing::MAX_STEEPNESS = 0.8f;
+
+PathingGrid TerrainPathing::generate(const vector<float>& heights, int width, int depth){
+    PathingGrid pathing_grid(width, depth, -width / 2, -depth / 2);
+
+    vector<glm::vec3> normals = generateNormals(heights, width, depth);
+
+    // Iterate through the pathing array, filling in all the places where we can't go
+    for (int z = 0; z < depth; ++z){
+        for (int x = 0; x < width; ++x){
+            float steepness = acos(glm::dot(glm::vec3(0.0f, 1.0f, 0.0f), normals[x + z * width]));
+            pathing_grid.setPathable(x + pathing_grid.getStartX(), z + pathing_grid.getStartZ(), steepness < MAX_STEEPNESS);
+        }
+    }
+
+    // Work out how much room there is around every cell once, so radius
+    // checks while pathing are a single lookup.
+    pathing_grid.generateClearance();
+
+    return pathing_grid;
+}
+
+vector<glm::vec3> TerrainPathing::generateNormals(const vector<float>& heights, int width, int depth){
+    vector<glm::vec3> normals(width * depth, glm::vec3(0.0f, 0.0f, 0.0f));
+
+    // Two triangles per quad, added up in the same order as the terrain mesh
+    // so the results match it exactly
+    for (int x = 0; x < width - 1; ++x){
+        for (int z = 0; z < depth - 1; ++z){
+            int quad[6] = {
+                x + z * width, (x + 1) + z * width, x + (z + 1) * width,
+                (x + 1) + z * width, (x + 1) + (z + 1) * width, x + (z + 1) * width
+            };
+
+            for (int i = 0; i < 6; i += 3){
+                int a = quad[i];
+                int b = quad[i + 1];
+                int c = quad[i + 2];
+
+                glm::vec3 position_a(a % width, heights[a], a / width);
+                glm::vec3 position_b(b % width, heights[b], b / width);
+                glm::vec3 position_c(c % width, heights[c], c / width);
+
+                glm::vec3 normal = glm::cross(position_c - position_a, position_b - position_a);
+
+                normals[a] += normal;
+                normals[b] += normal;
+                normals[c] += normal;
+            }
+        }
+    }
+
+    for (glm::vec3& normal : normals){
+        normal = glm::normalize(normal);
+    }
+
+    return normals;
+}
+
+bool TerrainPathing::loadHeights(string filename, float amplification, vector<float>& heights, int& width, int& depth){
+    unsigned char* image = SOIL_load_image(filename.c_str(), &width, &depth, 0, SOIL_LOAD_RGBA);
+
+    if (!image){
+        Debug::error("Could not load heightmap %s.\n", filename.c_str());
+        return false;
+    }
+
+    // Same scaling as Heightmap::getMapHeight
+    heights.resize(width * depth);
+    for (int i = 0; i < width * depth; ++i){
+        int red = image[i * 4 + 0];
+        int green = image[i * 4 + 1];
+        int blue = image[i * 4 + 2];
+
+        float map_height = float(red + green + blue) / (3.0f * 255.0);
+        map_height *= amplification;
+        heights[i] = map_height;
+    }
+
+    SOIL_free_image_data(image);
+    return true;
+}
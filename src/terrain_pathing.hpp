@@ -0,0 +1,33 @@
+#ifndef TerrainPathing_h
+#define TerrainPathing_h
+
+#include "includes/glm.hpp"
+
+#include <string>
+#include <vector>
+
+#include "pathing_grid.hpp"
+
+using namespace std;
+
+// Works out which cells of a heightmap can be walked on. Terrain uses it for
+// the game's pathing grid. It only needs the heights, not a mesh or a GL
+// context, so tools can build exactly the same grid without a window.
+class TerrainPathing {
+public:
+    // Heights are indexed x + z * width. The grid is centred on the origin,
+    // the same way Terrain lays out its mesh.
+    static PathingGrid generate(const vector<float>& heights, int width, int depth);
+
+    // Per-vertex normals, summed over the faces around each vertex
+    static vector<glm::vec3> generateNormals(const vector<float>& heights, int width, int depth);
+
+    // Reads a heightmap image the way Heightmap does, without going through a
+    // texture. Returns false if the image can't be loaded.
+    static bool loadHeights(string filename, float amplification, vector<float>& heights, int& width, int& depth);
+
+    // Slopes at least this steep (in radians from flat) can't be walked on
+    static const float MAX_STEEPNESS;
+};
+
+#endif
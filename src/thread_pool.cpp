@@ -0,0 +1,92 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+
+const int ThreadPool::AUTO_THREADS;
+
+ThreadPool::ThreadPool(int thread_count) : shutting_down(false), job(0), count(0), chunk_size(1), next_chunk(0), generation(0), busy_threads(0) {
+    if (thread_count < 0){
+        thread_count = std::max(int(std::thread::hardware_concurrency()), 1);
+    }
+
+    // The calling thread is one of them
+    for (int i = 1; i < thread_count; ++i){
+        threads.push_back(std::thread(&ThreadPool::threadLoop, this));
+    }
+}
+
+ThreadPool::~ThreadPool(){
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        shutting_down = true;
+    }
+    work_available.notify_all();
+
+    for (std::thread& thread : threads){
+        thread.join();
+    }
+}
+
+void ThreadPool::run(int count, int chunk_size, const Job_Type& job){
+    chunk_size = std::max(chunk_size, 1);
+
+    // Not worth waking anyone for a single chunk
+    if (threads.empty() || count <= chunk_size){
+        if (count > 0){
+            job(0, count);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->job = &job;
+        this->count = count;
+        this->chunk_size = chunk_size;
+        next_chunk = 0;
+        busy_threads = threads.size();
+        ++generation;
+    }
+    work_available.notify_all();
+
+    runChunks();
+
+    // The job is only borrowed, nobody can still be using it on return
+    std::unique_lock<std::mutex> lock(mutex);
+    work_done.wait(lock, [this]{ return busy_threads == 0; });
+    this->job = 0;
+}
+
+void ThreadPool::threadLoop(){
+    int seen_generation = 0;
+
+    while (true){
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            work_available.wait(lock, [this, seen_generation]{ return shutting_down || generation != seen_generation; });
+
+            if (shutting_down){
+                return;
+            }
+            seen_generation = generation;
+        }
+
+        runChunks();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--busy_threads == 0){
+            work_done.notify_one();
+        }
+    }
+}
+
+void ThreadPool::runChunks(){
+    while (true){
+        int begin = next_chunk++ * chunk_size;
+        if (begin >= count){
+            return;
+        }
+
+        (*job)(begin, std::min(begin + chunk_size, count));
+    }
+}
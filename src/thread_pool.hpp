@@ -0,0 +1,57 @@
+#ifndef ThreadPool_h
+#define ThreadPool_h
+
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+using namespace std;
+
+// A few threads kept waiting to split loops between them. The thread that
+// calls run takes chunks as well, and run only returns once every chunk is
+// done, so the caller can treat it like an ordinary loop.
+//
+// Chunks are handed out in no particular order. Jobs have to give the same
+// result whichever thread runs which chunk.
+class ThreadPool {
+public:
+    // Called with the range [begin, end) of one chunk
+    typedef std::function<void(int, int)> Job_Type;
+
+    // AUTO_THREADS uses every core. The count includes the calling thread,
+    // so 1 runs everything on it.
+    ThreadPool(int thread_count = AUTO_THREADS);
+    ~ThreadPool();
+
+    void run(int count, int chunk_size, const Job_Type& job);
+
+    int getThreadCount() {return threads.size() + 1;}
+
+    static const int AUTO_THREADS = -1;
+
+private:
+    void threadLoop();
+    void runChunks();
+
+    vector<std::thread> threads;
+    bool shutting_down;
+
+    // The run in progress
+    const Job_Type* job;
+    int count;
+    int chunk_size;
+    std::atomic<int> next_chunk;
+
+    // Bumped for every run, so a thread knows there's new work
+    int generation;
+    int busy_threads;
+
+    std::mutex mutex;
+    std::condition_variable work_available;
+    std::condition_variable work_done;
+};
+
+#endif
@@ -1,18 +1,234 @@
 #include "unit_holder.hpp"
 
-UnitHolder::UnitHolder(){
+#include "debug.hpp"
 
+const int UnitHolder::NO_HANDLE;
+const int UnitHolder::NO_ID;
+const int UnitHolder::SLOT_BITS;
+const int UnitHolder::SLOT_MASK;
+const int UnitHolder::GENERATION_MASK;
+
+UnitHolder::UnitHolder() : spatial_hash(*this) {
+
+}
+
+int UnitHolder::addUnit(Playable& unit){
+    UnitModel model;
+    return addUnit(unit, model);
 }
 
-void UnitHolder::addUnit(Playable& unit){
+int UnitHolder::addUnit(Playable& unit, UnitModel& model){
+    int id = units.size();
+
+    // A slot a dead unit left, if there is one
+    int slot;
+    if (!free_slots.empty()){
+        slot = free_slots.back();
+        free_slots.pop_back();
+    } else {
+        slot = slot_ids.size();
+        slot_ids.push_back(NO_ID);
+        slot_generations.push_back(0);
+    }
+
+    int handle = makeHandle(slot, slot_generations[slot]);
+    slot_ids[slot] = id;
+
     units.push_back(unit);
+    units.back().setId(id);
+    units.back().setHandle(handle);
+    models.push_back(model);
+
+    glm::vec3 position = unit.getPosition();
+    positions_x.push_back(position.x);
+    positions_z.push_back(position.z);
+    velocities_x.push_back(0.0f);
+    velocities_z.push_back(0.0f);
+    radii.push_back(unit.getRadius());
+    teams.push_back(unit.getTeam());
+
+    spatial_hash.insert(id);
+
+    return handle;
+}
+
+void UnitHolder::removeUnit(int id){
+    int last = units.size() - 1;
+
+    visibility.removeUnit(units[id].getHandle());
+
+    // Anyone still holding the handle finds nothing from now on
+    int slot = getSlot(units[id].getHandle());
+    slot_ids[slot] = NO_ID;
+    slot_generations[slot] = (slot_generations[slot] + 1) & GENERATION_MASK;
+    free_slots.push_back(slot);
+
+    spatial_hash.remove(id);
+
+    if (id != last){
+        spatial_hash.remove(last);
+
+        units[id] = std::move(units[last]);
+        units[id].setId(id);
+        models[id] = models[last];
+        slot_ids[getSlot(units[id].getHandle())] = id;
+
+        positions_x[id] = positions_x[last];
+        positions_z[id] = positions_z[last];
+        velocities_x[id] = velocities_x[last];
+        velocities_z[id] = velocities_z[last];
+        radii[id] = radii[last];
+        teams[id] = teams[last];
+
+        spatial_hash.insert(id);
+    }
+
+    units.pop_back();
+    models.pop_back();
+    positions_x.pop_back();
+    positions_z.pop_back();
+    velocities_x.pop_back();
+    velocities_z.pop_back();
+    radii.pop_back();
+    teams.pop_back();
+}
+
+void UnitHolder::removeDeadUnits(){
+    // From the back, so whoever is moved into a gap was already looked at
+    for (int id = units.size() - 1; id >= 0; --id){
+        if (!units[id].isAlive()){
+            removeUnit(id);
+        }
+    }
+}
+
+Playable* UnitHolder::findUnit(int handle){
+    int id = findId(handle);
+    return id == NO_ID ? 0 : &units[id];
+}
+
+int UnitHolder::findId(int handle){
+    if (handle < 0){
+        return NO_ID;
+    }
+
+    int slot = getSlot(handle);
+    if (slot >= slot_ids.size() || slot_generations[slot] != getGeneration(handle)){
+        return NO_ID;
+    }
+
+    return slot_ids[slot];
+}
+
+void UnitHolder::saveSlots(Snapshot& snapshot){
+    vector<int> handles;
+    handles.reserve(units.size());
+    for (Playable& unit : units){
+        handles.push_back(unit.getHandle());
+    }
+
+    snapshot.writeVector(slot_generations);
+    snapshot.writeVector(free_slots);
+    snapshot.writeVector(handles);
+}
+
+bool UnitHolder::readSlots(Snapshot& snapshot, SavedSlots& slots){
+    snapshot.readVector(slots.generations);
+    snapshot.readVector(slots.free);
+    snapshot.readVector(slots.handles);
+
+    if (!snapshot.isGood()){
+        return false;
+    }
+
+    // Every handle and free slot has to be a slot the snapshot has, once
+    vector<bool> used(slots.generations.size(), false);
+
+    for (int handle : slots.handles){
+        int slot = getSlot(handle);
+        if (handle < 0 || slot >= slots.generations.size() || used[slot] || slots.generations[slot] != getGeneration(handle)){
+            return false;
+        }
+        used[slot] = true;
+    }
+
+    for (int slot : slots.free){
+        if (slot < 0 || slot >= slots.generations.size() || used[slot]){
+            return false;
+        }
+        used[slot] = true;
+    }
+
+    // Every unit is built from the same XML for now, so one that died since
+    // can be brought back as a copy of one that didn't
+    if (units.empty() && !slots.handles.empty()){
+        Debug::error("No unit left to load the snapshot's units into.\n");
+        return false;
+    }
+
+    return true;
+}
+
+void UnitHolder::loadSlots(SavedSlots& slots, vector<Playable>& loaded_units){
+    units.swap(loaded_units);
+
+    while (models.size() > units.size()){
+        models.pop_back();
+    }
+    while (models.size() < units.size()){
+        models.push_back(models.front());
+    }
+
+    slot_ids.assign(slots.generations.size(), NO_ID);
+    for (int id = 0; id < slots.handles.size(); ++id){
+        slot_ids[getSlot(slots.handles[id])] = id;
+    }
+    slot_generations = slots.generations;
+    free_slots = slots.free;
+
+    int unit_count = units.size();
+    positions_x.assign(unit_count, 0.0f);
+    positions_z.assign(unit_count, 0.0f);
+    velocities_x.assign(unit_count, 0.0f);
+    velocities_z.assign(unit_count, 0.0f);
+    radii.assign(unit_count, 0.0f);
+    teams.assign(unit_count, 0);
+
+    spatial_hash.clear();
+    visibility.clear();
+
+    for (int id = 0; id < unit_count; ++id){
+        units[id].setId(id);
+        units[id].setHandle(slots.handles[id]);
+        spatial_hash.insert(id);
+    }
 }
 
 vector<Playable>& UnitHolder::getUnits(){
     return units;
 }
 
-void UnitHolder::populate(ResourceLoader& resource_loader) {
+void UnitHolder::moveUnit(int id){
+    Playable& unit = units[id];
+
+    glm::vec3 position = unit.getPosition();
+    positions_x[id] = position.x;
+    positions_z[id] = position.z;
+
+    glm::vec3 velocity = unit.getVelocity();
+    velocities_x[id] = velocity.x;
+    velocities_z[id] = velocity.z;
+    radii[id] = unit.getRadius();
+    teams[id] = unit.getTeam();
+
+    spatial_hash.update(id);
+}
+
+SpatialHash& UnitHolder::getSpatialHash(){
+    return spatial_hash;
+}
+
+void UnitHolder::populate(ResourceLoader& resource_loader, unsigned int seed) {
     // Creation of test playables
     # warning Move mesh loading into playable loading
     Mesh& playable_mesh_ref = resource_loader.loadMesh("small_airship.dae");
@@ -20,23 +236,71 @@ void UnitHolder::populate(ResourceLoader& resource_loader) {
         "shaders/doodad.fs");
     float playable_scale = 1.0f;
 
+    std::mt19937 random(seed);
+
     for(int i = 0; i < 1; ++i){
         for(int j = 0; j < 1; ++j){
             glm::vec3 playable_position = glm::vec3(-10 - 3.0f*i, 0.0f, 5 - 3.0f*j);
-            Playable temp(playable_mesh_ref, playable_shader_ref, playable_position, playable_scale);
-            temp.loadFromXML("res/units/airship.xml");
-            temp.setScale(0.8);
-            temp.setFlying(true);
+            Playable temp(playable_position);
+            UnitModel model(playable_mesh_ref, playable_shader_ref, playable_scale);
 
             Texture& diff_ref = resource_loader.loadTexture("small_airship.png");
-            temp.setDiffuse(diff_ref);
-            if (rand() % 2){
-                temp.setTeam(1);
-            } else {
-                temp.setTeam(2);
-            }
-
-            addUnit(temp);
+            model.setDiffuse(diff_ref);
+
+            addTestUnit(temp, model, random);
+        }
+    }
+}
+
+void UnitHolder::populate(unsigned int seed) {
+    std::mt19937 random(seed);
+
+    for(int i = 0; i < 1; ++i){
+        for(int j = 0; j < 1; ++j){
+            glm::vec3 playable_position = glm::vec3(-10 - 3.0f*i, 0.0f, 5 - 3.0f*j);
+            Playable temp(playable_position);
+            UnitModel model;
+
+            addTestUnit(temp, model, random);
         }
     }
 }
+
+void UnitHolder::addTestUnit(Playable& unit, UnitModel& model, std::mt19937& random) {
+    unit.loadFromXML("res/units/airship.xml");
+    model.setScale(0.8);
+    unit.setFlying(true);
+
+    if (random() % 2){
+        unit.setTeam(1);
+    } else {
+        unit.setTeam(2);
+    }
+
+    addUnit(unit, model);
+}
+
+uint64_t UnitHolder::getChecksum() {
+    // FNV-1a over the exact bits, so any difference at all shows up
+    uint64_t hash = 14695981039346656037ULL;
+
+    auto add = [&hash](const void* data, size_t size){
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; ++i){
+            hash ^= bytes[i];
+            hash *= 1099511628211ULL;
+        }
+    };
+
+    for (Playable& unit : units){
+        glm::vec3 position = unit.getPosition();
+        int health = unit.getHealth();
+
+        add(&position.x, sizeof(float));
+        add(&position.y, sizeof(float));
+        add(&position.z, sizeof(float));
+        add(&health, sizeof(int));
+    }
+
+    return hash;
+}
@@ -2,21 +2,142 @@
 #define UnitHolder_h
 
 #include "playable.hpp"
+#include "unit_model.hpp"
+#include "spatial_hash.hpp"
+#include "visibility_grid.hpp"
+#include "snapshot.hpp"
+
+#include <random>
+#include <cstdint>
 
 using namespace std;
 
+// Every unit on the map, as a slot map. Living units are kept packed at
+// the front of the vector and the arrays, by id, so loops over them never
+// step over the dead. A unit's id is its index and only holds for a step:
+// removing a unit moves the last one into its place.
+//
+// Anything that has to find a unit again later keeps its handle instead,
+// which names the slot the unit was given and how many units had the slot
+// before it. A handle never changes, and once its unit is removed it finds
+// nothing, even after the slot is given to someone else.
+//
+// The state other units look at every tick (where a unit is, where it's
+// going, how big it is, whose side it's on) is also kept in arrays by id, so scans over many units
+// read a few contiguous floats each instead of pulling a whole Playable into
+// cache. Playable::update moves the unit itself, then moveUnit copies the
+// result out. What each unit is drawn with is kept in its own vector of
+// UnitModels, by the same id, so the per-step storage carries no render
+// data at all.
 class UnitHolder {
 public:
     UnitHolder();
 
-    void addUnit(Playable& unit);
+    // Gives back the new unit's handle. A unit added without a model is
+    // never drawn.
+    int addUnit(Playable& unit);
+    int addUnit(Playable& unit, UnitModel& model);
+
+    // Moves the last unit into the gap, in constant time
+    void removeUnit(int id);
+
+    // Every unit with no health left, between steps
+    void removeDeadUnits();
 
     vector<Playable>& getUnits();
+    Playable& getUnit(int id) {return units[id];}
+    UnitModel& getModel(int id) {return models[id];}
+    int getUnitCount() {return units.size();}
+
+    // The unit a handle was given to, 0 (or NO_ID) once it's gone. The
+    // pointer only lasts until units are next added or removed.
+    Playable* findUnit(int handle);
+    int findId(int handle);
+    int getHandle(int id) {return units[id].getHandle();}
+
+    // Handles, free slots and which id each slot holds, so a snapshot can
+    // give every unit back the handle it had
+    void saveSlots(Snapshot& snapshot);
+
+    // The slots as a snapshot saved them, one handle per unit
+    struct SavedSlots {
+        vector<int> generations;
+        vector<int> free;
+        vector<int> handles;
+    };
+
+    // Reads the slots back and checks they fit together, without changing
+    // anything yet
+    bool readSlots(Snapshot& snapshot, SavedSlots& slots);
+
+    // Puts the units loaded from the snapshot, one per saved handle, in
+    // place of the ones there are now and gives them their handles. Each
+    // has to be moved afterwards.
+    void loadSlots(SavedSlots& slots, vector<Playable>& loaded_units);
+
+    static const int NO_HANDLE = -1;
+    static const int NO_ID = -1;
+
+    float getPositionX(int id) {return positions_x[id];}
+    float getPositionZ(int id) {return positions_z[id];}
+    float getVelocityX(int id) {return velocities_x[id];}
+    float getVelocityZ(int id) {return velocities_z[id];}
+    float getRadius(int id) {return radii[id];}
+    int getTeam(int id) {return teams[id];}
+
+    // Copies a unit's state into the arrays and the hash after it changed
+    void moveUnit(int id);
 
-    void populate(ResourceLoader& resource_loader);
+    // Where the units are, kept up to date as they move
+    SpatialHash& getSpatialHash();
+
+    // What each team can see. Removed units stop seeing straight away, the
+    // rest are stamped again by its update.
+    VisibilityGrid& getVisibility() {return visibility;}
+
+    // The seed picks the teams, so the same seed makes the same units
+    void populate(ResourceLoader& resource_loader, unsigned int seed);
+
+    // The same units with nothing to draw them with, for running without a
+    // window
+    void populate(unsigned int seed);
+
+    // Hash of where every unit is and how much health it has left. Two runs
+    // that went the same way have the same checksum.
+    uint64_t getChecksum();
 
 private:
+    void addTestUnit(Playable& unit, UnitModel& model, std::mt19937& random);
+
+    // Handles keep the generation above the slot
+    static int makeHandle(int slot, int generation) {return (generation << SLOT_BITS) | slot;}
+    static int getSlot(int handle) {return handle & SLOT_MASK;}
+    static int getGeneration(int handle) {return handle >> SLOT_BITS;}
+
+    // About a million units at once. A slot's generation wraps after 2048
+    // units, a handle that old could find the wrong one.
+    static const int SLOT_BITS = 20;
+    static const int SLOT_MASK = (1 << SLOT_BITS) - 1;
+    static const int GENERATION_MASK = (1 << (31 - SLOT_BITS)) - 1;
+
     vector<Playable> units;
+    vector<UnitModel> models;
+
+    // By slot: the id of the unit in it (NO_ID when free), and how many
+    // units it has held
+    vector<int> slot_ids;
+    vector<int> slot_generations;
+    vector<int> free_slots;
+
+    vector<float> positions_x;
+    vector<float> positions_z;
+    vector<float> velocities_x;
+    vector<float> velocities_z;
+    vector<float> radii;
+    vector<int> teams;
+
+    SpatialHash spatial_hash;
+    VisibilityGrid visibility;
 
 };
 
@@ -1,38 +1,106 @@
 #include "unit_manager.hpp"
 
-UnitManager::UnitManager(GameMap& game_map, UnitHolder& units) : unit_holder(&units), game_map(&game_map), pathfinder(game_map.getGround()) {
+#include <chrono>
+#include <cinttypes>
+#include <algorithm>
 
+#include "game_clock.hpp"
+
+const uint32_t UnitManager::SNAPSHOT_MAGIC;
+const uint32_t UnitManager::SNAPSHOT_VERSION;
+const uint32_t UnitManager::SNAPSHOT_END;
+const uint32_t UnitManager::SNAPSHOT_BYTE_ORDER;
+
+UnitManager::UnitManager(Terrain& ground, UnitHolder& units) : unit_holder(&units), ground(&ground), path_service(ground.getPathingGrid(), Profile::getInstance()->getPathWorkers(), Profile::getInstance()->getPathBudget()), flow_fields(ground.getPathingGrid()), pathing_changed(false), pathing_changes(0), routes_repairing(false), step_count(0), recording(0), playback(0), next_command(0), lockstep(0), unit_threads(Profile::getInstance()->getUnitThreads()) {
+    PathingGrid::Change_Callback_Type callback = std::bind(&UnitManager::onPathingChanged, this,
+        std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4);
+    change_callback_id = ground.getPathingGrid().addChangeCallback(callback);
+
+    // Unit queries are bucketed over the same area the pathing covers
+    PathingGrid& grid = ground.getPathingGrid();
+    units.getSpatialHash().setBounds(grid.getStartX(), grid.getStartZ(), grid.getWidth(), grid.getDepth());
+    units.getVisibility().setGround(ground, Profile::getInstance()->isFogOcclusionOn());
+}
+
+UnitManager::~UnitManager(){
+    ground->getPathingGrid().removeChangeCallback(change_callback_id);
 }
 
 void UnitManager::issueOrder(Playable::Order order, glm::vec3 target, bool should_enqueue){
+    // The replay is the one giving orders
+    if(playback){
+        return;
+    }
 
-    // even shorter circuit for "not my unit, can't command it".
+    if(recording){
+        recording->addOrder(step_count, order, target, should_enqueue);
+    }
 
-    // short circuit for stop and hold position
-    // No need to path!
+    // Everyone carries it out together a few turns from now, and only for
+    // the units that are ours. The selection only goes over when it's
+    // changed since the last order.
+    if(lockstep){
+        LockstepSession::Command select;
+        select.type = LockstepSession::Command::Type::SELECT;
+        for(int handle : selected_units){
+            Playable* unit = unit_holder->findUnit(handle);
+            if(unit && unit->getTeam() == lockstep->getTeam()){
+                select.unit_ids.push_back(handle);
+            }
+        }
 
-    // We need to decide if it's targeting a unit with this command or not
-    Playable* targeted_unit = 0;
+        if(select.unit_ids.empty()){
+            return;
+        }
+
+        if(select.unit_ids != lockstep_sent_selection){
+            if(!lockstep->queueCommand(select)){
+                Debug::warning("Lockstep turn is full, order dropped.\n");
+                return;
+            }
+            lockstep_sent_selection = select.unit_ids;
+        }
+
+        LockstepSession::Command command;
+        command.type = LockstepSession::Command::Type::ORDER;
+        command.order = order;
+        command.target = target;
+        command.should_enqueue = should_enqueue;
+        if(!lockstep->queueCommand(command)){
+            Debug::warning("Lockstep turn is full, order dropped.\n");
+        }
+        return;
+    }
 
-    vector<Playable>& all_units = unit_holder->getUnits();
+    giveOrder(selected_units, order, target, should_enqueue);
+}
 
-    // Check all the other playables to see if one is the target
-    for(int i = 0; i < all_units.size(); ++i){
-        glm::vec3 unit_pos = all_units[i].getPosition();
-        float click_distance_from_unit = getDistance(unit_pos.x, unit_pos.z, target.x, target.z);
+void UnitManager::giveOrder(vector<int>& unit_handles, Playable::Order order, glm::vec3 target, bool should_enqueue){
 
-        if(click_distance_from_unit < all_units[i].getRadius()){
-            targeted_unit = &all_units[i];
+    // Only the ones still alive
+    vector<Playable*> units;
+    for(int handle : unit_handles){
+        Playable* unit = unit_holder->findUnit(handle);
+        if(unit){
+            units.push_back(unit);
         }
     }
+
+    // even shorter circuit for "not my unit, can't command it".
+
+    // short circuit for stop and hold position
+    // No need to path!
+
+    // We need to decide if it's targeting a unit with this command or not
+    int targeted_unit = findClickedUnit(target);
     // Debug::info("Selected all_units size: %d\n", selected_units.size());
 
     // If it's only one unit
     float x_center, z_center, smallest_radius;
-    if (selected_units.size() != 0){
-        x_center = selected_units[0]->getPosition().x;
-        z_center = selected_units[0]->getPosition().z;
-        smallest_radius = selected_units[0]->getRadius();
+    if (units.size() != 0){
+        x_center = units[0]->getPosition().x;
+        z_center = units[0]->getPosition().z;
+        smallest_radius = units[0]->getRadius();
     } else {
         // Short circuit for bug when the selected all_units is empty
         return;
@@ -43,150 +111,942 @@ void UnitManager::issueOrder(Playable::Order order, glm::vec3 target, bool shoul
     float max_distance = 0.0f;
 
     // If there is more than one unit, setup the magic box
-    if(selected_units.size() > 1){
+    if(units.size() > 1){
         float x_sum = 0.0f;
         float z_sum = 0.0f;
 
-        for(int i = 0; i < selected_units.size(); ++i){
-            glm::vec3 unit_pos = selected_units[i]->getPosition();
+        for(int i = 0; i < units.size(); ++i){
+            glm::vec3 unit_pos = units[i]->getPosition();
             x_sum += unit_pos.x;
             z_sum += unit_pos.z;
         }
 
-        x_center = x_sum / selected_units.size();
-        z_center = z_sum / selected_units.size();
+        x_center = x_sum / units.size();
+        z_center = z_sum / units.size();
 
-        for(int i = 0; i < selected_units.size(); ++i){
+        for(int i = 0; i < units.size(); ++i){
 
-            glm::vec3 unit_pos = selected_units[i]->getPosition();
+            glm::vec3 unit_pos = units[i]->getPosition();
             float distance = getDistance(unit_pos.x, unit_pos.z, x_center, z_center);
 
             if(distance > max_distance){
                 max_distance = distance;
             }
 
-            if(selected_units[i]->getRadius() < smallest_radius){
-                smallest_radius = selected_units[i]->getRadius();
+            if(units[i]->getRadius() < smallest_radius){
+                smallest_radius = units[i]->getRadius();
             }
         }
 
         click_distance = getDistance(target.x, target.z, x_center, z_center);
     }
 
-    // Start logging the pathfinding time
-    float start_time = GameClock::getInstance()->getCurrentTime();
+    // Big groups that aren't queueing share a flow field, which doesn't care
+    // how spread out they are. Everyone else shares a path from the centre.
+    bool uses_flow_field = !should_enqueue && units.size() >= FLOW_FIELD_MIN_UNITS;
 
-    // Create the path for all all_units in the selection
-    vector<glm::vec3> path = pathfinder.find_path(int(x_center), int(z_center), int(target.x), int(target.z), smallest_radius);
+    shared_ptr<FlowField> field;
+    if(uses_flow_field){
+        field = flow_fields.find(int(target.x), int(target.z), PathingGrid::getClearanceClass(smallest_radius));
+    }
 
-    // End logging and report
-    float delta_time = GameClock::getInstance()->getCurrentTime() - start_time;
-    Debug::info("Took %.2f seconds to find the path.\n", delta_time);
+    // Ask for the path (or field) for all the units in the selection. It
+    // arrives on a later tick, see deliverPaths.
+    PendingOrder pending;
+    if(field){
+        pending.ticket = 0;
+    } else if(uses_flow_field){
+        pending.ticket = path_service.requestFlowField(int(target.x), int(target.z), smallest_radius);
+    } else {
+        pending.ticket = path_service.requestPath(int(x_center), int(z_center), int(target.x), int(target.z), smallest_radius);
+    }
+    pending.uses_flow_field = uses_flow_field;
+    pending.order = order;
+    pending.should_enqueue = should_enqueue;
+    pending.targeted_unit = targeted_unit;
+    pending.start = glm::vec3(int(x_center), 0.0f, int(z_center));
+    pending.target = target;
+    pending.radius = smallest_radius;
+    pending.has_partial_path = false;
+    pending.pathing_changes = pathing_changes;
 
-    // Issue the appropriate order
-    for(int i = 0; i < selected_units.size(); ++i){
+    for(int i = 0; i < units.size(); ++i){
 
         float x_to_move = target.x;
         float z_to_move = target.z;
-        glm::vec3 unit_pos = selected_units[i]->getPosition();
+        glm::vec3 unit_pos = units[i]->getPosition();
 
         if(click_distance > max_distance){
             x_to_move += (unit_pos.x - x_center);
             z_to_move += (unit_pos.z - z_center);
         }
 
-        selected_units[i]->receiveOrder(order, glm::vec3(x_to_move, 0.0f, z_to_move), should_enqueue, path, targeted_unit);
+        pending.units.push_back(units[i]->getHandle());
+        pending.targets.push_back(glm::vec3(x_to_move, 0.0f, z_to_move));
+    }
+
+    // Repairing a route re-issues it, which would wipe out anything queued
+    // after it, so units leave their route on any new order
+    removeFromRoutes(pending.units);
+
+    if(!should_enqueue){
+        // This order replaces whatever these units were waiting on
+        for(PendingOrder& earlier : pending_orders){
+            for(int i = earlier.units.size() - 1; i >= 0; --i){
+                if(std::find(pending.units.begin(), pending.units.end(), earlier.units[i]) != pending.units.end()){
+                    earlier.units.erase(earlier.units.begin() + i);
+                    earlier.targets.erase(earlier.targets.begin() + i);
+                }
+            }
+        }
+
+        // Head straight for the target until the real path shows up
+        for(int i = 0; i < pending.units.size(); ++i){
+            if(field){
+                units[i]->receiveFlowFieldOrder(order, pending.targets[i], field, targeted_unit);
+            } else {
+                units[i]->receiveOrder(order, pending.targets[i], false, vector<glm::vec3>(), targeted_unit);
+            }
+        }
+    }
+
+    // Someone is still following a field to this spot, nothing to wait for
+    if(field){
+        vector<glm::vec3> no_path;
+        trackRoute(pending, no_path);
+        return;
     }
 
+    pending_orders.push_back(pending);
+
 }
 
-void UnitManager::selectUnit(glm::vec3 click){
+void UnitManager::deliverPaths(){
+    while(!pending_orders.empty()){
+        PendingOrder& pending = pending_orders.front();
 
-    vector<Playable*> selected_units_copy = selected_units;
-    selected_units.clear();
+        if(pending.uses_flow_field){
+            shared_ptr<FlowField> field;
+            if(!path_service.takeFlowField(pending.ticket, field)){
+                break;
+            }
 
-    float nearest = FLT_MAX;
-    Playable* nearest_playable = 0;
+            flow_fields.insert(field);
 
-    vector<Playable>& all_units = unit_holder->getUnits();
+            for(int i = 0; i < pending.units.size(); ++i){
+                Playable* unit = unit_holder->findUnit(pending.units[i]);
+                if(unit){
+                    unit->receiveFlowFieldOrder(pending.order, pending.targets[i], field, pending.targeted_unit);
+                }
+            }
 
-    for(int i = 0; i < all_units.size(); ++i){
+            vector<glm::vec3> no_path;
+            trackRoute(pending, no_path);
 
-        glm::vec3 unit_pos = all_units[i].getPosition();
-        float distance = getDistance(unit_pos.x, unit_pos.z, click.x, click.z);
+            // Built before an edit, so have it checked like any other route
+            if(pending.pathing_changes != pathing_changes){
+                pathing_changed = true;
+            }
 
-        if( distance < all_units[i].getRadius() && distance < nearest){
-            nearest = distance;
-            nearest_playable = &all_units[i];
-        } else {
-            all_units[i].deSelect();
+            pending_orders.pop_front();
+            continue;
+        }
+
+        vector<glm::vec3> path;
+        if(!path_service.takeResult(pending.ticket, path)){
+            break;
+        }
+
+        for(int i = 0; i < pending.units.size(); ++i){
+            Playable* unit = unit_holder->findUnit(pending.units[i]);
+            if(unit){
+                unit->receiveOrder(pending.order, pending.targets[i], pending.should_enqueue, path, pending.targeted_unit);
+            }
+        }
+
+        if(!path.empty()){
+            trackRoute(pending, path);
+        }
+
+        if(pending.pathing_changes != pathing_changes){
+            pathing_changed = true;
+        }
+
+        pending_orders.pop_front();
+    }
+}
+
+void UnitManager::trackRoute(PendingOrder& pending, vector<glm::vec3>& path){
+    // Keep an eye on it in case the grid changes under the units
+    if(pending.should_enqueue || pending.units.empty()){
+        return;
+    }
+
+    ActiveRoute route;
+    route.uses_flow_field = pending.uses_flow_field;
+    route.order = pending.order;
+    route.targeted_unit = pending.targeted_unit;
+    route.units = pending.units;
+    route.targets = pending.targets;
+    route.target = pending.target;
+    route.radius = pending.radius;
+    route.goal = path.empty() ? pending.target : path.back();
+    route.start = pending.start;
+    route.path = path;
+    route.repairing = false;
+    active_routes.push_back(route);
+}
+
+void UnitManager::deliverPartialPaths(){
+    // Time sliced searches can take a few frames. Meanwhile the units follow
+    // the best path found so far rather than a straight line.
+    vector<glm::vec3> path;
+
+    for(PendingOrder& pending : pending_orders){
+        if(pending.uses_flow_field || pending.should_enqueue || pending.units.empty()){
+            continue;
+        }
+
+        if(!path_service.getPartialPath(pending.ticket, path) || path.empty()){
+            continue;
+        }
+
+        // Every new order turns the units again, so only re-issue it once
+        // the way they should be heading has changed
+        if(pending.has_partial_path && path.front() == pending.partial_first_step){
+            continue;
+        }
+        pending.has_partial_path = true;
+        pending.partial_first_step = path.front();
+
+        // The last waypoint is swapped for the target on delivery, but here
+        // it's only the closest point yet and should be walked through
+        path.push_back(path.back());
+
+        for(int i = 0; i < pending.units.size(); ++i){
+            Playable* unit = unit_holder->findUnit(pending.units[i]);
+            if(unit){
+                unit->receiveOrder(pending.order, pending.targets[i], false, path, pending.targeted_unit);
+            }
+        }
+    }
+}
+
+void UnitManager::removeFromRoutes(vector<int>& units){
+    for(int r = active_routes.size() - 1; r >= 0; --r){
+        ActiveRoute& route = active_routes[r];
+
+        for(int i = route.units.size() - 1; i >= 0; --i){
+            if(std::find(units.begin(), units.end(), route.units[i]) != units.end()){
+                route.units.erase(route.units.begin() + i);
+                route.targets.erase(route.targets.begin() + i);
+            }
         }
+
+        if(route.units.empty()){
+            active_routes.erase(active_routes.begin() + r);
+        }
+    }
+}
+
+void UnitManager::onPathingChanged(int min_x, int min_z, int max_x, int max_z){
+    // Routes are checked once per tick, however many edits there were
+    pathing_changed = true;
+    pathing_changes++;
+}
+
+void UnitManager::repairRoutes(){
+    bool check_paths = pathing_changed;
+    pathing_changed = false;
+    routes_repairing = false;
+
+    PathingGrid& grid = ground->getPathingGrid();
+    int nodes_left = REPAIR_NODES_PER_STEP;
+
+    for(int r = active_routes.size() - 1; r >= 0; --r){
+        ActiveRoute& route = active_routes[r];
+
+        // Units that already got there (or died on the way) don't need the
+        // route any more
+        for(int i = route.units.size() - 1; i >= 0; --i){
+            Playable* unit = unit_holder->findUnit(route.units[i]);
+            if(!unit || unit->isIdle()){
+                route.units.erase(route.units.begin() + i);
+                route.targets.erase(route.targets.begin() + i);
+            }
+        }
+
+        if(route.units.empty()){
+            active_routes.erase(active_routes.begin() + r);
+            continue;
+        }
+
+        // Any edit can change distances all over a field. The units keep
+        // the one they have until a new one for the same goal arrives, and
+        // deliverPaths keeps an eye on that one instead.
+        if(route.uses_flow_field){
+            if(!check_paths){
+                continue;
+            }
+
+            PendingOrder pending;
+            pending.ticket = path_service.requestFlowField(int(route.target.x), int(route.target.z), route.radius);
+            pending.uses_flow_field = true;
+            pending.order = route.order;
+            pending.should_enqueue = false;
+            pending.targeted_unit = route.targeted_unit;
+            pending.units = route.units;
+            pending.targets = route.targets;
+            pending.start = route.start;
+            pending.target = route.target;
+            pending.radius = route.radius;
+            pending.has_partial_path = false;
+            pending.pathing_changes = pathing_changes;
+            pending_orders.push_back(pending);
+
+            active_routes.erase(active_routes.begin() + r);
+            continue;
+        }
+
+        // Is every leg of the route still walkable? A repair under way takes
+        // the edit in and carries on from where the group is now.
+        if(check_paths || (route.repairing && !route.planner)){
+            int clearance = PathingGrid::getClearanceClass(route.radius);
+            bool blocked = route.repairing;
+            glm::vec3 previous = route.start;
+
+            for(int i = 0; i < route.path.size() && !blocked; ++i){
+                if(!grid.canPathOnLine(previous.x, previous.z, route.path[i].x, route.path[i].z, clearance)){
+                    blocked = true;
+                }
+                previous = route.path[i];
+            }
+
+            if(!blocked && !grid.canPathOnLine(previous.x, previous.z, route.goal.x, route.goal.z, clearance)){
+                blocked = true;
+            }
+
+            if(blocked){
+                startRepair(route);
+            }
+        }
+
+        // Repairs share the step's budget, whatever is left over waits for
+        // the next step
+        if(!route.repairing || nodes_left <= 0){
+            routes_repairing = routes_repairing || route.repairing;
+            continue;
+        }
+
+        bool finished = route.planner->continuePath(nodes_left);
+        nodes_left -= route.planner->getNodesExpanded();
+
+        if(!finished){
+            routes_repairing = true;
+            continue;
+        }
+        route.repairing = false;
+
+        vector<glm::vec3> path = route.planner->getPath();
+
+        // Nowhere better to send them, let them walk up to the obstacle
+        if(path.empty()){
+            continue;
+        }
+
+        route.path = path;
+
+        for(int i = 0; i < route.units.size(); ++i){
+            unit_holder->findUnit(route.units[i])->receiveOrder(route.order, route.targets[i], false, path, route.targeted_unit);
+        }
+    }
+}
+
+void UnitManager::startRepair(ActiveRoute& route){
+    // Plan again from the middle of the group, like the original order
+    float x_sum = 0.0f;
+    float z_sum = 0.0f;
+
+    for(int i = 0; i < route.units.size(); ++i){
+        glm::vec3 unit_pos = unit_holder->findUnit(route.units[i])->getPosition();
+        x_sum += unit_pos.x;
+        z_sum += unit_pos.z;
+    }
+
+    float x_center = x_sum / route.units.size();
+    float z_center = z_sum / route.units.size();
+
+    // The edit may have cut the target off, or opened the way to it again
+    PathingGrid& grid = ground->getPathingGrid();
+    glm::vec3 goal = route.target;
+    if(!grid.findReachableTarget(x_center, z_center, goal.x, goal.z, PathingGrid::getClearanceClass(route.radius))){
+        route.repairing = false;
+        return;
+    }
+
+    // The planner only keeps its search for the same goal, which it holds
+    // on the ground
+    if(route.planner && route.planner->getTarget() == glm::vec3(goal.x, 0.0f, goal.z)){
+        route.planner->moveStart(x_center, z_center);
+    } else {
+        if(!route.planner){
+            route.planner = make_shared<IncrementalPathFinder>(grid);
+        }
+        route.planner->startPath(x_center, z_center, goal.x, goal.z, route.radius);
+    }
+
+    route.goal = goal;
+    route.start = glm::vec3(x_center, 0.0f, z_center);
+    route.repairing = true;
+}
+
+int UnitManager::findClickedUnit(glm::vec3 click){
+    // The nearest playable the click landed on, if any. A click further
+    // than the biggest radius from a unit can't be on it.
+    SpatialHash& spatial_hash = unit_holder->getSpatialHash();
+    vector<int> clicked;
+    spatial_hash.findNearest(click.x, click.z, 1, spatial_hash.getMaxUnitRadius(), clicked, [this, click](int unit){
+        float distance = getDistance(unit_holder->getPositionX(unit), unit_holder->getPositionZ(unit), click.x, click.z);
+        return distance < unit_holder->getRadius(unit);
+    });
+
+    if(clicked.empty()){
+        return UnitHolder::NO_HANDLE;
+    }
+    return unit_holder->getHandle(clicked[0]);
+}
+
+void UnitManager::selectUnit(glm::vec3 click){
+    if(playback){
+        return;
+    }
+
+    vector<int> selected_units_copy = selected_units;
+    selected_units.clear();
+
+    int nearest_playable = findClickedUnit(click);
+
+    // Only the units that were selected need telling they aren't any more
+    for(int i = 0; i < selected_units_copy.size(); ++i){
+        unit_holder->findUnit(selected_units_copy[i])->deSelect();
+    }
+
+    for(int i = 0; i < temp_selected_units.size(); ++i){
+        unit_holder->findUnit(temp_selected_units[i])->tempDeSelect();
     }
+    temp_selected_units.clear();
 
     // If we found one that was clicked on and is the nearest
-    if(nearest_playable){
-        nearest_playable->select();
+    if(nearest_playable != UnitHolder::NO_HANDLE){
+        unit_holder->findUnit(nearest_playable)->select();
         selected_units.push_back(nearest_playable);
     } else {
         selected_units = selected_units_copy;
 
         for(int i = 0; i < selected_units.size(); ++i){
-            selected_units[i]->select();
+            unit_holder->findUnit(selected_units[i])->select();
         }
     }
+
+    recordSelection();
 }
 
 void UnitManager::selectUnits(glm::vec3 coord_a, glm::vec3 coord_b){
-    vector<Playable*> selected_units_copy = selected_units;
-    selected_units.clear();
-
-    float left = min(coord_a.x, coord_b.x);
-    float right = max(coord_a.x, coord_b.x);
+    if(playback){
+        return;
+    }
 
-    float down = min(coord_a.z, coord_b.z);
-    float up = max(coord_a.z, coord_b.z);
+    vector<int> selected_units_copy = selected_units;
+    selected_units.clear();
 
-    vector<Playable>& all_units = unit_holder->getUnits();
+    for(int i = 0; i < selected_units_copy.size(); ++i){
+        unit_holder->findUnit(selected_units_copy[i])->deSelect();
+    }
 
-    for(int i = 0; i < all_units.size(); ++i){
-        if(all_units[i].isTempSelected()){
-            all_units[i].select();
-            all_units[i].tempDeSelect();
-            selected_units.push_back(&all_units[i]);
-        } else {
-            all_units[i].deSelect();
-        }
+    // The box was last seen by tempSelectUnits, take what it picked
+    for(int i = 0; i < temp_selected_units.size(); ++i){
+        Playable* unit = unit_holder->findUnit(temp_selected_units[i]);
+        unit->select();
+        unit->tempDeSelect();
+        selected_units.push_back(temp_selected_units[i]);
     }
+    temp_selected_units.clear();
 
     if(selected_units.size() == 0){
         selected_units = selected_units_copy;
 
         for(int i = 0; i < selected_units.size(); ++i){
-            selected_units[i]->select();
+            unit_holder->findUnit(selected_units[i])->select();
         }
     }
 
+    recordSelection();
 }
 
 void UnitManager::tempSelectUnits(glm::vec3 coord_a, glm::vec3 coord_b){
+    if(playback){
+        return;
+    }
+
     float left = min(coord_a.x, coord_b.x);
     float right = max(coord_a.x, coord_b.x);
 
     float down = min(coord_a.z, coord_b.z);
     float up = max(coord_a.z, coord_b.z);
 
-    vector<Playable>& all_units = unit_holder->getUnits();
+    // Runs every frame of a drag, so only the units in or near the box and
+    // the ones it held last frame are touched
+    for(int i = 0; i < temp_selected_units.size(); ++i){
+        unit_holder->findUnit(temp_selected_units[i])->tempDeSelect();
+    }
+
+    vector<int> in_box;
+    unit_holder->getSpatialHash().findInBox(left, down, right, up, in_box);
+
+    temp_selected_units.clear();
+    for(int i = 0; i < in_box.size(); ++i){
+        Playable& unit = unit_holder->getUnit(in_box[i]);
+        unit.tempSelect();
+        temp_selected_units.push_back(unit.getHandle());
+    }
+}
+
+void UnitManager::recordSelection(){
+    if(!recording){
+        return;
+    }
+
+    // What ended up selected, so playing it back doesn't depend on the box
+    // or the click
+    recording->addSelection(step_count, selected_units);
+}
+
+void UnitManager::setSelection(vector<int>& unit_handles){
+    for(int i = 0; i < selected_units.size(); ++i){
+        unit_holder->findUnit(selected_units[i])->deSelect();
+    }
+    selected_units.clear();
+
+    for(int i = 0; i < temp_selected_units.size(); ++i){
+        unit_holder->findUnit(temp_selected_units[i])->tempDeSelect();
+    }
+    temp_selected_units.clear();
+
+    for(int handle : unit_handles){
+        Playable* unit = unit_holder->findUnit(handle);
+        if(unit){
+            unit->select();
+            selected_units.push_back(handle);
+        }
+    }
+}
+
+void UnitManager::forgetRemovedUnits(){
+    auto is_removed = [this](int handle){
+        return !unit_holder->findUnit(handle);
+    };
+
+    selected_units.erase(std::remove_if(selected_units.begin(), selected_units.end(), is_removed), selected_units.end());
+    temp_selected_units.erase(std::remove_if(temp_selected_units.begin(), temp_selected_units.end(), is_removed), temp_selected_units.end());
+}
+
+void UnitManager::startLockstep(LockstepSession& session){
+    lockstep = &session;
+}
+
+bool UnitManager::startLockstepTurn(){
+    int turn = step_count / LockstepSession::TURN_STEPS;
+    if(!lockstep->waitForTurn(turn)){
+        return false;
+    }
+
+    vector<LockstepSession::Command> commands = lockstep->takeTurn(turn);
+
+    for(LockstepSession::Command& command : commands){
+        vector<int>& selection = lockstep_selections[command.team];
+
+        if(command.type == LockstepSession::Command::Type::SELECT){
+            // A player can't order someone else's units, whatever they send
+            selection.clear();
+            for(int handle : command.unit_ids){
+                Playable* unit = unit_holder->findUnit(handle);
+                if(unit && unit->getTeam() == command.team){
+                    selection.push_back(handle);
+                }
+            }
+            continue;
+        }
+
+        vector<int> unit_handles = selection;
+        giveOrder(unit_handles, command.order, command.target, command.should_enqueue);
+    }
+
+    return true;
+}
+
+bool UnitManager::saveSnapshot(string filename){
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    int unit_count = unit_holder->getUnitCount();
+
+    Snapshot snapshot;
+    snapshot.reserve(size_t(unit_count) * SNAPSHOT_BYTES_PER_UNIT);
+
+    snapshot.write(SNAPSHOT_MAGIC);
+    snapshot.write(SNAPSHOT_VERSION);
+    snapshot.write(SNAPSHOT_BYTE_ORDER);
+    snapshot.write(1.5f);
+
+    snapshot.write(int64_t(step_count));
+    snapshot.write(int64_t(GameClock::getInstance()->getSimulationSteps()));
+
+    // Each field once, however many units follow it. Units only save which
+    // one they follow.
+    vector<shared_ptr<FlowField>> fields;
+    for(int id = 0; id < unit_count; ++id){
+        shared_ptr<FlowField> field = unit_holder->getUnit(id).getFlowField();
+        if(field && std::find(fields.begin(), fields.end(), field) == fields.end()){
+            fields.push_back(field);
+        }
+    }
+
+    snapshot.write(uint32_t(fields.size()));
+    for(shared_ptr<FlowField>& field : fields){
+        field->saveState(snapshot);
+    }
+
+    unit_holder->saveSlots(snapshot);
+
+    for(int id = 0; id < unit_count; ++id){
+        unit_holder->getUnit(id).saveState(snapshot);
+    }
+
+    snapshot.write(uint32_t(pending_orders.size()));
+    for(PendingOrder& pending : pending_orders){
+        snapshot.write(pending.uses_flow_field);
+        snapshot.write(uint8_t(pending.order));
+        snapshot.write(pending.should_enqueue);
+        snapshot.write(pending.targeted_unit);
+        snapshot.writeVector(pending.units);
+        snapshot.writeVector(pending.targets);
+        snapshot.write(pending.start);
+        snapshot.write(pending.target);
+        snapshot.write(pending.radius);
+    }
+
+    snapshot.write(uint32_t(active_routes.size()));
+    for(ActiveRoute& route : active_routes){
+        snapshot.write(route.uses_flow_field);
+        snapshot.write(uint8_t(route.order));
+        snapshot.write(route.targeted_unit);
+        snapshot.writeVector(route.units);
+        snapshot.writeVector(route.targets);
+        snapshot.write(route.target);
+        snapshot.write(route.radius);
+        snapshot.write(route.goal);
+        snapshot.write(route.start);
+        snapshot.writeVector(route.path);
+        snapshot.write(route.repairing);
+    }
+
+    snapshot.write(SNAPSHOT_END);
+
+    if(!snapshot.save(filename)){
+        return false;
+    }
+
+    std::chrono::duration<double, std::milli> time_taken = std::chrono::steady_clock::now() - start;
+    Debug::info("Saved %d units to %s in %.1f ms.\n", unit_count, filename.c_str(), time_taken.count());
+    return true;
+}
+
+bool UnitManager::loadSnapshot(string filename){
+    if(recording || playback || lockstep){
+        Debug::error("Can't load a snapshot while replaying or in a lockstep game.\n");
+        return false;
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    Snapshot snapshot;
+    if(!snapshot.load(filename)){
+        return false;
+    }
+
+    uint32_t magic = 0;
+    uint32_t version = 0;
+    uint32_t byte_order = 0;
+    float float_check = 0.0f;
+    int64_t saved_step_count = 0;
+    int64_t simulation_steps = 0;
+
+    snapshot.read(magic);
+    snapshot.read(version);
+    snapshot.read(byte_order);
+    snapshot.read(float_check);
+    snapshot.read(saved_step_count);
+    snapshot.read(simulation_steps);
+
+    // Check everything that can be checked before changing anything
+    if(!snapshot.isGood() || magic != SNAPSHOT_MAGIC || !snapshot.endsWith(SNAPSHOT_END)){
+        Debug::error("%s is not a whole snapshot.\n", filename.c_str());
+        return false;
+    }
+
+    if(version != SNAPSHOT_VERSION){
+        Debug::error("Snapshot %s is version %u, expected %u.\n", filename.c_str(), version, SNAPSHOT_VERSION);
+        return false;
+    }
+
+    if(byte_order != SNAPSHOT_BYTE_ORDER || float_check != 1.5f){
+        Debug::error("Snapshot %s was saved on a different kind of machine.\n", filename.c_str());
+        return false;
+    }
+
+    // Everything is read into these first, and only once the whole file has
+    // been read and checked does any of it replace what's there
+    PathingGrid& grid = ground->getPathingGrid();
+    vector<shared_ptr<FlowField>> fields;
+
+    uint32_t field_count = 0;
+    snapshot.read(field_count);
+
+    for(uint32_t i = 0; i < field_count && snapshot.isGood(); ++i){
+        shared_ptr<FlowField> field = FlowField::loadState(snapshot, grid);
+        if(field){
+            fields.push_back(field);
+        }
+    }
+
+    UnitHolder::SavedSlots slots;
+    if(!snapshot.isGood() || !unit_holder->readSlots(snapshot, slots)){
+        Debug::error("Snapshot %s has a broken unit list.\n", filename.c_str());
+        return false;
+    }
+
+    // A unit follows one of the saved fields, or one for the same goal is
+    // built for it. Either way it's only kept if the load goes through.
+    Playable::Flow_Field_Source_Type flow_field_source = [&fields, &grid](int goal_x, int goal_z, int clearance) -> shared_ptr<FlowField> {
+        FlowField::clampGoal(grid, goal_x, goal_z);
+        for(shared_ptr<FlowField>& field : fields){
+            if(field->getGoalX() == goal_x && field->getGoalZ() == goal_z && field->getClearance() == clearance){
+                return field;
+            }
+        }
+        fields.push_back(make_shared<FlowField>(grid, goal_x, goal_z, clearance));
+        return fields.back();
+    };
+
+    // Each unit is loaded into a copy of the one that will be in its place,
+    // or of the first one if it has died since. None of them should look
+    // selected, the same ones are picked again afterwards.
+    int unit_count = slots.handles.size();
+    vector<Playable> loaded_units;
+    loaded_units.reserve(unit_count);
+
+    for(int id = 0; id < unit_count && snapshot.isGood(); ++id){
+        loaded_units.push_back(unit_holder->getUnit(id < unit_holder->getUnitCount() ? id : 0));
+
+        Playable& unit = loaded_units.back();
+        unit.deSelect();
+        unit.tempDeSelect();
+        unit.loadState(snapshot, flow_field_source);
+    }
+
+    deque<PendingOrder> loaded_orders;
+
+    uint32_t pending_count = 0;
+    snapshot.read(pending_count);
+
+    for(uint32_t i = 0; i < pending_count && snapshot.isGood(); ++i){
+        PendingOrder pending;
+        uint8_t order = 0;
+
+        snapshot.read(pending.uses_flow_field);
+        snapshot.read(order);
+        snapshot.read(pending.should_enqueue);
+        snapshot.read(pending.targeted_unit);
+        snapshot.readVector(pending.units);
+        snapshot.readVector(pending.targets);
+        snapshot.read(pending.start);
+        snapshot.read(pending.target);
+        snapshot.read(pending.radius);
+
+        if(!snapshot.isGood()){
+            break;
+        }
+
+        if(pending.units.size() != pending.targets.size() || order > uint8_t(Playable::Order::STOP)){
+            Debug::error("Snapshot %s has a broken order.\n", filename.c_str());
+            return false;
+        }
+
+        pending.order = Playable::Order(order);
+        pending.has_partial_path = false;
+        pending.pathing_changes = pathing_changes;
+
+        loaded_orders.push_back(pending);
+    }
+
+    vector<ActiveRoute> loaded_routes;
+
+    uint32_t route_count = 0;
+    snapshot.read(route_count);
+
+    for(uint32_t i = 0; i < route_count && snapshot.isGood(); ++i){
+        ActiveRoute route;
+        uint8_t order = 0;
+
+        snapshot.read(route.uses_flow_field);
+        snapshot.read(order);
+        snapshot.read(route.targeted_unit);
+        snapshot.readVector(route.units);
+        snapshot.readVector(route.targets);
+        snapshot.read(route.target);
+        snapshot.read(route.radius);
+        snapshot.read(route.goal);
+        snapshot.read(route.start);
+        snapshot.readVector(route.path);
+        snapshot.read(route.repairing);
+
+        if(!snapshot.isGood()){
+            break;
+        }
+
+        if(route.units.size() != route.targets.size() || order > uint8_t(Playable::Order::STOP)){
+            Debug::error("Snapshot %s has a broken route.\n", filename.c_str());
+            return false;
+        }
+
+        route.order = Playable::Order(order);
+        loaded_routes.push_back(route);
+    }
+
+    uint32_t end = 0;
+    snapshot.read(end);
+
+    if(!snapshot.isGood() || end != SNAPSHOT_END){
+        Debug::error("Snapshot %s ended early, nothing was loaded.\n", filename.c_str());
+        return false;
+    }
+
+    // The old orders' searches are still queued. Wait them out and throw
+    // the results away, or they'd be kept for tickets nobody takes.
+    path_service.finishAll();
+
+    for(PendingOrder& pending : pending_orders){
+        vector<glm::vec3> path;
+        shared_ptr<FlowField> field;
+        if(pending.uses_flow_field){
+            path_service.takeFlowField(pending.ticket, field);
+        } else {
+            path_service.takeResult(pending.ticket, path);
+        }
+    }
+
+    vector<int> selection = selected_units;
+    vector<int> no_selection;
+    setSelection(no_selection);
+
+    for(shared_ptr<FlowField>& field : fields){
+        flow_fields.insert(field);
+    }
+
+    unit_holder->loadSlots(slots, loaded_units);
+
+    for(int id = 0; id < unit_count; ++id){
+        unit_holder->moveUnit(id);
+    }
+
+    // Stamps only depend on the cell a unit is in, so this is what the saved
+    // game saw too
+    unit_holder->getVisibility().update(*unit_holder);
+
+    setSelection(selection);
+
+    // Anything still on its way was asked for before the save, ask again
+    pending_orders = loaded_orders;
+
+    for(PendingOrder& pending : pending_orders){
+        if(pending.uses_flow_field){
+            pending.ticket = path_service.requestFlowField(int(pending.target.x), int(pending.target.z), pending.radius);
+        } else {
+            pending.ticket = path_service.requestPath(pending.start.x, pending.start.z, int(pending.target.x), int(pending.target.z), pending.radius);
+        }
+    }
+
+    // The search isn't saved, a repair under way starts again
+    active_routes = loaded_routes;
+    routes_repairing = false;
+
+    for(ActiveRoute& route : active_routes){
+        routes_repairing = routes_repairing || route.repairing;
+    }
+
+    step_count = long(saved_step_count);
+    GameClock::getInstance()->setSimulationSteps(long(simulation_steps));
+
+    std::chrono::duration<double, std::milli> time_taken = std::chrono::steady_clock::now() - start;
+    Debug::info("Loaded %d units from %s in %.1f ms.\n", unit_count, filename.c_str(), time_taken.count());
+    return true;
+}
+
+void UnitManager::startRecording(Replay& replay){
+    recording = &replay;
+    playback = 0;
+}
+
+void UnitManager::startPlayback(Replay& replay){
+    playback = &replay;
+    recording = 0;
+    next_command = 0;
+
+    step_times.clear();
+    step_times.reserve(max(replay.getStepCount() - step_count, 0L));
+}
+
+bool UnitManager::isPlaybackFinished(){
+    return playback && step_count >= playback->getStepCount();
+}
 
-    for(int i = 0; i < all_units.size(); ++i){
-        glm::vec3 unit_pos = all_units[i].getPosition();
-        float radius = all_units[i].getRadius();
+void UnitManager::playCommands(){
+    vector<Replay::Command>& commands = playback->getCommands();
 
-        if(left - radius < unit_pos.x && right + radius > unit_pos.x && down - radius < unit_pos.z && up + radius > unit_pos.z){
-            all_units[i].tempSelect();
+    // Everything made before this step, in the order it was made
+    while(next_command < commands.size() && commands[next_command].step <= step_count){
+        Replay::Command& command = commands[next_command];
+
+        if(command.type == Replay::Type::SELECT){
+            setSelection(command.unit_ids);
         } else {
-            all_units[i].tempDeSelect();
+            giveOrder(selected_units, command.order, command.target, command.should_enqueue);
         }
+
+        next_command++;
+    }
+}
+
+void UnitManager::printPlaybackReport(){
+    vector<double> sorted_times = step_times;
+    std::sort(sorted_times.begin(), sorted_times.end());
+
+    auto percentile = [&sorted_times](double fraction){
+        if(sorted_times.empty()){
+            return 0.0;
+        }
+        int index = min(int(sorted_times.size() * fraction), int(sorted_times.size()) - 1);
+        return sorted_times[index];
+    };
+
+    double total = 0.0;
+    for(double step_time : sorted_times){
+        total += step_time;
     }
+
+    printf("{\"steps\": %d, \"total_ms\": %.3f, \"p50_step_ms\": %.3f, \"p90_step_ms\": %.3f, "
+           "\"p99_step_ms\": %.3f, \"max_step_ms\": %.3f, \"checksum\": \"%016" PRIx64 "\"}\n",
+           int(sorted_times.size()), total, percentile(0.5), percentile(0.9), percentile(0.99),
+           sorted_times.empty() ? 0.0 : sorted_times.back(), unit_holder->getChecksum());
 }
 
 float UnitManager::getDistance(float a1, float a2, float b1, float b2){
@@ -195,10 +1055,92 @@ float UnitManager::getDistance(float a1, float a2, float b1, float b2){
     return sqrt(x_diff*x_diff + z_diff*z_diff);
 }
 
-void UnitManager::updateUnits(){
-    // update all the units
-    for (Playable& unit : unit_holder->getUnits()){
-        vector<Playable*> empty_units;
-        unit.update(&(game_map->getGround()), &empty_units);
+void UnitManager::updatePaths(){
+    path_service.update();
+}
+
+bool UnitManager::updateUnits(){
+    // The replay is over, leave everything where it ended for the report
+    if(isPlaybackFinished()){
+        return false;
+    }
+
+    // Nothing moves until the other player's orders for the turn are in
+    if(lockstep && step_count % LockstepSession::TURN_STEPS == 0 && !startLockstepTurn()){
+        return false;
+    }
+
+    std::chrono::steady_clock::time_point step_start = std::chrono::steady_clock::now();
+
+    // Only steps actually taken count towards the game's time
+    GameClock::getInstance()->advanceSimulationStep();
+
+    if(playback){
+        playCommands();
+    }
+
+    // A path has to arrive on the same step every time the game is played,
+    // and on every machine in a lockstep game
+    if(recording || playback || lockstep){
+        path_service.finishAll();
     }
+
+    deliverPaths();
+
+    if(path_service.isTimeSliced()){
+        deliverPartialPaths();
+    }
+
+    if(pathing_changed || routes_repairing){
+        repairRoutes();
+    }
+
+    // update all the units. First every unit looks around, against where
+    // everyone was at the end of the last step, then every unit acts. No
+    // unit writes anything another one reads within a phase, so the chunks
+    // can run on any thread in any order and come out the same.
+    int unit_count = unit_holder->getUnitCount();
+    UnitHolder* units = unit_holder;
+    Terrain* ground = this->ground;
+
+    unit_threads.run(unit_count, UNITS_PER_CHUNK, [units, ground](int begin, int end){
+        for (int id = begin; id < end; ++id){
+            units->getUnit(id).scan(units, ground);
+        }
+    });
+
+    unit_threads.run(unit_count, UNITS_PER_CHUNK, [units, ground](int begin, int end){
+        for (int id = begin; id < end; ++id){
+            units->getUnit(id).update(ground);
+        }
+    });
+
+    // Damage and the new positions go out in id order
+    for (int id = 0; id < unit_count; ++id){
+        unit_holder->getUnit(id).resolveAttack(unit_holder);
+    }
+
+    for (int id = 0; id < unit_count; ++id){
+        unit_holder->moveUnit(id);
+    }
+
+    // The dead go now, so no loop next step has to step over them
+    unit_holder->removeDeadUnits();
+    forgetRemovedUnits();
+
+    // What everyone sees next step, from where they ended up
+    unit_holder->getVisibility().update(*unit_holder);
+
+    step_count++;
+
+    if(lockstep && step_count % LockstepSession::TURN_STEPS == 0){
+        lockstep->endTurn(step_count / LockstepSession::TURN_STEPS - 1, *unit_holder);
+    }
+
+    if(playback){
+        std::chrono::duration<double, std::milli> step_time = std::chrono::steady_clock::now() - step_start;
+        step_times.push_back(step_time.count());
+    }
+
+    return true;
 }
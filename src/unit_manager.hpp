@@ -3,29 +3,199 @@
 
 #include "playable.hpp"
 #include "unit_holder.hpp"
-#include "game_map.hpp"
+#include "terrain.hpp"
+#include "profile.hpp"
+#include "path_request_service.hpp"
+#include "incremental_pathfinder.hpp"
+#include "thread_pool.hpp"
+#include "replay.hpp"
+#include "lockstep_session.hpp"
+#include "snapshot.hpp"
+
+#include <deque>
+#include <map>
 
 using namespace std;
 
 class UnitManager {
 public:
-    UnitManager(GameMap& game_map, UnitHolder& units);
+    UnitManager(Terrain& ground, UnitHolder& units);
+    ~UnitManager();
 
     void issueOrder(Playable::Order, glm::vec3, bool);
     void selectUnit(glm::vec3);
     void selectUnits(glm::vec3, glm::vec3);
     void tempSelectUnits(glm::vec3, glm::vec3);
 
-    void updateUnits();
+    // Takes one simulation step. False if it couldn't be taken, because the
+    // replay is over or the other player's orders haven't arrived yet.
+    bool updateUnits();
+
+    // Spends the time slice on path searches, when they're time sliced.
+    // Once a frame however many steps it takes, the paths found are handed
+    // out by the steps.
+    void updatePaths();
+
+    // Every order and change of selection from here on goes into the
+    // replay, tagged with the step it came before. Paths are waited for
+    // instead of arriving whenever a search finishes, so the game can be
+    // played back exactly.
+    void startRecording(Replay& replay);
+
+    // Feeds the replay's commands in at the steps they were made, and
+    // ignores orders and selections from anywhere else. Stops stepping once
+    // the replay's last step is done.
+    void startPlayback(Replay& replay);
+    bool isPlaybackFinished();
+
+    // One JSON line with the spread of step times over the playback and
+    // the checksum of where it left the units
+    void printPlaybackReport();
+
+    // Orders go through the session and are carried out by every player on
+    // the same step. Only units on the session's team can be ordered from
+    // here.
+    void startLockstep(LockstepSession& session);
+
+    // Saves every unit, the orders still waiting on paths and the routes
+    // being walked, between steps. Loading gives every unit back its
+    // handle, so it has to be the same map, and asks for the waiting paths
+    // again. A file that doesn't read back whole changes nothing. Not while
+    // replaying or in lockstep.
+    bool saveSnapshot(string filename);
+    bool loadSnapshot(string filename);
+
+    // Steps taken since the manager was made
+    long getStepCount() {return step_count;}
 
 private:
+    // An order waiting on its path. Orders are handed to the units in the
+    // order they were issued, so queued (shift) orders stay in sequence.
+    // Units are kept by handle, and any that die meanwhile are skipped.
+    struct PendingOrder {
+        int ticket;
+        bool uses_flow_field;
+        Playable::Order order;
+        bool should_enqueue;
+        int targeted_unit;
+        vector<int> units;
+        vector<glm::vec3> targets;
+        glm::vec3 start;
+        glm::vec3 target;
+        float radius;
+
+        // First waypoint of the partial path the units were last given
+        bool has_partial_path;
+        glm::vec3 partial_first_step;
+
+        // Grid edits so far when it was asked for. A search on a worker's
+        // copy of the grid may not have seen the ones after.
+        int pathing_changes;
+    };
+
+    // An order the units are still walking. If the grid changes under a
+    // path, the route is planned again from where the group is now. A flow
+    // field can't be patched, so its units are given a new one.
+    struct ActiveRoute {
+        bool uses_flow_field;
+        Playable::Order order;
+        int targeted_unit;
+        vector<int> units;
+        vector<glm::vec3> targets;
+        glm::vec3 target;
+        float radius;
+
+        // Where the path actually ends. A target the group can't reach is
+        // moved to the closest cell it can, and repairs head there too.
+        glm::vec3 goal;
+
+        // Where the route was planned from, then its waypoints. Empty for a
+        // flow field.
+        glm::vec3 start;
+        vector<glm::vec3> path;
+
+        // Made the first time the route needs repairing, and kept so later
+        // repairs only redo the part of the search that changed
+        shared_ptr<IncrementalPathFinder> planner;
+
+        // A repair's search is spread over as many steps as it takes, and
+        // the units keep the old path until it's done
+        bool repairing;
+    };
+
+    void giveOrder(vector<int>&, Playable::Order, glm::vec3, bool);
+    void setSelection(vector<int>&);
+    void forgetRemovedUnits();
+    void recordSelection();
+    void playCommands();
+    bool startLockstepTurn();
+
     float getDistance(float, float, float, float);
+    int findClickedUnit(glm::vec3);
+    void deliverPaths();
+    void deliverPartialPaths();
+    void trackRoute(PendingOrder&, vector<glm::vec3>&);
+    void repairRoutes();
+    void startRepair(ActiveRoute&);
+    void onPathingChanged(int, int, int, int);
+    void removeFromRoutes(vector<int>&);
 
-    vector<Playable*> selected_units;
+    // Handles, only ever of living units
+    vector<int> selected_units;
+    vector<int> temp_selected_units;
     UnitHolder* unit_holder;
 
-    GameMap* game_map;
-    PathFinder pathfinder;
+    Terrain* ground;
+    PathRequestService path_service;
+    deque<PendingOrder> pending_orders;
+    FlowFieldCache flow_fields;
+    vector<ActiveRoute> active_routes;
+
+    int change_callback_id;
+    bool pathing_changed;
+    int pathing_changes;
+    bool routes_repairing;
+
+    long step_count;
+
+    // At most one of these is set
+    Replay* recording;
+    Replay* playback;
+    int next_command;
+
+    // How long each step of the playback took, in milliseconds
+    vector<double> step_times;
+
+    LockstepSession* lockstep;
+
+    // The selection our last lockstep order went out with, and each team's
+    // as of the turn being carried out, which their orders are for
+    vector<int> lockstep_sent_selection;
+    map<int, vector<int>> lockstep_selections;
+
+    // Splits each phase of the unit update between the cores
+    ThreadPool unit_threads;
+
+    // Groups at least this big share a flow field instead of one path
+    static const int FLOW_FIELD_MIN_UNITS = 16;
+
+    // Cells all the route repairs together may expand in one step
+    static const int REPAIR_NODES_PER_STEP = 4096;
+
+    // Units one thread updates at a time. Smaller armies stay on the main
+    // thread.
+    static const int UNITS_PER_CHUNK = 256;
+
+    // "RTSS", the version, and a marker written last
+    static const uint32_t SNAPSHOT_MAGIC = 0x53535452;
+    static const uint32_t SNAPSHOT_VERSION = 6;
+    static const uint32_t SNAPSHOT_END = 0x444E4553;
+
+    // Read back differently on a machine with the other byte order
+    static const uint32_t SNAPSHOT_BYTE_ORDER = 0x01020304;
+
+    // A guess at a unit's size, so the buffer is only grown once
+    static const int SNAPSHOT_BYTES_PER_UNIT = 256;
 
 };
 
@@ -0,0 +1,68 @@
+#include "unit_model.hpp"
+
+Doodad* UnitModel::selection_ring;
+
+UnitModel::UnitModel() : Drawable(), team(-1) {
+
+}
+
+UnitModel::UnitModel(Mesh& mesh, Shader& shader, GLfloat scale) : Drawable(mesh, shader, glm::vec3(0.0f), scale), team(-1) {
+
+    if(! selection_ring){
+        Mesh* selection_ring_mesh = new Mesh("res/models/selection_ring.dae");
+        selection_ring = new Doodad(*selection_ring_mesh, shader, position, 2.0f);
+        selection_ring->setEmissive(Texture("res/textures/selection_ring.png"));
+        selection_ring->rotateGlobalEuler(M_PI/2.0f, 0.0f, 0.0f);
+    }
+}
+
+Drawable* UnitModel::clone() {
+    return new UnitModel(*this);
+}
+
+void UnitModel::draw(Playable& unit){
+    if (!mesh || !unit.isAlive()){
+        return;
+    }
+
+    setTeam(unit.getTeam());
+
+    // The rest of the frame's time hasn't been simulated yet
+    glm::vec3 render_position = unit.getRenderPosition();
+    float render_rotation = unit.getRenderRotation();
+
+    setPosition(render_position);
+    setRotationEuler(unit.getRotation().x, render_rotation, unit.getRotation().z);
+
+    Drawable::draw();
+
+    if(unit.isSelected() || unit.isTempSelected()){
+        selection_ring->setPosition(glm::vec3(render_position.x, unit.getGroundHeight() + 0.5, render_position.z));
+        selection_ring->setRotationEuler(glm::vec3(M_PI/2.0f, render_rotation, 0.0));
+        selection_ring->draw();
+    }
+}
+
+void UnitModel::setTeam(int t){
+    if (t == team){
+        return;
+    }
+
+    if (t == 1){
+        setEmissive(Texture(glm::vec4(0.5, 0.5, 1, 0.1)));
+    } else if (t == 2) {
+        setEmissive(Texture(glm::vec4(0.172f, 0.855f, 0.424f, 0.1)));
+    }
+    team = t;
+}
+
+string UnitModel::asJsonString() {
+    // No defined format for a unit model in json string
+    string json_string = "";
+
+    return json_string;
+}
+
+void UnitModel::updateUniformData(){
+    glUniform1f(glGetUniformLocation(shader->getGLId(), "scale"), scale);
+}
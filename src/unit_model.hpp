@@ -0,0 +1,40 @@
+#ifndef UnitModel_h
+#define UnitModel_h
+
+#include "drawable.hpp"
+#include "doodad.hpp"
+#include "playable.hpp"
+
+using namespace std;
+
+// What a unit is drawn with: its mesh, shader, textures and matrices. The
+// Playable only holds what the simulation steps, so stepping every unit
+// never pulls any of this into cache. A UnitHolder keeps one model for each
+// unit, by the same id.
+class UnitModel : public Drawable {
+public:
+    // Nothing to draw, for units simulated without a GL context
+    UnitModel();
+    UnitModel(Mesh&, Shader& shader, GLfloat);
+    Drawable* clone();
+
+    // Draws the unit part way from its last step to this one, with its
+    // selection ring. Dead units, and models with no mesh, draw nothing.
+    void draw(Playable& unit);
+
+    string asJsonString();
+
+private:
+    void updateUniformData();
+
+    // Colours the model for a team, only when the unit's team changes
+    void setTeam(int t);
+
+    static Doodad* selection_ring;
+
+    // The team the model was last coloured for, -1 for none yet
+    int team;
+
+};
+
+#endif
@@ -0,0 +1,281 @@
+#include "visibility_grid.hpp"
+
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+
+#include "terrain.hpp"
+#include "unit_holder.hpp"
+
+const unsigned char VisibilityGrid::UNEXPLORED;
+const unsigned char VisibilityGrid::EXPLORED;
+const unsigned char VisibilityGrid::VISIBLE;
+
+const float VisibilityGrid::EYE_HEIGHT = 1.0f;
+const float VisibilityGrid::TARGET_HEIGHT = 0.5f;
+
+VisibilityGrid::VisibilityGrid() : ground(0), occlusion(false), width(0), depth(0), start_x(0), start_z(0) {
+    // Nothing is seen until there's ground to see
+}
+
+void VisibilityGrid::setGround(Terrain& ground, bool occlusion){
+    this->ground = &ground;
+    this->occlusion = occlusion;
+
+    // The same cells as the heightmap and the pathing
+    PathingGrid& grid = ground.getPathingGrid();
+    width = grid.getWidth();
+    depth = grid.getDepth();
+    start_x = grid.getStartX();
+    start_z = grid.getStartZ();
+
+    heights.resize(width * depth);
+    for (int z = 0; z < depth; ++z){
+        for (int x = 0; x < width; ++x){
+            heights[x + z * width] = ground.getHeight(x + start_x, z + start_z);
+        }
+    }
+
+    teams.clear();
+    stamps.clear();
+}
+
+void VisibilityGrid::update(UnitHolder& units){
+    if (!ground){
+        return;
+    }
+
+    for (int id = 0; id < units.getUnitCount(); ++id){
+        Playable& unit = units.getUnit(id);
+
+        auto found = stamps.find(unit.getHandle());
+        if (found == stamps.end()){
+            stamp(stamps[unit.getHandle()], unit);
+            continue;
+        }
+
+        // Most steps a unit stays inside its cell and nothing changes
+        Stamp& current = found->second;
+        if (current.cell_x != getCellX(units.getPositionX(id)) || current.cell_z != getCellZ(units.getPositionZ(id)) ||
+            current.team != units.getTeam(id)){
+            unstamp(current);
+            stamp(current, unit);
+        }
+    }
+}
+
+void VisibilityGrid::removeUnit(int handle){
+    auto found = stamps.find(handle);
+    if (found == stamps.end()){
+        return;
+    }
+
+    unstamp(found->second);
+    stamps.erase(found);
+}
+
+void VisibilityGrid::clear(){
+    stamps.clear();
+
+    for (TeamGrid& grid : teams){
+        if (grid.counts.empty()){
+            continue;
+        }
+
+        std::fill(grid.counts.begin(), grid.counts.end(), 0);
+        std::fill(grid.image.begin(), grid.image.end(), UNEXPLORED);
+
+        grid.changed = true;
+        grid.changed_min_x = 0;
+        grid.changed_min_z = 0;
+        grid.changed_max_x = width - 1;
+        grid.changed_max_z = depth - 1;
+    }
+}
+
+bool VisibilityGrid::isVisible(int team, float x, float z){
+    if (team < 0 || team >= teams.size() || teams[team].counts.empty()){
+        return false;
+    }
+
+    return teams[team].counts[getCellX(x) + getCellZ(z) * width] > 0;
+}
+
+const vector<unsigned char>& VisibilityGrid::getImage(int team){
+    if (team < 0 || team >= teams.size()){
+        return no_image;
+    }
+    return teams[team].image;
+}
+
+bool VisibilityGrid::takeChangedArea(int team, int& min_x, int& min_z, int& max_x, int& max_z){
+    if (team < 0 || team >= teams.size() || !teams[team].changed){
+        return false;
+    }
+
+    TeamGrid& grid = teams[team];
+    min_x = grid.changed_min_x;
+    min_z = grid.changed_min_z;
+    max_x = grid.changed_max_x;
+    max_z = grid.changed_max_z;
+
+    grid.changed = false;
+    return true;
+}
+
+VisibilityGrid::TeamGrid& VisibilityGrid::getTeamGrid(int team){
+    if (team >= teams.size()){
+        teams.resize(team + 1);
+    }
+
+    // Made the first time one of the team's units is stamped
+    TeamGrid& grid = teams[team];
+    if (grid.counts.empty()){
+        grid.counts.assign(width * depth, 0);
+        grid.image.assign(width * depth, UNEXPLORED);
+
+        grid.changed = true;
+        grid.changed_min_x = 0;
+        grid.changed_min_z = 0;
+        grid.changed_max_x = width - 1;
+        grid.changed_max_z = depth - 1;
+    }
+
+    return grid;
+}
+
+int VisibilityGrid::getCellX(float x){
+    return std::max(0, std::min(int(std::floor(x)) - start_x, width - 1));
+}
+
+int VisibilityGrid::getCellZ(float z){
+    return std::max(0, std::min(int(std::floor(z)) - start_z, depth - 1));
+}
+
+void VisibilityGrid::stamp(Stamp& stamp, Playable& unit){
+    glm::vec3 position = unit.getPosition();
+
+    stamp.team = unit.getTeam();
+    stamp.cell_x = getCellX(position.x);
+    stamp.cell_z = getCellZ(position.z);
+    stamp.cells.clear();
+
+    TeamGrid& grid = getTeamGrid(stamp.team);
+
+    // Sight is measured from the unit's edge, like weapon range
+    const Disc& disc = getDisc(unit.getRadius() + unit.getSightRadius());
+
+    // From the ground under the cell rather than the unit, so the stamp only
+    // depends on which cell the unit is in
+    float eye_height = heights[stamp.cell_x + stamp.cell_z * width] + EYE_HEIGHT;
+
+    // Near the edges the lines of sight are checked one by one
+    bool inside = stamp.cell_x >= disc.reach_cells && stamp.cell_x < width - disc.reach_cells &&
+                  stamp.cell_z >= disc.reach_cells && stamp.cell_z < depth - disc.reach_cells;
+
+    for (const DiscCell& disc_cell : disc.cells){
+        int x = stamp.cell_x + disc_cell.dx;
+        int z = stamp.cell_z + disc_cell.dz;
+        if (!inside && (x < 0 || x >= width || z < 0 || z >= depth)){
+            continue;
+        }
+
+        if (occlusion && !canSee(disc, disc_cell, stamp.cell_x, stamp.cell_z, eye_height)){
+            continue;
+        }
+
+        int cell = x + z * width;
+        stamp.cells.push_back(cell);
+
+        if (grid.counts[cell]++ == 0){
+            grid.image[cell] = VISIBLE;
+            markChanged(grid, cell);
+        }
+    }
+}
+
+const VisibilityGrid::Disc& VisibilityGrid::getDisc(float reach){
+    auto found = discs.find(reach);
+    if (found != discs.end()){
+        return found->second;
+    }
+
+    Disc& disc = discs[reach];
+    disc.reach_cells = int(reach);
+
+    for (int dz = -disc.reach_cells; dz <= disc.reach_cells; ++dz){
+        for (int dx = -disc.reach_cells; dx <= disc.reach_cells; ++dx){
+            if (dx * dx + dz * dz > reach * reach){
+                continue;
+            }
+
+            DiscCell disc_cell;
+            disc_cell.dx = dx;
+            disc_cell.dz = dz;
+            disc_cell.path_start = disc.paths.size();
+
+            // The cells between the centre and this one, nearest first
+            int steps = std::max(std::abs(dx), std::abs(dz));
+            for (int i = 1; i < steps; ++i){
+                PathCell path_cell;
+                path_cell.t = float(i) / steps;
+                path_cell.dx = int(std::round(dx * path_cell.t));
+                path_cell.dz = int(std::round(dz * path_cell.t));
+                disc.paths.push_back(path_cell);
+            }
+
+            disc_cell.path_count = disc.paths.size() - disc_cell.path_start;
+            disc.cells.push_back(disc_cell);
+        }
+    }
+
+    return disc;
+}
+
+void VisibilityGrid::unstamp(Stamp& stamp){
+    TeamGrid& grid = teams[stamp.team];
+
+    // Still remembered as seen, just not seen now
+    for (int cell : stamp.cells){
+        if (--grid.counts[cell] == 0){
+            grid.image[cell] = EXPLORED;
+            markChanged(grid, cell);
+        }
+    }
+
+    stamp.cells.clear();
+}
+
+bool VisibilityGrid::canSee(const Disc& disc, const DiscCell& disc_cell, int from_x, int from_z, float eye_height){
+    int centre = from_x + from_z * width;
+    float target_height = heights[centre + disc_cell.dx + disc_cell.dz * width] + TARGET_HEIGHT;
+
+    // Every cell the line passes over has to be below it. They're all
+    // between the centre and the target, so on the grid if both are.
+    const PathCell* path = disc.paths.data() + disc_cell.path_start;
+    for (int i = 0; i < disc_cell.path_count; ++i){
+        float line_height = eye_height + (target_height - eye_height) * path[i].t;
+        if (heights[centre + path[i].dx + path[i].dz * width] > line_height){
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void VisibilityGrid::markChanged(TeamGrid& grid, int cell){
+    int x = cell % width;
+    int z = cell / width;
+
+    if (!grid.changed){
+        grid.changed = true;
+        grid.changed_min_x = grid.changed_max_x = x;
+        grid.changed_min_z = grid.changed_max_z = z;
+        return;
+    }
+
+    grid.changed_min_x = std::min(grid.changed_min_x, x);
+    grid.changed_min_z = std::min(grid.changed_min_z, z);
+    grid.changed_max_x = std::max(grid.changed_max_x, x);
+    grid.changed_max_z = std::max(grid.changed_max_z, z);
+}
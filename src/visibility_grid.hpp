@@ -0,0 +1,141 @@
+#ifndef VisibilityGrid_h
+#define VisibilityGrid_h
+
+#include <vector>
+#include <unordered_map>
+
+using namespace std;
+
+class Terrain;
+class UnitHolder;
+class Playable;
+
+// What each team can see, one cell per point of the terrain's heightmap.
+// Every unit stamps the disc it can see into its team's grid, and each cell
+// counts how many of the team's units see it. A unit is only stamped again
+// when it moves into another cell, so a step costs about as much as the
+// units that crossed a cell, not every unit's whole disc.
+//
+// With occlusion on, a cell behind higher ground than the line from the
+// unit's eyes to it isn't seen. Each stamp remembers the cells it counted,
+// so taking it away again gives the same counts back. The cells of a sight
+// disc, and the cells each line of sight crosses, are worked out once for
+// every reach and reused by every stamp with it.
+//
+// Each team also has an image of its grid for the terrain shader: cells it
+// sees now, cells it saw before, and cells it never saw. The part of the
+// image that changed is kept as a rectangle to upload.
+class VisibilityGrid {
+public:
+    VisibilityGrid();
+
+    // Covers the ground, and forgets everything seen so far
+    void setGround(Terrain& ground, bool occlusion);
+
+    // Stamps the units that are new or moved into another cell since the
+    // last update
+    void update(UnitHolder& units);
+
+    // Takes a unit's stamp away, when it's removed
+    void removeUnit(int handle);
+
+    // Every stamp and everything seen is forgotten. The next update stamps
+    // all the units again.
+    void clear();
+
+    // Whether any of the team's units sees the cell under (x, z)
+    bool isVisible(int team, float x, float z);
+
+    int getWidth() {return width;}
+    int getDepth() {return depth;}
+
+    // The team's image, a byte per cell in rows of width. Empty if the team
+    // hasn't stamped anything yet.
+    const vector<unsigned char>& getImage(int team);
+
+    // The cells of the team's image that changed since the last call, if
+    // any. The maxima are inclusive.
+    bool takeChangedArea(int team, int& min_x, int& min_z, int& max_x, int& max_z);
+
+    static const unsigned char UNEXPLORED = 0;
+    static const unsigned char EXPLORED = 100;
+    static const unsigned char VISIBLE = 255;
+
+    // How high above the ground a unit sees from, and a cell is looked at
+    static const float EYE_HEIGHT;
+    static const float TARGET_HEIGHT;
+
+private:
+    struct Stamp {
+        int team;
+        int cell_x;
+        int cell_z;
+        vector<int> cells;
+    };
+
+    // A cell of a sight disc, relative to its centre. Its line of sight
+    // crosses path_count cells from path_start in the disc's paths.
+    struct DiscCell {
+        int dx;
+        int dz;
+        int path_start;
+        int path_count;
+    };
+
+    struct PathCell {
+        int dx;
+        int dz;
+        float t;
+    };
+
+    struct Disc {
+        int reach_cells;
+        vector<DiscCell> cells;
+        vector<PathCell> paths;
+    };
+
+    struct TeamGrid {
+        vector<unsigned short> counts;
+        vector<unsigned char> image;
+
+        bool changed;
+        int changed_min_x;
+        int changed_min_z;
+        int changed_max_x;
+        int changed_max_z;
+    };
+
+    TeamGrid& getTeamGrid(int team);
+    const Disc& getDisc(float reach);
+    int getCellX(float x);
+    int getCellZ(float z);
+
+    void stamp(Stamp& stamp, Playable& unit);
+    void unstamp(Stamp& stamp);
+    bool canSee(const Disc& disc, const DiscCell& disc_cell, int from_x, int from_z, float eye_height);
+    void markChanged(TeamGrid& grid, int cell);
+
+    Terrain* ground;
+    bool occlusion;
+
+    int width;
+    int depth;
+    int start_x;
+    int start_z;
+
+    // The ground's heights, a float per cell, for the lines of sight
+    vector<float> heights;
+
+    // By reach
+    unordered_map<float, Disc> discs;
+
+    // By team number
+    vector<TeamGrid> teams;
+
+    // By unit handle
+    unordered_map<int, Stamp> stamps;
+
+    vector<unsigned char> no_image;
+};
+
+#endif
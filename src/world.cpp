@@ -1,6 +1,6 @@
 #include "world.hpp"
 
-World::World(string level_filename, bool edit_mode) : render_stack(), level(level_filename, render_stack){
+World::World(string level_filename, bool edit_mode, unsigned int seed) : render_stack(), level(level_filename, render_stack, seed){
     this->edit_mode = edit_mode;
 
     if (edit_mode){
@@ -15,11 +15,13 @@ using namespace std;
 
 class World{
 public:
-    World(string, bool);
+    World(string, bool, unsigned int);
     ~World();
 
     void update();
 
+    Level& getLevel() {return level;}
+
 private:
     RenderDeque render_stack;
     Level level;
@@ -0,0 +1,256 @@
+// Headless pathfinding benchmark. Builds the pathing grid of each heightmap
+// the same way the game does (without a window), runs a seeded batch of
+// random queries per radius and search mode, and prints one JSON object per
+// line so runs can be diffed against a baseline.
+//
+//   make pathbench
+//   ./pathbench [-q queries] [-s seed] [-a amplification] [heightmap.png ...]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "terrain_pathing.hpp"
+#include "pathing_grid.hpp"
+#include "pathfinder.hpp"
+#include "hierarchical_pathfinder.hpp"
+
+using namespace std;
+
+// Every allocation made through new is counted, so a query's allocations are
+// the difference across it. Single threaded, so plain counters are enough.
+static size_t allocated_bytes = 0;
+static size_t allocation_count = 0;
+
+void* operator new(size_t size){
+    allocated_bytes += size;
+    allocation_count++;
+
+    void* memory = malloc(size ? size : 1);
+    if (!memory){
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void operator delete(void* memory) noexcept {
+    free(memory);
+}
+
+struct Query {
+    int start_x;
+    int start_z;
+    int target_x;
+    int target_z;
+};
+
+struct Sample {
+    double microseconds;
+    int nodes_expanded;
+    size_t bytes;
+    size_t allocations;
+    int waypoints;
+};
+
+static const char* DEFAULT_MAPS[] = {
+    "res/textures/maze.png",
+    "res/textures/mountains.png",
+    "res/textures/heightmap.png",
+    "res/textures/simple_heightmap.png"
+};
+
+static const float RADII[] = { 0.5f, 1.0f, 2.0f, 4.0f };
+
+static const char* MODES[] = { "astar", "jump_point", "hierarchical", "navigation_mesh" };
+
+static double percentile(vector<double> values, double fraction){
+    // Nearest rank
+    std::sort(values.begin(), values.end());
+    int rank = int(ceil(fraction * values.size())) - 1;
+    return values[std::max(0, std::min(rank, int(values.size()) - 1))];
+}
+
+static vector<Query> makeQueries(PathingGrid& grid, float radius, int count, unsigned int seed){
+    // Starts are always somewhere the unit fits. Targets are anywhere on the
+    // map, like clicks, so some of them can't be reached.
+    std::mt19937 random(seed);
+    int clearance = PathingGrid::getClearanceClass(radius);
+
+    vector<Query> queries;
+    int attempts = 0;
+
+    while (queries.size() < count && attempts < count * 1000){
+        attempts++;
+
+        Query query;
+        query.start_x = int(random() % grid.getWidth()) + grid.getStartX();
+        query.start_z = int(random() % grid.getDepth()) + grid.getStartZ();
+        query.target_x = int(random() % grid.getWidth()) + grid.getStartX();
+        query.target_z = int(random() % grid.getDepth()) + grid.getStartZ();
+
+        if (grid.canPath(query.start_x, query.start_z, clearance)){
+            queries.push_back(query);
+        }
+    }
+
+    return queries;
+}
+
+static Sample runQuery(int mode, Query& query, float radius, PathFinder& pathfinder, HierarchicalPathFinder& hierarchical){
+    Sample sample;
+    size_t bytes_before = allocated_bytes;
+    size_t allocations_before = allocation_count;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    vector<glm::vec3> path;
+    if (mode == 2){
+        // Refined all the way, so it's timed to the same whole path the
+        // other modes give, not just the front a unit starts out on
+        path = hierarchical.find_path(query.start_x, query.start_z, query.target_x, query.target_z, radius);
+        int refined = hierarchical.getRefinedCount();
+        while (hierarchical.refineNext(path, refined, radius)){
+        }
+        sample.nodes_expanded = hierarchical.getNodesExpanded();
+    } else {
+        PathFinder::Mode search_mode = PathFinder::Mode::NAVIGATION_MESH;
+        if (mode == 0){
+            search_mode = PathFinder::Mode::ASTAR;
+        } else if (mode == 1){
+            search_mode = PathFinder::Mode::JUMP_POINT;
+        }
+        path = pathfinder.find_path(query.start_x, query.start_z, query.target_x, query.target_z, radius, search_mode);
+        sample.nodes_expanded = pathfinder.getNodesExpanded();
+    }
+
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    sample.microseconds = std::chrono::duration<double, std::micro>(end - start).count();
+    sample.bytes = allocated_bytes - bytes_before;
+    sample.allocations = allocation_count - allocations_before;
+    sample.waypoints = path.size();
+    return sample;
+}
+
+static void report(const string& map, PathingGrid& grid, float radius, int mode, vector<Sample>& samples){
+    vector<double> latencies;
+    vector<double> nodes;
+    double total_bytes = 0.0;
+    double total_allocations = 0.0;
+    double total_waypoints = 0.0;
+
+    for (Sample& sample : samples){
+        latencies.push_back(sample.microseconds);
+        nodes.push_back(sample.nodes_expanded);
+        total_bytes += sample.bytes;
+        total_allocations += sample.allocations;
+        total_waypoints += sample.waypoints;
+    }
+
+    double count = std::max(int(samples.size()), 1);
+    double total_latency = 0.0;
+    double total_nodes = 0.0;
+    for (int i = 0; i < samples.size(); ++i){
+        total_latency += latencies[i];
+        total_nodes += nodes[i];
+    }
+
+    printf("{\"type\": \"queries\", \"map\": \"%s\", \"width\": %d, \"depth\": %d, \"radius\": %.2f, \"mode\": \"%s\", \"queries\": %d, "
+           "\"mean_us\": %.2f, \"p50_us\": %.2f, \"p95_us\": %.2f, \"p99_us\": %.2f, \"max_us\": %.2f, "
+           "\"mean_nodes\": %.1f, \"p99_nodes\": %.0f, \"bytes_per_query\": %.1f, \"allocations_per_query\": %.2f, \"mean_waypoints\": %.2f}\n",
+           map.c_str(), grid.getWidth(), grid.getDepth(), radius, MODES[mode], int(samples.size()),
+           total_latency / count, percentile(latencies, 0.50), percentile(latencies, 0.95), percentile(latencies, 0.99), percentile(latencies, 1.0),
+           total_nodes / count, percentile(nodes, 0.99), total_bytes / count, total_allocations / count, total_waypoints / count);
+}
+
+int main(int argc, char* argv[]){
+    int query_count = 1000;
+    unsigned int seed = 1;
+    float amplification = 10.0f;
+    vector<string> maps;
+
+    for (int i = 1; i < argc; ++i){
+        if (!strcmp(argv[i], "-q") && i + 1 < argc){
+            query_count = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-s") && i + 1 < argc){
+            seed = strtoul(argv[++i], 0, 10);
+        } else if (!strcmp(argv[i], "-a") && i + 1 < argc){
+            amplification = atof(argv[++i]);
+        } else if (argv[i][0] == '-'){
+            fprintf(stderr, "usage: %s [-q queries] [-s seed] [-a amplification] [heightmap.png ...]\n", argv[0]);
+            return 1;
+        } else {
+            maps.push_back(argv[i]);
+        }
+    }
+
+    if (maps.empty()){
+        maps.assign(DEFAULT_MAPS, DEFAULT_MAPS + sizeof(DEFAULT_MAPS) / sizeof(DEFAULT_MAPS[0]));
+    }
+
+    for (string& map : maps){
+        vector<float> heights;
+        int width;
+        int depth;
+
+        if (!TerrainPathing::loadHeights(map, amplification, heights, width, depth)){
+            return 1;
+        }
+
+        std::chrono::steady_clock::time_point build_start = std::chrono::steady_clock::now();
+        PathingGrid grid = TerrainPathing::generate(heights, width, depth);
+        double build_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - build_start).count();
+
+        int pathable = 0;
+        for (int z = 0; z < depth; ++z){
+            for (int x = 0; x < width; ++x){
+                pathable += grid.canPath(x + grid.getStartX(), z + grid.getStartZ());
+            }
+        }
+
+        printf("{\"type\": \"grid\", \"map\": \"%s\", \"width\": %d, \"depth\": %d, \"pathable\": %.4f, \"build_ms\": %.2f, \"seed\": %u}\n",
+               map.c_str(), width, depth, double(pathable) / (width * depth), build_ms, seed);
+
+        PathFinder pathfinder(grid);
+        PathFinder local_pathfinder(grid, PathFinder::Mode::JUMP_POINT);
+        HierarchicalPathFinder hierarchical(grid, local_pathfinder);
+
+        for (float radius : RADII){
+            vector<Query> queries = makeQueries(grid, radius, query_count, seed);
+            if (queries.empty()){
+                continue;
+            }
+
+            // The mesh is built lazily as well, time it on its own
+            int clearance = PathingGrid::getClearanceClass(radius);
+            std::chrono::steady_clock::time_point mesh_start = std::chrono::steady_clock::now();
+            NavigationMesh& mesh = grid.getNavigationMesh(clearance);
+            double mesh_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - mesh_start).count();
+
+            printf("{\"type\": \"navigation_mesh\", \"map\": \"%s\", \"radius\": %.2f, \"polygons\": %d, \"portals\": %d, \"build_ms\": %.2f}\n",
+                   map.c_str(), radius, mesh.getPolygonCount(), mesh.getPortalCount(), mesh_ms);
+
+            for (int mode = 0; mode < 4; ++mode){
+                // One query first, so the lazily built per-class data (regions,
+                // line bits, the abstract graph) isn't charged to the batch
+                runQuery(mode, queries[0], radius, pathfinder, hierarchical);
+
+                vector<Sample> samples;
+                for (Query& query : queries){
+                    samples.push_back(runQuery(mode, query, radius, pathfinder, hierarchical));
+                }
+
+                report(map, grid, radius, mode, samples);
+                fflush(stdout);
+            }
+        }
+    }
+
+    return 0;
+}